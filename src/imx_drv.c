@@ -94,6 +94,7 @@ extern Bool IMX_EXA_PreInit(ScrnInfoPtr pScrn);
 extern Bool IMX_EXA_ScreenInit(int scrnIndex, ScreenPtr pScreen);
 extern Bool IMX_EXA_CloseScreen(int scrnIndex, ScreenPtr pScreen);
 extern Bool IMX_EXA_GetPixmapProperties(PixmapPtr pPixmap, void** pPhysAddr, int* pPitch);
+extern void IMX_EXA_UnpinPixmap(PixmapPtr pPixmap);
 
 /* for X extension */
 extern void IMX_EXT_Init();
@@ -134,6 +135,20 @@ static SymTabRec IMXChipsets[] = {
 #define OPTION_STR_COMPOSITING	"Compositing"
 #define OPTION_STR_XV_BILINEAR	"XvBilinear"
 #define OPTION_STR_XV_DOUBLEFB	"XvDoubleBuffering"
+#define OPTION_STR_EVICTION_POLICY	"EvictionPolicy"
+#define OPTION_STR_COMPRESS_EVICTED	"CompressEvicted"
+#define OPTION_STR_COMPRESS_EVICTED_MIN_KB	"CompressEvictedMinKB"
+#define OPTION_STR_MIN_SURF_AREA	"MinSurfaceArea"
+#define OPTION_STR_MIN_SURF_HEIGHT	"MinSurfaceHeight"
+#define OPTION_STR_MAX_SURF_DIM	"MaxSurfaceDim"
+#define OPTION_STR_PIXMAP_ATLAS	"PixmapAtlas"
+#define OPTION_STR_GPUMEM_BUDGET_KB	"GpuMemBudgetKB"
+#define OPTION_STR_GPUMEM_HIGH_WATERMARK	"GpuMemHighWatermark"
+#define OPTION_STR_GPUMEM_LOW_WATERMARK	"GpuMemLowWatermark"
+#define OPTION_STR_GPUMEM_DEFRAG	"GpuMemDefrag"
+#define OPTION_STR_VIDMEM_HEAP	"VidmemHeap"
+#define OPTION_STR_CPU_SMALL_OPS	"CpuSmallOps"
+#define OPTION_STR_CPU_OP_COSTS	"CpuOpCosts"
 #define OPTION_STR_DEBUG		"Debug"
 
 static const OptionInfoRec IMXOptions[] = {
@@ -144,6 +159,20 @@ static const OptionInfoRec IMXOptions[] = {
 	{ OPTION_COMPOSITING,	OPTION_STR_COMPOSITING,	OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_XV_BILINEAR,	OPTION_STR_XV_BILINEAR,	OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_XV_DOUBLEFB,	OPTION_STR_XV_DOUBLEFB,	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_EVICTION_POLICY,	OPTION_STR_EVICTION_POLICY,	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_COMPRESS_EVICTED,	OPTION_STR_COMPRESS_EVICTED,	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_COMPRESS_EVICTED_MIN_KB,	OPTION_STR_COMPRESS_EVICTED_MIN_KB,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_MIN_SURF_AREA,	OPTION_STR_MIN_SURF_AREA,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_MIN_SURF_HEIGHT,	OPTION_STR_MIN_SURF_HEIGHT,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_MAX_SURF_DIM,	OPTION_STR_MAX_SURF_DIM,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_PIXMAP_ATLAS,	OPTION_STR_PIXMAP_ATLAS,	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_GPUMEM_BUDGET_KB,	OPTION_STR_GPUMEM_BUDGET_KB,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_GPUMEM_HIGH_WATERMARK,	OPTION_STR_GPUMEM_HIGH_WATERMARK,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_GPUMEM_LOW_WATERMARK,	OPTION_STR_GPUMEM_LOW_WATERMARK,	OPTV_INTEGER,	{0},	FALSE },
+	{ OPTION_GPUMEM_DEFRAG,	OPTION_STR_GPUMEM_DEFRAG,	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_VIDMEM_HEAP,	OPTION_STR_VIDMEM_HEAP,	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_CPU_SMALL_OPS,	OPTION_STR_CPU_SMALL_OPS,	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_CPU_OP_COSTS,	OPTION_STR_CPU_OP_COSTS,	OPTV_STRING,	{0},	FALSE },
 	{ OPTION_DEBUG,			OPTION_STR_DEBUG,		OPTV_BOOLEAN,	{0},	FALSE },
 	{ -1,					NULL,					OPTV_NONE,		{0},	FALSE }
 };
@@ -815,6 +844,35 @@ IMXGetPixmapProperties(
 	return IMX_EXA_GetPixmapProperties(pPixmap, pPhysAddr, pPitch);
 }
 
+void
+IMXUnpinPixmap(
+	PixmapPtr pPixmap)
+{
+	/* Is there a pixmap? */
+	if (NULL == pPixmap) {
+		return;
+	}
+
+	/* Access screen associated with this pixmap. */
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+
+	/* Check if the screen associated with this pixmap has IMX driver. */
+	if (0 != strcmp(IMX_DRIVER_NAME, pScrn->driverName)) {
+		return;
+	}
+
+	/* Access driver specific content. */
+	IMXPtr fPtr = IMXPTR(pScrn);
+
+	/* Nothing was pinned if not accelerating. */
+	if (IMXEXA_BACKEND_NONE == fPtr->backend) {
+		return;
+	}
+
+	/* Release a pin taken by IMXGetPixmapProperties. */
+	IMX_EXA_UnpinPixmap(pPixmap);
+}
+
 static Bool
 IMXDriverFunc(ScrnInfoPtr pScrn, xorgDriverFuncOp op, pointer ptr)
 {
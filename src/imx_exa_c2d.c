@@ -23,13 +23,20 @@
  * SOFTWARE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <xf86.h>
 #include <fbdevhw.h>
 #include <exa.h>
+#include <pixman.h>
 
 #include <sys/ioctl.h>
 #include <linux/fb.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 /* Preparation for the inclusion of c2d_api.h */
@@ -49,16 +56,104 @@
 #error This driver can be built only against EXA version 2.5.0 or higher.
 #endif
 
-/* Minimal area of pixel surfaces for accelerating operations. */
+/* Minimal area of pixel surfaces for accelerating operations; default of Option "MinSurfaceArea". */
 #define IMX_EXA_MIN_SURF_AREA				2048 /* 4KB at 16bpp */
 /* WARNING: Z160 backend may have stability issues with surface heights less than 32 (corrupted tooltips etc.). */
+/* Default of Option "MinSurfaceHeight". */
 #define	IMX_EXA_MIN_SURF_HEIGHT				32
-/* Maximal dimension of pixel surfaces for accelerating operations. */
+/* Maximal dimension of pixel surfaces for accelerating operations; upper bound of Option "MaxSurfaceDim". */
 #define IMX_EXA_MAX_SURF_DIM 				2048
 /* NOTE: When scale-blitting Z160 cannot address a source beyond the 1024th row/column */
 /* (it runs out of src coord bits and wraps around), but otherwise it can address 2048 units */
 /* in each direction. Large pixmaps are usually identity-blitted, so we take the risk. */
 
+/* Byte budget of the pool of recycled pixmap surfaces. */
+#define IMX_EXA_SURF_POOL_MAX_BYTES			(4 * 1024 * 1024)
+/* Number of exa ops after which a pooled surface is considered stale and gets freed. */
+#define IMX_EXA_SURF_POOL_MAX_AGE			4096
+
+/* Max number of best-scored victims considered in a single eviction pass. */
+#define IMX_EXA_EVICTION_BATCH				32
+/* Multiple of the bytes needed by an eviction that the clock hand collects candidates for. */
+#define IMX_EXA_CLOCK_WINDOW_FACTOR			2
+/* Estimated fixed cost of reinstating an evicted pixmap (alloc, lock, unlock), in bytes-copied equivalents. */
+#define IMX_EXA_EVICTION_FIXED_COST			(64 * 1024)
+
+/* Number of exa ops after an evicting allocation during which gpumem is considered under pressure. */
+#define IMX_EXA_PRESSURE_WINDOW				256
+/* Under pressure, nil-usage pixmaps smaller than this multiple of the min area don't evict others. */
+#define IMX_EXA_PRESSURE_AREA_FACTOR		4
+
+/* Failures, and ratio of failures to uses, past which an offscreen pixmap gets demoted to sysmem. */
+#define IMX_EXA_DEMOTE_MIN_FAILURES			4
+#define IMX_EXA_DEMOTE_FAILURES_PER_USE		2.5
+/* Heat of acceleration requests at which a sysmem pixmap gets promoted to gpumem. */
+#define IMX_EXA_PROMOTE_HEAT				8
+/* Number of exa ops over which the heat of a pixmap halves. */
+#define IMX_EXA_HEAT_HALF_LIFE				64
+/* Number of exa ops after a migration during which a pixmap is not migrated back. */
+#define IMX_EXA_MIGRATION_HOLDOFF			512
+
+/* Defaults of the gpumem watermarks, in percent of the gpumem budget. */
+#define IMX_EXA_GPUMEM_HIGH_WATERMARK		90
+#define IMX_EXA_GPUMEM_LOW_WATERMARK		75
+/* Number of exa ops a pixmap must go unused to be evicted at idle time. */
+#define IMX_EXA_IDLE_EVICTION_MIN_AGE		1024
+
+/* Number of exa ops between checks of gpumem fragmentation at idle time. */
+#define IMX_EXA_DEFRAG_CHECK_INTERVAL		4096
+/* Max number of blocks, and max bytes, of free gpumem held at once by a fragmentation check; */
+/* gpumem is shared with VPU, GL and Xv, whose allocations fail while the check holds it. */
+#define IMX_EXA_DEFRAG_PROBE_BLOCKS			16
+#define IMX_EXA_DEFRAG_PROBE_MAX_BYTES		(8 * 1024 * 1024)
+/* Fragmentation in percent, and least free gpumem, from which gpumem gets compacted. */
+#define IMX_EXA_DEFRAG_THRESHOLD			50
+#define IMX_EXA_DEFRAG_MIN_FREE				(1024 * 1024)
+/* Max number of pixmaps relocated per idle moment. */
+#define IMX_EXA_DEFRAG_BATCH				16
+
+/* Default size of the smallest sysmem backup worth compressing. */
+#define IMX_EXA_PACK_MIN_BYTES				(64 * 1024)
+
+/* Max number of draws queued before they get flushed to the GPU. */
+#define IMX_EXA_FLUSH_MAX_PENDING_DRAWS		64
+/* Length in ms of the window over which the rate of flushes is measured. */
+#define IMX_EXA_FLUSH_RATE_WINDOW			1000
+
+/* Most bytes of the scratch surface that overlapping copies get bounced through. */
+#define IMX_EXA_SCRATCH_MAX_BYTES			(2 * 1024 * 1024)
+
+/* Largest rect area, in pixels, ever considered for doing on the CPU. */
+#define IMX_EXA_CPU_OP_MAX_AREA				16384
+/* Costs of the model routing small ops to the CPU, used if calibration at startup fails: */
+/* ns per GPU draw, ns per surface lock plus unlock, ps per pixel filled and copied by the CPU. */
+#define IMX_EXA_COST_GPU_DRAW				20000
+#define IMX_EXA_COST_LOCK					10000
+#define IMX_EXA_COST_CPU_FILL				2000
+#define IMX_EXA_COST_CPU_COPY				20000
+/* Bytes of each of the cached dst, src and mask rows composited with component alpha at a time. */
+#define IMX_EXA_CA_CHUNK_BYTES				(64 * 1024)
+/* Geometry of the scratch surface of the calibration, and number of timed passes over it. */
+#define IMX_EXA_CALIBRATE_WIDTH				256
+#define IMX_EXA_CALIBRATE_HEIGHT			64
+#define IMX_EXA_CALIBRATE_REPEATS			8
+/* Width of the single-row surfaces the raster ops and blend modes get checked on at startup. */
+#define IMX_EXA_ROP_CHECK_WIDTH				8
+
+/* Geometry of the atlas surfaces shared by small pixmaps. */
+#define IMX_EXA_ATLAS_WIDTH					1024
+#define IMX_EXA_ATLAS_HEIGHT				256
+/* Max geometry of pixmaps sub-allocated from atlases. */
+#define IMX_EXA_ATLAS_MAX_PIXMAP_WIDTH		256
+#define IMX_EXA_ATLAS_MAX_PIXMAP_HEIGHT		64
+/* Alignment of sub-surfaces within atlases, in bytes horizontally and in rows vertically. */
+#define IMX_EXA_ATLAS_ALIGN_BYTES			64
+#define IMX_EXA_ATLAS_HEIGHT_GRAIN			4
+
+/* Alignment of the surfaces in the heap over spare framebuffer memory, and least heap size worth setting up. */
+#define IMX_EXA_VIDMEM_ALIGN_BYTES			64
+#define IMX_EXA_VIDMEM_MIN_BYTES			(256 * 1024)
+
 /* This flag must be enabled to perform any debug logging */
 #define IMX_EXA_DEBUG_MASTER				(0 && IMX_DEBUG_MASTER)
 
@@ -72,7 +167,19 @@
 #define	IMX_EXA_DEBUG_PREPARE_COMPOSITE		(0 && IMX_EXA_DEBUG_MASTER)
 #define	IMX_EXA_DEBUG_COMPOSITE				(0 && IMX_EXA_DEBUG_MASTER)
 #define IMX_EXA_DEBUG_EVICTION				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_DEFRAG				(0 && IMX_EXA_DEBUG_MASTER)
 #define IMX_EXA_DEBUG_DEMOTION				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_PROMOTION				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_SURF_POOL				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_PACK					(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_ATLAS					(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_VIDMEM				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_FLUSH					(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_STATE					(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_BATCH					(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_CPU_OPS				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_OVERLAP				(0 && IMX_EXA_DEBUG_MASTER)
+#define IMX_EXA_DEBUG_PLANEMASK				(0 && IMX_EXA_DEBUG_MASTER)
 #define IMX_EXA_DEBUG_TRACE					(0 && IMX_EXA_DEBUG_MASTER)
 
 #if IMX_EXA_DEBUG_TRACE
@@ -381,6 +488,57 @@ imxexa_string_from_c2d_format(
 	return "unknown";
 }
 
+unsigned
+imxexa_bpp_from_c2d_format(
+	C2D_COLORFORMAT format)
+{
+	switch (format) {
+
+	/* 1bpp formats */
+	case C2D_COLOR_A1:
+		return 1;
+
+	/* 4bpp formats */
+	case C2D_COLOR_A4:
+		return 4;
+
+	/* 8bpp formats */
+	case C2D_COLOR_A8:
+	case C2D_COLOR_8:
+		return 8;
+
+	/* 16bpp formats */
+	case C2D_COLOR_4444:
+	case C2D_COLOR_4444_RGBA:
+	case C2D_COLOR_1555:
+	case C2D_COLOR_5551_RGBA:
+	case C2D_COLOR_0565:
+		return 16;
+
+	/* 32bpp formats */
+	case C2D_COLOR_8888:
+	case C2D_COLOR_8888_RGBA:
+	case C2D_COLOR_8888_ABGR:
+		return 32;
+
+	/* 24bpp formats */
+	case C2D_COLOR_888:
+		return 24;
+
+	/* 16bpp formats */
+	case C2D_COLOR_YVYU:
+	case C2D_COLOR_UYVY:
+	case C2D_COLOR_YUY2:
+		return 16;
+
+	/* Pacify the compiler. */
+	default:
+		break;
+	}
+
+	return 0;
+}
+
 static inline const char*
 imxexa_string_from_priv_pixmap(
 	IMXEXAPixmapPtr fPixmapPtr)
@@ -439,17 +597,32 @@ imxexa_register_pixmap_with_driver(
 	if (NULL == fPixmapPtr)
 		return;
 
-	/* Put new pixmap at the head of pixmap list. */
-	/* If new pixmap is alone - put it as primary eviction candidate. */
-	fPixmapPtr->prev = NULL;
-	fPixmapPtr->next = fPtr->pFirstPix;
+	/* Put new pixmap right behind the clock hand, i.e. last in line for */
+	/* examination by the hand; the tail of the list if the hand is at the head. */
+	IMXEXAPixmapPtr next = fPtr->pClockHand;
+	IMXEXAPixmapPtr prev = NULL != next ? next->prev : fPtr->pLastPix;
+
+	if (next == fPtr->pFirstPix) {
+
+		prev = fPtr->pLastPix;
+		next = NULL;
+	}
+
+	fPixmapPtr->prev = prev;
+	fPixmapPtr->next = next;
 
-	if (NULL != fPtr->pFirstPix)
-		fPtr->pFirstPix->prev = fPixmapPtr;
+	if (NULL != prev)
+		prev->next = fPixmapPtr;
 	else
-		fPtr->pFirstEvictionCandidate = fPixmapPtr;
+		fPtr->pFirstPix = fPixmapPtr;
 
-	fPtr->pFirstPix = fPixmapPtr;
+	if (NULL != next)
+		next->prev = fPixmapPtr;
+	else
+		fPtr->pLastPix = fPixmapPtr;
+
+	/* New pixmaps get a reference to start with. */
+	fPixmapPtr->referenced = TRUE;
 }
 
 static inline void
@@ -460,8 +633,11 @@ imxexa_unregister_pixmap_from_driver(
 	if (NULL == fPixmapPtr)
 		return;
 
-	/* Unlink pixmap from siblings. If pixmap was last in list and thus */
-	/* primary eviction candidate - update eviction candidates head. */
+	/* Move the clock hand off the pixmap. */
+	if (fPtr->pClockHand == fPixmapPtr)
+		fPtr->pClockHand = fPixmapPtr->next;
+
+	/* Unlink pixmap from siblings. */
 	if (NULL != fPixmapPtr->prev)
 		fPixmapPtr->prev->next = fPixmapPtr->next;
 	else
@@ -470,1325 +646,5412 @@ imxexa_unregister_pixmap_from_driver(
 	if (NULL != fPixmapPtr->next)
 		fPixmapPtr->next->prev = fPixmapPtr->prev;
 	else
-		fPtr->pFirstEvictionCandidate = fPixmapPtr->prev;
+		fPtr->pLastPix = fPixmapPtr->prev;
 }
 
 static inline unsigned
-imxexa_calc_c2d_allocated_mem(
-	IMXEXAPtr fPtr)
+imxexa_gpumem_format_index(
+	C2D_COLORFORMAT format)
 {
-	unsigned res = 0;
-
-	IMXEXAPixmapPtr p;
-	for (p = fPtr->pFirstPix; p != NULL; p = p->next) {
+	switch (format) {
+	case C2D_COLOR_8:
+		return 0;
+	case C2D_COLOR_0565:
+		return 1;
+	case C2D_COLOR_888:
+		return 2;
+	case C2D_COLOR_8888:
+		return 3;
 
-		if (NULL != p->surf && 0 == (C2D_SURFACE_NO_BUFFER_ALLOC & p->surfDef.flags)) {
-			res += p->surfDef.height * p->surfDef.stride;
-		}
+	/* Pacify the compiler. */
+	default:
+		break;
 	}
 
-	return res;
+	return IMXEXA_GPUMEM_FORMAT_COUNT - 1;
 }
 
-static inline const char*
-imxexa_string_from_c2d_surface(
-	IMXEXAPixmapPtr fPixmapPtr)
+static inline unsigned
+imxexa_gpumem_usage_index(
+	int usage)
 {
-	static char buf[1024];
-
-	snprintf(buf, sizeof(buf) / sizeof(buf[0]), "%s %ux%u %u %p %p",
-		imxexa_string_from_c2d_format(fPixmapPtr->surfDef.format),
-		fPixmapPtr->surfDef.width,
-		fPixmapPtr->surfDef.height,
-		fPixmapPtr->surfDef.stride,
-		fPixmapPtr->surfDef.buffer,
-		fPixmapPtr->surfDef.host);
+	switch (usage) {
+	case 0:
+		return 0;
+	case CREATE_PIXMAP_USAGE_SCRATCH:
+		return 1;
+	case CREATE_PIXMAP_USAGE_BACKING_PIXMAP:
+		return 2;
+	case CREATE_PIXMAP_USAGE_GLYPH_PICTURE:
+		return 3;
+	}
 
-	return buf;
+	return IMXEXA_GPUMEM_USAGE_COUNT - 1;
 }
 
-static void
-imxexa_list_c2d_surfaces(
-	IMXEXAPtr fPtr)
+static inline void
+imxexa_account_pixmap(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr,
+	int sign)
 {
-	xf86DrvMsg(0, X_INFO,
-		"current surfaces:\n");
+	/* Add (sign > 0) or withdraw (sign < 0) the contribution of pixmap in its current state to the */
+	/* running totals. Callers withdraw before, and add after every change of residency of the pixmap. */
+	if (NULL == fPixmapPtr)
+		return;
 
-	unsigned surf_count = 0;
-	unsigned pixmap_count = 0;
+	/* Is pixmap in gpumem allocated via the standard allocator? */
+	if (NULL != fPixmapPtr->surf && 0 == (C2D_SURFACE_NO_BUFFER_ALLOC & fPixmapPtr->surfDef.flags)) {
 
-	IMXEXAPixmapPtr p;
-	for (p = fPtr->pFirstPix; p != NULL; p = p->next, ++pixmap_count) {
+		const unsigned bytes = fPixmapPtr->surfDef.height * fPixmapPtr->surfDef.stride;
+		const imxexa_residency_t residency = PIXMAP_STAMP_PINNED == fPixmapPtr->stamp ?
+			IMXEXA_RESIDENCY_PINNED : IMXEXA_RESIDENCY_GPU;
 
-		if (NULL != p->surf && 0 == (C2D_SURFACE_NO_BUFFER_ALLOC & p->surfDef.flags)) {
+		if (0 > sign) {
 
-			xf86DrvMsg(0, X_INFO,
-				"%u %p 0x%.16llx: %s\n",
-				surf_count,
-				p,
-				p->stamp,
-				imxexa_string_from_c2d_surface(p));
+			fPtr->gpumemAllocated -= bytes;
+			fPtr->gpumemByFormat[imxexa_gpumem_format_index(fPixmapPtr->surfDef.format)] -= bytes;
+			fPtr->gpumemByUsage[imxexa_gpumem_usage_index(fPixmapPtr->usage)] -= bytes;
+			fPtr->memByResidency[residency] -= bytes;
+		}
+		else {
 
-			++surf_count;
+			fPtr->gpumemAllocated += bytes;
+			fPtr->gpumemByFormat[imxexa_gpumem_format_index(fPixmapPtr->surfDef.format)] += bytes;
+			fPtr->gpumemByUsage[imxexa_gpumem_usage_index(fPixmapPtr->usage)] += bytes;
+			fPtr->memByResidency[residency] += bytes;
+
+#if IMX_DEBUG_MASTER
+
+			const uint32_t gpumem = fPtr->gpumemAllocated + fPtr->surfPoolBytes + fPtr->atlasBytes;
+
+			if (gpumem > fPtr->gpumem_watermark)
+				fPtr->gpumem_watermark = gpumem;
+#endif
 		}
 	}
+	else /* Is pixmap evicted? */
+	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
 
-	xf86DrvMsg(0, X_INFO,
-		"counted %u surfaces among %u pixmaps\n",
-		surf_count, pixmap_count);
+		const unsigned bytes = fPixmapPtr->packBytes +
+			(NULL != fPixmapPtr->sysPtr ? fPixmapPtr->height * fPixmapPtr->sysPitchBytes : 0);
+
+		if (0 > sign)
+			fPtr->memByResidency[IMXEXA_RESIDENCY_EVICTED] -= bytes;
+		else
+			fPtr->memByResidency[IMXEXA_RESIDENCY_EVICTED] += bytes;
+	}
 }
 
-static void
-imxexa_setup_context_defaults(
-	C2D_CONTEXT ctx)
+static inline unsigned
+imxexa_calc_c2d_allocated_mem(
+	IMXEXAPtr fPtr)
 {
-	c2dSetDstSurface(ctx, 0);
-	c2dSetSrcSurface(ctx, 0);
-	c2dSetBrushSurface(ctx, 0, 0);
-	c2dSetMaskSurface(ctx, 0, 0);
+	/* Recycled surfaces sitting in the pool, and atlases, occupy gpumem as well. */
+	return fPtr->gpumemAllocated + fPtr->surfPoolBytes + fPtr->atlasBytes;
+}
 
-	c2dSetDstRectangle(ctx, 0);
-	c2dSetSrcRectangle(ctx, 0);
-	c2dSetDstClipRect(ctx, 0);
+static inline unsigned
+imxexa_calc_gpumem_fragmentation(
+	IMXEXAPtr fPtr)
+{
+	/* Share in percent of the free gpumem outside of the largest free block, as of the last check. */
+	if (0 == fPtr->gpumemFreeTotal)
+		return 0;
 
-	c2dSetBlendMode(ctx, C2D_ALPHA_BLEND_NONE);
-	c2dSetGlobalAlpha(ctx, 0xff);
+	return 100 - (unsigned) (100ULL * fPtr->gpumemFreeLargest / fPtr->gpumemFreeTotal);
+}
 
-	c2dSetSrcColorkey(ctx, 0, 0);
-	c2dSetDstColorkey(ctx, 0, 0);
+static inline void
+imxexa_flush_gpu(
+	IMXEXAPtr fPtr)
+{
+	c2dFlush(fPtr->gpuContext);
 
-	c2dSetSrcRotate(ctx, 0);
-	c2dSetDstRotate(ctx, 0);
+	fPtr->pendingDraws = 0;
+	++fPtr->numFlushes;
+	++fPtr->flushSerial;
+}
 
-	c2dSetRop(ctx, 0xcccc);
+static inline void
+imxexa_flush_pending_draws(
+	IMXEXAPtr fPtr)
+{
+	if (0 != fPtr->pendingDraws)
+		imxexa_flush_gpu(fPtr);
+}
 
-	c2dSetFgColor(ctx, 0);
-	c2dSetBgColor(ctx, 0);
+static inline void
+imxexa_finish_gpu(
+	IMXEXAPtr fPtr)
+{
+	imxexa_flush_pending_draws(fPtr);
+	c2dFinish(fPtr->gpuContext);
 
-	c2dSetGradientDirection(ctx, C2D_GD_LEFT_RIGHT);
-	c2dSetStretchMode(ctx, C2D_STRETCH_POINT_SAMPLING); /* c2d_z160: this seems to be the _general_ sampling, not just at stretching. */
+	fPtr->retiredSerial = fPtr->flushSerial;
 }
 
-static inline PixmapPtr
-imxexa_get_pixmap_from_drawable(DrawablePtr pDrawable)
+static inline uint64_t
+imxexa_current_serial(
+	const IMXEXAPtr fPtr)
 {
-	if (NULL == pDrawable)
-		return NULL;
+	/* Serial of the batch the last queued draw went into. */
+	return fPtr->flushSerial + (0 != fPtr->pendingDraws);
+}
 
-	/* Check for a backing pixmap. */
-	if (DRAWABLE_WINDOW == pDrawable->type) {
+static inline void
+imxexa_record_op_serial(
+	IMXEXAPtr fPtr)
+{
+	/* Note the batch holding the last draw of the op just done in the pixmaps it involved. */
+	const uint64_t serial = imxexa_current_serial(fPtr);
 
-		WindowPtr pWindow = (WindowPtr)pDrawable;
-		return pDrawable->pScreen->GetWindowPixmap(pWindow);
-	}
+	if (NULL != fPtr->pPixDst)
+		fPtr->pPixDst->gpuSerial = serial;
 
-	/* It's a regular pixmap. */
-	return (PixmapPtr) pDrawable;
+	if (NULL != fPtr->pPixSrc)
+		fPtr->pPixSrc->gpuSerial = serial;
+
+	if (NULL != fPtr->pPixMsk)
+		fPtr->pPixMsk->gpuSerial = serial;
 }
 
-static inline PixmapPtr
-imxexa_get_pixmap_from_picture(PicturePtr pPicture)
+static inline void
+imxexa_flush_pixmap_draws(
+	IMXEXAPtr fPtr,
+	const IMXEXAPixmapPtr fPixmapPtr)
 {
-	if (NULL != pPicture)
-		return imxexa_get_pixmap_from_drawable(pPicture->pDrawable);
-
-	return NULL;
+	/* Are draws on pixmap still queued? Others queued may stay so, unless batched along. */
+	if (fPixmapPtr->gpuSerial > fPtr->flushSerial)
+		imxexa_flush_gpu(fPtr);
 }
 
-static inline Bool
-imxexa_can_accelerate_pixmap(
-	IMXEXAPixmapPtr fPixmapPtr)
+static void
+imxexa_wait_pixmap_idle(
+	IMXEXAPtr fPtr,
+	const IMXEXAPixmapPtr fPixmapPtr)
 {
-	if (NULL == fPixmapPtr)
-		return FALSE;
+	/* Is the last op on pixmap known to be done? Then there is nothing to wait for. */
+	if (fPixmapPtr->gpuSerial <= fPtr->retiredSerial)
+		return;
 
-	/* Evicted pixmaps are reinstated on first use, report them as good for acceleration. */
-	if (NULL == fPixmapPtr->surf && PIXMAP_STAMP_EVICTED != fPixmapPtr->stamp)
-		return FALSE;
+	imxexa_flush_pixmap_draws(fPtr, fPixmapPtr);
 
-	return TRUE;
+	/* C2D waits for the last flushed batch only, which includes the op on pixmap. */
+	c2dWaitForTimestamp(fPtr->gpuContext);
+
+	fPtr->retiredSerial = fPtr->flushSerial;
 }
 
-static Bool
-IMXEXAPixmapIsOffscreen(
-	PixmapPtr pPixmap)
+static inline void
+imxexa_queue_draw(
+	IMXEXAPtr fPtr)
 {
-	if (NULL == pPixmap)
-		return FALSE;
+	/* Draws are flushed in batches, once enough are queued, or when their results are due: */
+	/* at CPU access to surfaces, before surfaces get freed, and before the server sleeps. */
+	++fPtr->numDraws;
 
-	/* Access driver private data associated with pixmap. */
-	IMXEXAPixmapPtr fPixmapPtr =
-		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+	if (IMX_EXA_FLUSH_MAX_PENDING_DRAWS <= ++fPtr->pendingDraws)
+		imxexa_flush_gpu(fPtr);
+}
 
-	return imxexa_can_accelerate_pixmap(fPixmapPtr);
+static inline C2D_STATUS
+imxexa_lock_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr,
+	void** ptr)
+{
+	/* Wait for the last op on pixmap, which covers ops on earlier users of its memory too; */
+	/* idle pixmaps are locked without flushing or waiting on unrelated GPU work. */
+	imxexa_wait_pixmap_idle(fPtr, fPixmapPtr);
+
+	return c2dSurfLock(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapPtr), ptr);
 }
 
 static void
-imxexa_gpu_context_release(
-	ScrnInfoPtr pScrn)
+imxexa_update_flush_rate(
+	IMXEXAPtr fPtr)
 {
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	const unsigned long now = GetTimeInMillis();
+	const unsigned long elapsed = now - fPtr->flushRateStamp;
 
-	if (NULL == fPtr->gpuContext)
+	if (IMX_EXA_FLUSH_RATE_WINDOW > elapsed)
 		return;
 
-	C2D_STATUS r;
-
-	/* Rendezvous with the GPU. */
-	r = c2dFinish(fPtr->gpuContext);
-
-	if (C2D_STATUS_OK != r) {
+	fPtr->flushesPerSec = (fPtr->numFlushes - fPtr->flushRateBase) * 1000 / elapsed;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"Unable to sync GPU (code: 0x%08x)\n", r);
-	}
+	if (fPtr->flushesPerSec > fPtr->flushesPerSecMax)
+		fPtr->flushesPerSecMax = fPtr->flushesPerSec;
 
-	/* Dispose of screen's secondary surface. */
-	if (NULL != fPtr->doubleSurf) {
+	fPtr->flushRateBase = fPtr->numFlushes;
+	fPtr->flushRateStamp = now;
 
-		r = c2dSurfFree(fPtr->gpuContext, fPtr->doubleSurf);
-		fPtr->doubleSurf = NULL;
+#if IMX_EXA_DEBUG_FLUSH
 
-		if (C2D_STATUS_OK != r) {
+	if (0 != fPtr->flushesPerSec) {
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"Unable to free screen's secondary surface (code: 0x%08x)\n", r);
-		}
+		xf86DrvMsg(0, X_INFO,
+			"imxexa_update_flush_rate: %u flushes per second, %lu draws in %lu flushes total\n",
+			fPtr->flushesPerSec, fPtr->numDraws, fPtr->numFlushes);
 	}
 
-	/* Dispose of screen's primary surface. */
-	if (NULL != fPtr->screenSurf) {
-
-		r = c2dSurfFree(fPtr->gpuContext, fPtr->screenSurf);
-		fPtr->screenSurf = NULL;
+#endif
+}
 
-		if (C2D_STATUS_OK != r) {
+static inline Bool
+imxexa_state_needs_update(
+	IMXEXAPtr fPtr,
+	const imxexa_state_t slot,
+	const Bool unchanged)
+{
+	/* Skip the setter only when the context is known to hold the value already. */
+	if (unchanged && 0 != (fPtr->ctxState.valid & 1U << slot)) {
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"Unable to free screen's primary surface (code: 0x%08x)\n", r);
-		}
+#if IMX_DEBUG_MASTER
+		++fPtr->numStateSkipped[slot];
+#endif
+		return FALSE;
 	}
 
-#if IMX_EXA_DEBUG_PIXMAPS
-
-	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-		"gpumem watermark: %u\n", fPtr->gpumem_watermark);
+#if IMX_DEBUG_MASTER
+	++fPtr->numStateIssued[slot];
+#endif
+	return TRUE;
+}
 
-#endif /* IMX_EXA_DEBUG_PIXMAPS */
+static inline C2D_STATUS
+imxexa_state_commit(
+	IMXEXAPtr fPtr,
+	const imxexa_state_t slot,
+	const C2D_STATUS r)
+{
+	/* A failed setter leaves the context state unknown; have the next one issued regardless. */
+	if (C2D_STATUS_OK == r)
+		fPtr->ctxState.valid |= 1U << slot;
+	else
+		fPtr->ctxState.valid &= ~(1U << slot);
 
-	/* We are done with this context. */
-	r = c2dDestroyContext(fPtr->gpuContext);
-	fPtr->gpuContext = NULL;
+	return r;
+}
 
-	if (C2D_STATUS_OK == r) {
+C2D_STATUS
+imxexa_set_dst_surface(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE surf)
+{
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_DST_SURFACE, surf == fPtr->ctxState.dstSurf))
+		return C2D_STATUS_OK;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-			"Destroyed GPU context\n");
-	}
-	else {
+	fPtr->ctxState.dstSurf = surf;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
-			"Unable to destroy GPU context (code: 0x%08x)\n", r);
-	}
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_DST_SURFACE,
+		c2dSetDstSurface(fPtr->gpuContext, surf));
 }
 
-static Bool
-imxexa_gpu_context_acquire(
-	ScrnInfoPtr pScrn)
+C2D_STATUS
+imxexa_set_src_surface(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE surf)
 {
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_SRC_SURFACE, surf == fPtr->ctxState.srcSurf))
+		return C2D_STATUS_OK;
 
-	if (IMXEXA_BACKEND_NONE == imxPtr->backend)
-		return FALSE;
+	fPtr->ctxState.srcSurf = surf;
 
-	if (NULL != fPtr->gpuContext)
-		return TRUE;
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_SRC_SURFACE,
+		c2dSetSrcSurface(fPtr->gpuContext, surf));
+}
 
-	C2D_COLORFORMAT format;
+C2D_STATUS
+imxexa_set_brush_surface(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE surf)
+{
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_BRUSH_SURFACE, surf == fPtr->ctxState.brushSurf))
+		return C2D_STATUS_OK;
 
-	/* Is screen's bitsPerPixel supported in surfaces? */
-	if (!imxexa_surf_format_from_bpp(imxPtr->backend, pScrn->bitsPerPixel, &format)) {
+	fPtr->ctxState.brushSurf = surf;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"Screen bitsPerPixel not supported by GPU\n");
-		return FALSE;
-	}
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_BRUSH_SURFACE,
+		c2dSetBrushSurface(fPtr->gpuContext, surf, NULL));
+}
 
-	/* Create GPU context. */
-	C2D_STATUS r = c2dCreateContext(&fPtr->gpuContext);
+C2D_STATUS
+imxexa_set_mask_surface(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE surf)
+{
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_MASK_SURFACE, surf == fPtr->ctxState.maskSurf))
+		return C2D_STATUS_OK;
 
-	if (C2D_STATUS_OK != r) {
+	fPtr->ctxState.maskSurf = surf;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"Unable to acquire GPU context (code: 0x%08x)\n", r);
-		return FALSE;
-	}
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_MASK_SURFACE,
+		c2dSetMaskSurface(fPtr->gpuContext, surf, NULL));
+}
 
-	/* Create screen surface(s). */
-	const int fd = fbdevHWGetFD(pScrn);
+C2D_STATUS
+imxexa_set_blend_mode(
+	IMXEXAPtr fPtr,
+	C2D_ALPHA_BLEND_MODE mode)
+{
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_BLEND_MODE, mode == fPtr->ctxState.blendMode))
+		return C2D_STATUS_OK;
 
-	struct fb_fix_screeninfo fixinfo;
-	struct fb_var_screeninfo varinfo;
+	fPtr->ctxState.blendMode = mode;
 
-	ioctl(fd, FBIOGET_FSCREENINFO, &fixinfo);
-	ioctl(fd, FBIOGET_VSCREENINFO, &varinfo);
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_BLEND_MODE,
+		c2dSetBlendMode(fPtr->gpuContext, mode));
+}
 
-	Bool adjust_virtual_fb = FALSE;
+C2D_STATUS
+imxexa_set_dither(
+	IMXEXAPtr fPtr,
+	int dither)
+{
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_DITHER, dither == fPtr->ctxState.dither))
+		return C2D_STATUS_OK;
 
-	/* For Z430 backend make sure screen stride is multiple of 32 pixels. */
-	if (IMXEXA_BACKEND_Z430 == imxPtr->backend &&
-		varinfo.xres_virtual & 0x1f) {
+	fPtr->ctxState.dither = dither;
 
-		varinfo.xres_virtual = (varinfo.xres_virtual + 0x1f) & ~0x1f;
-		varinfo.xoffset = 0;
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_DITHER,
+		c2dSetDither(fPtr->gpuContext, dither));
+}
 
-		adjust_virtual_fb = TRUE;
-	}
+C2D_STATUS
+imxexa_set_stretch_mode(
+	IMXEXAPtr fPtr,
+	C2D_STRETCH_MODE mode)
+{
+	/* c2d_z160: this seems to set the _general_ sampling, not just at stretching. */
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_STRETCH_MODE, mode == fPtr->ctxState.stretchMode))
+		return C2D_STATUS_OK;
 
-	/* Arrange double buffering for fullscreen clients. */
-	/* Currently used only by XV adaptor which works only with Z160 backend. */
-	if (IMXEXA_BACKEND_Z160 == imxPtr->backend && imxPtr->use_double_buffering &&
-		varinfo.yres_virtual < varinfo.yres * 2) {
+	fPtr->ctxState.stretchMode = mode;
 
-		varinfo.yres_virtual = varinfo.yres * 2;
-		varinfo.yoffset = 0;
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_STRETCH_MODE,
+		c2dSetStretchMode(fPtr->gpuContext, mode));
+}
 
-		adjust_virtual_fb = TRUE;
-	}
+C2D_STATUS
+imxexa_set_rop(
+	IMXEXAPtr fPtr,
+	unsigned rop)
+{
+	if (!imxexa_state_needs_update(fPtr, IMXEXA_STATE_ROP, rop == fPtr->ctxState.rop))
+		return C2D_STATUS_OK;
 
-	if (adjust_virtual_fb &&
-		-1 == ioctl(fd, FBIOPUT_VSCREENINFO, &varinfo)) {
+	fPtr->ctxState.rop = rop;
 
-		c2dDestroyContext(fPtr->gpuContext);
-		fPtr->gpuContext = NULL;
+	return imxexa_state_commit(fPtr, IMXEXA_STATE_ROP,
+		c2dSetRop(fPtr->gpuContext, rop));
+}
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"Attempt to adjust virtual framebuffer failed at put_vscreeninfo ioctl (errno: %s)\n",
-			strerror(errno));
+static inline void
+imxexa_set_plain_sampling(
+	IMXEXAPtr fPtr)
+{
+	/* XV leaves its dithering and filtering set up past its blits; undo that only once it matters. */
+	imxexa_set_dither(fPtr, 0);
+	imxexa_set_stretch_mode(fPtr, C2D_STRETCH_POINT_SAMPLING);
+}
 
-		return FALSE;
+C2D_STATUS
+imxexa_free_c2d_surface(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE surf)
+{
+	/* A later surface may get the same handle; never take the context to be holding that one. */
+	if (surf == fPtr->ctxState.dstSurf)
+		fPtr->ctxState.valid &= ~(1U << IMXEXA_STATE_DST_SURFACE);
+
+	if (surf == fPtr->ctxState.srcSurf)
+		fPtr->ctxState.valid &= ~(1U << IMXEXA_STATE_SRC_SURFACE);
+
+	if (surf == fPtr->ctxState.brushSurf)
+		fPtr->ctxState.valid &= ~(1U << IMXEXA_STATE_BRUSH_SURFACE);
+
+	if (surf == fPtr->ctxState.maskSurf)
+		fPtr->ctxState.valid &= ~(1U << IMXEXA_STATE_MASK_SURFACE);
+
+	return c2dSurfFree(fPtr->gpuContext, surf);
+}
+
+static inline const char*
+imxexa_string_from_c2d_surface(
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	static char buf[1024];
+
+	snprintf(buf, sizeof(buf) / sizeof(buf[0]), "%s %ux%u %u %p %p",
+		imxexa_string_from_c2d_format(fPixmapPtr->surfDef.format),
+		fPixmapPtr->surfDef.width,
+		fPixmapPtr->surfDef.height,
+		fPixmapPtr->surfDef.stride,
+		fPixmapPtr->surfDef.buffer,
+		fPixmapPtr->surfDef.host);
+
+	return buf;
+}
+
+static void
+imxexa_list_c2d_surfaces(
+	IMXEXAPtr fPtr)
+{
+	xf86DrvMsg(0, X_INFO,
+		"current surfaces:\n");
+
+	unsigned surf_count = 0;
+	unsigned pixmap_count = 0;
+
+	IMXEXAPixmapPtr p;
+	for (p = fPtr->pFirstPix; p != NULL; p = p->next, ++pixmap_count) {
+
+		if (NULL != p->surf && 0 == (C2D_SURFACE_NO_BUFFER_ALLOC & p->surfDef.flags)) {
+
+			xf86DrvMsg(0, X_INFO,
+				"%u %p 0x%.16llx: %s\n",
+				surf_count,
+				p,
+				p->stamp,
+				imxexa_string_from_c2d_surface(p));
+
+			++surf_count;
+		}
 	}
 
-	/* At the early stages of driver init our ScrnInfoPtr does not have a valid ScreenPtr. */
-	fPtr->screenSurfDef.format = format;
-	fPtr->screenSurfDef.width  = varinfo.xres;
-	fPtr->screenSurfDef.height = varinfo.yres;
-	fPtr->screenSurfDef.stride = varinfo.xres_virtual * varinfo.bits_per_pixel / 8;
-	fPtr->screenSurfDef.buffer = (void *) fixinfo.smem_start;
-	fPtr->screenSurfDef.host   = fbdevHWMapVidmem(pScrn);
-	fPtr->screenSurfDef.flags  = C2D_SURFACE_NO_BUFFER_ALLOC;
+	xf86DrvMsg(0, X_INFO,
+		"counted %u surfaces among %u pixmaps\n",
+		surf_count, pixmap_count);
 
-	r = c2dSurfAlloc(fPtr->gpuContext, &fPtr->screenSurf, &fPtr->screenSurfDef);
+	xf86DrvMsg(0, X_INFO,
+		"gpumem allocated: %u (pooled: %u), by format 8/0565/888/8888/other: %u/%u/%u/%u/%u\n",
+		fPtr->gpumemAllocated,
+		fPtr->surfPoolBytes,
+		fPtr->gpumemByFormat[0],
+		fPtr->gpumemByFormat[1],
+		fPtr->gpumemByFormat[2],
+		fPtr->gpumemByFormat[3],
+		fPtr->gpumemByFormat[4]);
 
-	if (C2D_STATUS_OK != r) {
+	xf86DrvMsg(0, X_INFO,
+		"gpumem by usage nil/scratch/backing/glyph/other: %u/%u/%u/%u/%u\n",
+		fPtr->gpumemByUsage[0],
+		fPtr->gpumemByUsage[1],
+		fPtr->gpumemByUsage[2],
+		fPtr->gpumemByUsage[3],
+		fPtr->gpumemByUsage[4]);
 
-		c2dDestroyContext(fPtr->gpuContext);
-		fPtr->gpuContext = NULL;
+	if (0 != fPtr->gpumemBudget) {
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"Unable to allocate screen's primary surface (code: 0x%08x)\n", r);
+		xf86DrvMsg(0, X_INFO,
+			"gpumem budget: %u, watermarks high/low: %u/%u%s\n",
+			fPtr->gpumemBudget,
+			fPtr->gpumemHighMark,
+			fPtr->gpumemLowMark,
+			fPtr->idleEvicting ? ", evicting" : "");
+	}
 
-		return FALSE;
+	if (fPtr->defragGpumem) {
+
+		xf86DrvMsg(0, X_INFO,
+			"gpumem free: %u, largest free block: %u, fragmentation %u%%%s\n",
+			fPtr->gpumemFreeTotal,
+			fPtr->gpumemFreeLargest,
+			imxexa_calc_gpumem_fragmentation(fPtr),
+			fPtr->defragmenting ? ", compacting" : "");
 	}
 
-	if (IMXEXA_BACKEND_Z160 == imxPtr->backend && imxPtr->use_double_buffering) {
+	xf86DrvMsg(0, X_INFO,
+		"mem by residency gpu/pinned/evicted: %u/%u/%u\n",
+		fPtr->memByResidency[IMXEXA_RESIDENCY_GPU],
+		fPtr->memByResidency[IMXEXA_RESIDENCY_PINNED],
+		fPtr->memByResidency[IMXEXA_RESIDENCY_EVICTED]);
 
-		C2D_SURFACE_DEF surfDef;
-		memcpy(&surfDef, &fPtr->screenSurfDef, sizeof(surfDef));
+	xf86DrvMsg(0, X_INFO,
+		"compressed backups: %u, raw bytes: %u, compressed bytes: %u\n",
+		fPtr->packedBackups,
+		fPtr->packedRawBytes,
+		fPtr->packedBytes);
 
-		surfDef.buffer = (uint8_t *) fixinfo.smem_start + varinfo.yres * surfDef.stride;
-		surfDef.host   = NULL; /* Surface is not intend to be ever locked. */
-		surfDef.flags  = C2D_SURFACE_NO_BUFFER_ALLOC;
+	xf86DrvMsg(0, X_INFO,
+		"pixmaps promoted to gpumem: %lu, demoted to sysmem: %lu\n",
+		fPtr->numPromotions,
+		fPtr->numDemotions);
 
-		r = c2dSurfAlloc(fPtr->gpuContext, &fPtr->doubleSurf, &surfDef);
+	xf86DrvMsg(0, X_INFO,
+		"draws: %lu, flushes: %lu, flushes per second: %u (max %u)\n",
+		fPtr->numDraws,
+		fPtr->numFlushes,
+		fPtr->flushesPerSec,
+		fPtr->flushesPerSecMax);
 
-		if (C2D_STATUS_OK != r) {
+	if (0 != fPtr->vidmemSize) {
 
-			c2dDestroyContext(fPtr->gpuContext);
-			fPtr->gpuContext = NULL;
+		xf86DrvMsg(0, X_INFO,
+			"vidmem heap: %u surfaces, %u of %u bytes free in %u blocks\n",
+			fPtr->vidmemLiveCount,
+			fPtr->vidmemFree,
+			fPtr->vidmemSize,
+			fPtr->vidmemBlockCount);
+	}
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"Unable to allocate screen's secondary surface (code: 0x%08x)\n", r);
+	unsigned i;
+	for (i = 0; i < IMXEXA_ATLAS_MAX_COUNT; ++i) {
 
-			return FALSE;
-		}
+		const IMXEXAAtlasPtr atlas = fPtr->atlas + i;
+
+		if (NULL == atlas->surf)
+			continue;
+
+		/* Fragmentation is the share of the shelved area not taken by live sub-surfaces. */
+		const unsigned shelved = atlas->top * atlas->surfDef.width;
+
+		xf86DrvMsg(0, X_INFO,
+			"atlas %u: %s, %u sub-surfaces on %u shelves, %u of %u rows shelved, fragmentation %u%%\n",
+			i,
+			imxexa_string_from_c2d_format(atlas->surfDef.format),
+			atlas->liveCount,
+			atlas->shelfCount,
+			atlas->top,
+			atlas->surfDef.height,
+			0 != shelved ? 100 - 100 * atlas->liveArea / shelved : 0);
 	}
+}
 
-	/* GPU context created, set it up to defaults. */
-	imxexa_setup_context_defaults(fPtr->gpuContext);
+static void
+imxexa_surf_pool_remove(
+	IMXEXAPtr fPtr,
+	unsigned idx)
+{
+	IMXEXASurfPoolEntryRec* const entry = fPtr->surfPool + idx;
 
-	fPtr->gpuSynced = FALSE;
+	fPtr->surfPoolBytes -= entry->surfDef.height * entry->surfDef.stride;
+	--fPtr->surfPoolCount;
 
-	return TRUE;
+	memmove(entry, entry + 1, (fPtr->surfPoolCount - idx) * sizeof(*entry));
 }
 
-static inline const char*
-imxexa_string_from_pixmap_usage(
-	int usage)
+static void
+imxexa_surf_pool_trim(
+	IMXEXAPtr fPtr,
+	unsigned max_bytes)
 {
-	switch (usage) {
-	case 0:
-		return "nil_usage";
-	case CREATE_PIXMAP_USAGE_SCRATCH:
-		return "CREATE_PIXMAP_USAGE_SCRATCH";
-	case CREATE_PIXMAP_USAGE_BACKING_PIXMAP:
-		return "CREATE_PIXMAP_USAGE_BACKING_PIXMAP";
-	case CREATE_PIXMAP_USAGE_GLYPH_PICTURE:
-		return "CREATE_PIXMAP_USAGE_GLYPH_PICTURE";
-	}
+	/* Free the oldest pooled surfaces while they are stale or the pool is over the byte limit. */
+	/* Draws on pooled surfaces were flushed, not necessarily finished, when they entered the pool; */
+	/* that is enough to free them, as for any surface, but not to reuse them without a wait. */
+	while (0 != fPtr->surfPoolCount &&
+		(max_bytes < fPtr->surfPoolBytes ||
+		 fPtr->surfPool[0].stamp + IMX_EXA_SURF_POOL_MAX_AGE < fPtr->heartbeat)) {
 
-	return "unknown";
+		const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPtr->surfPool[0].surf);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_surf_pool_trim failed to free pooled surface (code: 0x%08x)\n", r);
+		}
+
+		imxexa_surf_pool_remove(fPtr, 0);
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numSurfPoolDrops;
+
+#endif
+	}
 }
 
-static inline void
-imxexa_update_surface_from_backup(
+static Bool
+imxexa_surf_pool_acquire(
 	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr)
+	C2D_SURFACE_DEF* surfDef,
+	C2D_SURFACE* surf,
+	uint64_t* gpuSerial)
 {
-	if (NULL == fPixmapPtr)
-		return;
+	imxexa_surf_pool_trim(fPtr, IMX_EXA_SURF_POOL_MAX_BYTES);
 
-	if (NULL == fPixmapPtr->surf)
-		return;
+	unsigned i = fPtr->surfPoolCount;
 
-	char* ptr_dst = fPixmapPtr->surfPtr;
-	char* ptr_src = fPixmapPtr->sysPtr;
+	/* Look for the most recently released surface of the same format, width (and thus stride) */
+	/* and height. Taller surfaces won't do: Z160 tiles repeating sources from the whole surface, */
+	/* rows beyond the pixmap included. */
+	while (0 != i--) {
 
-	if (NULL == fPixmapPtr->surfPtr) {
+		const C2D_SURFACE_DEF* const poolDef = &fPtr->surfPool[i].surfDef;
+
+		if (poolDef->format == surfDef->format &&
+			poolDef->width == surfDef->width &&
+			poolDef->height == surfDef->height) {
+
+			memcpy(surfDef, poolDef, sizeof(*surfDef));
+			*surf = fPtr->surfPool[i].surf;
+			*gpuSerial = fPtr->surfPool[i].gpuSerial;
+
+			imxexa_surf_pool_remove(fPtr, i);
+
+#if IMX_DEBUG_MASTER
+
+			++fPtr->numSurfPoolHits;
+
+#endif
+
+			return TRUE;
+		}
+	}
+
+#if IMX_DEBUG_MASTER
+
+	++fPtr->numSurfPoolMisses;
+
+#endif
+
+	return FALSE;
+}
+
+static Bool
+imxexa_surf_pool_release(
+	IMXEXAPtr fPtr,
+	const C2D_SURFACE_DEF* surfDef,
+	C2D_SURFACE surf,
+	uint64_t gpuSerial)
+{
+	/* Only surfaces owning their buffers can be recycled. */
+	if (0 != (C2D_SURFACE_NO_BUFFER_ALLOC & surfDef->flags))
+		return FALSE;
+
+	const unsigned bytes = surfDef->height * surfDef->stride;
+
+	if (IMX_EXA_SURF_POOL_MAX_BYTES < bytes)
+		return FALSE;
+
+	/* Make room for the new entry, both in terms of bytes and of pool slots. */
+	imxexa_surf_pool_trim(fPtr, IMX_EXA_SURF_POOL_MAX_BYTES - bytes);
+
+	if (IMXEXA_SURF_POOL_ENTRIES == fPtr->surfPoolCount) {
+
+		const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPtr->surfPool[0].surf);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_surf_pool_release failed to free pooled surface (code: 0x%08x)\n", r);
+		}
+
+		imxexa_surf_pool_remove(fPtr, 0);
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numSurfPoolDrops;
+
+#endif
+	}
+
+	IMXEXASurfPoolEntryRec* const entry = fPtr->surfPool + fPtr->surfPoolCount++;
+
+	memcpy(&entry->surfDef, surfDef, sizeof(entry->surfDef));
+	entry->surf = surf;
+	entry->stamp = fPtr->heartbeat;
+	entry->gpuSerial = gpuSerial;
+
+	fPtr->surfPoolBytes += bytes;
+
+	return TRUE;
+}
+
+static void
+imxexa_setup_context_defaults(
+	IMXEXAPtr fPtr)
+{
+	C2D_CONTEXT ctx = fPtr->gpuContext;
+
+	c2dSetDstSurface(ctx, 0);
+	c2dSetSrcSurface(ctx, 0);
+	c2dSetBrushSurface(ctx, 0, 0);
+	c2dSetMaskSurface(ctx, 0, 0);
+
+	c2dSetDstRectangle(ctx, 0);
+	c2dSetSrcRectangle(ctx, 0);
+	c2dSetDstClipRect(ctx, 0);
+
+	c2dSetBlendMode(ctx, C2D_ALPHA_BLEND_NONE);
+	c2dSetGlobalAlpha(ctx, 0xff);
+
+	c2dSetSrcColorkey(ctx, 0, 0);
+	c2dSetDstColorkey(ctx, 0, 0);
+
+	c2dSetSrcRotate(ctx, 0);
+	c2dSetDstRotate(ctx, 0);
+
+	c2dSetRop(ctx, IMXEXA_ROP4_COPY);
+
+	c2dSetFgColor(ctx, 0);
+	c2dSetBgColor(ctx, 0);
+
+	c2dSetGradientDirection(ctx, C2D_GD_LEFT_RIGHT);
+	c2dSetStretchMode(ctx, C2D_STRETCH_POINT_SAMPLING); /* c2d_z160: this seems to be the _general_ sampling, not just at stretching. */
+	c2dSetDither(ctx, 0);
+
+	/* Seed the shadow of the context state with the above. */
+	memset(&fPtr->ctxState, 0, sizeof(fPtr->ctxState));
+
+	fPtr->ctxState.blendMode = C2D_ALPHA_BLEND_NONE;
+	fPtr->ctxState.dither = 0;
+	fPtr->ctxState.stretchMode = C2D_STRETCH_POINT_SAMPLING;
+	fPtr->ctxState.rop = IMXEXA_ROP4_COPY;
+	fPtr->ctxState.valid = (1U << IMXEXA_STATE_COUNT) - 1;
+}
+
+static inline PixmapPtr
+imxexa_get_pixmap_from_drawable(DrawablePtr pDrawable)
+{
+	if (NULL == pDrawable)
+		return NULL;
+
+	/* Check for a backing pixmap. */
+	if (DRAWABLE_WINDOW == pDrawable->type) {
+
+		WindowPtr pWindow = (WindowPtr)pDrawable;
+		return pDrawable->pScreen->GetWindowPixmap(pWindow);
+	}
+
+	/* It's a regular pixmap. */
+	return (PixmapPtr) pDrawable;
+}
+
+static inline PixmapPtr
+imxexa_get_pixmap_from_picture(PicturePtr pPicture)
+{
+	if (NULL != pPicture)
+		return imxexa_get_pixmap_from_drawable(pPicture->pDrawable);
+
+	return NULL;
+}
+
+static inline Bool
+imxexa_can_accelerate_pixmap(
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return FALSE;
+
+	/* Evicted pixmaps are reinstated on first use, report them as good for acceleration. */
+	if (NULL == fPixmapPtr->surf && PIXMAP_STAMP_EVICTED != fPixmapPtr->stamp)
+		return FALSE;
+
+	return TRUE;
+}
+
+static Bool
+IMXEXAPixmapIsOffscreen(
+	PixmapPtr pPixmap)
+{
+	if (NULL == pPixmap)
+		return FALSE;
+
+	/* Access driver private data associated with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr =
+		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+
+	return imxexa_can_accelerate_pixmap(fPixmapPtr);
+}
+
+static void
+imxexa_atlas_free(
+	IMXEXAPtr fPtr,
+	IMXEXAAtlasPtr atlas);
+
+static void
+imxexa_gpu_context_release(
+	ScrnInfoPtr pScrn)
+{
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	if (NULL == fPtr->gpuContext)
+		return;
+
+	C2D_STATUS r;
+
+	/* Rendezvous with the GPU. */
+	imxexa_flush_pending_draws(fPtr);
+	r = c2dFinish(fPtr->gpuContext);
+
+	fPtr->retiredSerial = fPtr->flushSerial;
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"Unable to sync GPU (code: 0x%08x)\n", r);
+	}
+
+	/* Dispose of all recycled surfaces. */
+	imxexa_surf_pool_trim(fPtr, 0);
+
+#if IMX_EXA_DEBUG_FLUSH
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"draws: %lu, flushes: %lu, max flushes per second: %u\n",
+		fPtr->numDraws, fPtr->numFlushes, fPtr->flushesPerSecMax);
+
+#endif
+
+#if IMX_EXA_DEBUG_BATCH
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"solid/copy rects: %lu, merged: %lu, batches: %lu\n",
+		fPtr->numBatchedRects, fPtr->numMergedRects, fPtr->numBatchSubmits);
+
+#endif
+
+#if IMX_EXA_DEBUG_OVERLAP
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"overlapping copies split in bands: %lu, bounced through scratch: %lu\n",
+		fPtr->numOverlapBanded, fPtr->numOverlapBounced);
+
+#endif
+
+#if IMX_EXA_DEBUG_CPU_OPS
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"rects done by the CPU: %lu, of which composites of component alpha: %lu\n",
+		fPtr->numCpuRects, fPtr->numCpuRectsCA);
+
+#endif
+
+#if IMX_EXA_DEBUG_PLANEMASK
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"ops with a planemask done by the GPU: %lu solids, %lu copies; left to fb: %lu\n",
+		fPtr->numMaskedSolids, fPtr->numMaskedCopies, fPtr->numMaskedFallbacks);
+
+#endif
+
+#if IMX_EXA_DEBUG_STATE
+
+	static const char* const state_name[IMXEXA_STATE_COUNT] = {
+		"dst surface",
+		"src surface",
+		"brush surface",
+		"mask surface",
+		"blend mode",
+		"dither",
+		"stretch mode",
+		"rop"
+	};
+
+	unsigned slot;
+
+	for (slot = 0; slot < IMXEXA_STATE_COUNT; ++slot) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"%s state changes issued: %lu, skipped: %lu\n",
+			state_name[slot], fPtr->numStateIssued[slot], fPtr->numStateSkipped[slot]);
+	}
+
+#endif
+
+#if IMX_EXA_DEBUG_DEMOTION || IMX_EXA_DEBUG_PROMOTION
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"pixmaps promoted to gpumem: %lu, demoted to sysmem: %lu\n",
+		fPtr->numPromotions, fPtr->numDemotions);
+
+#endif
+
+#if IMX_EXA_DEBUG_ATLAS
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"atlas sub-allocations: %lu, failures: %lu, repacks: %lu\n",
+		fPtr->numAtlasAllocs, fPtr->numAtlasFailures, fPtr->numAtlasRepacks);
+
+#endif /* IMX_EXA_DEBUG_ATLAS */
+
+	/* Dispose of all atlases; pixmaps still in them are beyond use with the context gone. */
+	unsigned i;
+	for (i = 0; i < IMXEXA_ATLAS_MAX_COUNT; ++i)
+		imxexa_atlas_free(fPtr, fPtr->atlas + i);
+
+#if IMX_EXA_DEBUG_VIDMEM
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"vidmem heap allocations: %lu, failures: %lu\n",
+		fPtr->numVidmemAllocs, fPtr->numVidmemFailures);
+
+#endif /* IMX_EXA_DEBUG_VIDMEM */
+
+	/* Likewise, dispose of the vidmem heap. */
+	fPtr->vidmemSize = 0;
+	fPtr->vidmemFree = 0;
+	fPtr->vidmemLiveCount = 0;
+	fPtr->vidmemBlockCount = 0;
+
+#if IMX_EXA_DEBUG_SURF_POOL
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"surface pool hits: %lu, misses: %lu, drops: %lu\n",
+		fPtr->numSurfPoolHits, fPtr->numSurfPoolMisses, fPtr->numSurfPoolDrops);
+
+#endif /* IMX_EXA_DEBUG_SURF_POOL */
+
+#if IMX_EXA_DEBUG_EVICTION
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"evicting allocations: %lu, evicted pixmaps: %lu (needing GPU sync: %lu), evicted bytes total: %llu, max per allocation: %u\n",
+		fPtr->numEvictingAllocs,
+		fPtr->numEvictedPixmaps,
+		fPtr->numEvictedUnmapped,
+		(unsigned long long) fPtr->evictedBytesTotal,
+		fPtr->evictedBytesMax);
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"clean evictions: %lu, bytes copied at eviction: %llu, at reinstatement: %llu\n",
+		fPtr->numCleanEvictions,
+		(unsigned long long) fPtr->evictedBytesCopied,
+		(unsigned long long) fPtr->reinstatedBytesCopied);
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"pixmaps evicted at idle time: %lu, bytes: %llu\n",
+		fPtr->numIdleEvictedPixmaps,
+		(unsigned long long) fPtr->idleEvictedBytes);
+
+#endif /* IMX_EXA_DEBUG_EVICTION */
+
+#if IMX_EXA_DEBUG_DEFRAG
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"gpumem compaction passes: %lu, relocated pixmaps: %lu, bytes: %llu\n",
+		fPtr->numDefragPasses,
+		fPtr->numRelocatedPixmaps,
+		(unsigned long long) fPtr->relocatedBytes);
+
+#endif /* IMX_EXA_DEBUG_DEFRAG */
+
+#if IMX_EXA_DEBUG_PACK
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"backup compression attempts: %lu, rejects: %lu, decompressions: %lu, currently compressed: %u (%u bytes to %u)\n",
+		fPtr->numPackAttempts,
+		fPtr->numPackRejects,
+		fPtr->numUnpacks,
+		fPtr->packedBackups,
+		fPtr->packedRawBytes,
+		fPtr->packedBytes);
+
+#endif /* IMX_EXA_DEBUG_PACK */
+
+	/* Dispose of the rows of component-alpha composites. */
+	free(fPtr->caRows);
+	fPtr->caRows = NULL;
+
+	/* Dispose of the scratch surface. */
+	if (NULL != fPtr->scratchSurf) {
+
+		imxexa_free_c2d_surface(fPtr, fPtr->scratchSurf);
+		fPtr->scratchSurf = NULL;
+	}
+
+	/* Dispose of screen's secondary surface. */
+	if (NULL != fPtr->doubleSurf) {
+
+		r = imxexa_free_c2d_surface(fPtr, fPtr->doubleSurf);
+		fPtr->doubleSurf = NULL;
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"Unable to free screen's secondary surface (code: 0x%08x)\n", r);
+		}
+	}
+
+	/* Dispose of screen's primary surface. */
+	if (NULL != fPtr->screenSurf) {
+
+		r = imxexa_free_c2d_surface(fPtr, fPtr->screenSurf);
+		fPtr->screenSurf = NULL;
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"Unable to free screen's primary surface (code: 0x%08x)\n", r);
+		}
+	}
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"gpumem watermark: %u\n", fPtr->gpumem_watermark);
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"gpumem free at last check: %u, largest free block: %u, fragmentation %u%%\n",
+		fPtr->gpumemFreeTotal, fPtr->gpumemFreeLargest, imxexa_calc_gpumem_fragmentation(fPtr));
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"pixmap record slabs: %lu\n", fPtr->numPixSlabs);
+
+#endif /* IMX_EXA_DEBUG_PIXMAPS */
+
+	/* We are done with this context. */
+	r = c2dDestroyContext(fPtr->gpuContext);
+	fPtr->gpuContext = NULL;
+
+	if (C2D_STATUS_OK == r) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"Destroyed GPU context\n");
+	}
+	else {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			"Unable to destroy GPU context (code: 0x%08x)\n", r);
+	}
+}
+
+static Bool
+imxexa_gpu_context_acquire(
+	ScrnInfoPtr pScrn)
+{
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	if (IMXEXA_BACKEND_NONE == imxPtr->backend)
+		return FALSE;
+
+	if (NULL != fPtr->gpuContext)
+		return TRUE;
+
+	C2D_COLORFORMAT format;
+
+	/* Is screen's bitsPerPixel supported in surfaces? */
+	if (!imxexa_surf_format_from_bpp(imxPtr->backend, pScrn->bitsPerPixel, &format)) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"Screen bitsPerPixel not supported by GPU\n");
+		return FALSE;
+	}
+
+	/* Create GPU context. */
+	C2D_STATUS r = c2dCreateContext(&fPtr->gpuContext);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"Unable to acquire GPU context (code: 0x%08x)\n", r);
+		return FALSE;
+	}
+
+	/* Create screen surface(s). */
+	const int fd = fbdevHWGetFD(pScrn);
+
+	struct fb_fix_screeninfo fixinfo;
+	struct fb_var_screeninfo varinfo;
+
+	ioctl(fd, FBIOGET_FSCREENINFO, &fixinfo);
+	ioctl(fd, FBIOGET_VSCREENINFO, &varinfo);
+
+	Bool adjust_virtual_fb = FALSE;
+
+	/* For Z430 backend make sure screen stride is multiple of 32 pixels. */
+	if (IMXEXA_BACKEND_Z430 == imxPtr->backend &&
+		varinfo.xres_virtual & 0x1f) {
+
+		varinfo.xres_virtual = (varinfo.xres_virtual + 0x1f) & ~0x1f;
+		varinfo.xoffset = 0;
+
+		adjust_virtual_fb = TRUE;
+	}
+
+	/* Arrange double buffering for fullscreen clients. */
+	/* Currently used only by XV adaptor which works only with Z160 backend. */
+	if (IMXEXA_BACKEND_Z160 == imxPtr->backend && imxPtr->use_double_buffering &&
+		varinfo.yres_virtual < varinfo.yres * 2) {
+
+		varinfo.yres_virtual = varinfo.yres * 2;
+		varinfo.yoffset = 0;
+
+		adjust_virtual_fb = TRUE;
+	}
+
+	if (adjust_virtual_fb &&
+		-1 == ioctl(fd, FBIOPUT_VSCREENINFO, &varinfo)) {
+
+		c2dDestroyContext(fPtr->gpuContext);
+		fPtr->gpuContext = NULL;
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"Attempt to adjust virtual framebuffer failed at put_vscreeninfo ioctl (errno: %s)\n",
+			strerror(errno));
+
+		return FALSE;
+	}
+
+	/* At the early stages of driver init our ScrnInfoPtr does not have a valid ScreenPtr. */
+	fPtr->screenSurfDef.format = format;
+	fPtr->screenSurfDef.width  = varinfo.xres;
+	fPtr->screenSurfDef.height = varinfo.yres;
+	fPtr->screenSurfDef.stride = varinfo.xres_virtual * varinfo.bits_per_pixel / 8;
+	fPtr->screenSurfDef.buffer = (void *) fixinfo.smem_start;
+	fPtr->screenSurfDef.host   = fbdevHWMapVidmem(pScrn);
+	fPtr->screenSurfDef.flags  = C2D_SURFACE_NO_BUFFER_ALLOC;
+
+	r = c2dSurfAlloc(fPtr->gpuContext, &fPtr->screenSurf, &fPtr->screenSurfDef);
+
+	if (C2D_STATUS_OK != r) {
+
+		c2dDestroyContext(fPtr->gpuContext);
+		fPtr->gpuContext = NULL;
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"Unable to allocate screen's primary surface (code: 0x%08x)\n", r);
+
+		return FALSE;
+	}
+
+	if (IMXEXA_BACKEND_Z160 == imxPtr->backend && imxPtr->use_double_buffering) {
+
+		C2D_SURFACE_DEF surfDef;
+		memcpy(&surfDef, &fPtr->screenSurfDef, sizeof(surfDef));
+
+		surfDef.buffer = (uint8_t *) fixinfo.smem_start + varinfo.yres * surfDef.stride;
+		surfDef.host   = NULL; /* Surface is not intend to be ever locked. */
+		surfDef.flags  = C2D_SURFACE_NO_BUFFER_ALLOC;
+
+		r = c2dSurfAlloc(fPtr->gpuContext, &fPtr->doubleSurf, &surfDef);
+
+		if (C2D_STATUS_OK != r) {
+
+			c2dDestroyContext(fPtr->gpuContext);
+			fPtr->gpuContext = NULL;
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"Unable to allocate screen's secondary surface (code: 0x%08x)\n", r);
+
+			return FALSE;
+		}
+	}
+
+	/* Set up the heap over the framebuffer memory past the virtual screen; the latter */
+	/* spans the secondary surface, if any. */
+	fPtr->vidmemSize = 0;
+	fPtr->vidmemFree = 0;
+	fPtr->vidmemLiveCount = 0;
+	fPtr->vidmemBlockCount = 0;
+
+	const unsigned vidmem_start = (varinfo.yres_virtual * fPtr->screenSurfDef.stride +
+		IMX_EXA_VIDMEM_ALIGN_BYTES - 1) & ~(IMX_EXA_VIDMEM_ALIGN_BYTES - 1);
+
+	if (fPtr->useVidmem && fixinfo.smem_len >= vidmem_start + IMX_EXA_VIDMEM_MIN_BYTES) {
+
+		fPtr->vidmemBuffer = fPtr->screenSurfDef.buffer;
+		fPtr->vidmemHost = fPtr->screenSurfDef.host;
+		fPtr->vidmemSize = (fixinfo.smem_len - vidmem_start) & ~(IMX_EXA_VIDMEM_ALIGN_BYTES - 1);
+		fPtr->vidmemFree = fPtr->vidmemSize;
+
+		fPtr->vidmemBlock[0].offset = vidmem_start;
+		fPtr->vidmemBlock[0].size = fPtr->vidmemSize;
+		fPtr->vidmemBlockCount = 1;
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"Placing pixmaps in %u KB of spare framebuffer memory\n",
+			fPtr->vidmemSize / 1024);
+	}
+
+	/* GPU context created, set it up to defaults. */
+	imxexa_setup_context_defaults(fPtr);
+
+	fPtr->gpuSynced = FALSE;
+
+	return TRUE;
+}
+
+static inline const char*
+imxexa_string_from_pixmap_usage(
+	int usage)
+{
+	switch (usage) {
+	case 0:
+		return "nil_usage";
+	case CREATE_PIXMAP_USAGE_SCRATCH:
+		return "CREATE_PIXMAP_USAGE_SCRATCH";
+	case CREATE_PIXMAP_USAGE_BACKING_PIXMAP:
+		return "CREATE_PIXMAP_USAGE_BACKING_PIXMAP";
+	case CREATE_PIXMAP_USAGE_GLYPH_PICTURE:
+		return "CREATE_PIXMAP_USAGE_GLYPH_PICTURE";
+	}
+
+	return "unknown";
+}
+
+static inline Bool
+imxexa_box_is_empty(
+	const BoxRec* box)
+{
+	return box->x1 >= box->x2 || box->y1 >= box->y2;
+}
+
+static inline void
+imxexa_box_union(
+	BoxPtr box,
+	int x1, int y1,
+	int x2, int y2)
+{
+	if (imxexa_box_is_empty(box)) {
+
+		box->x1 = x1;
+		box->y1 = y1;
+		box->x2 = x2;
+		box->y2 = y2;
+		return;
+	}
+
+	if (x1 < box->x1)
+		box->x1 = x1;
+	if (y1 < box->y1)
+		box->y1 = y1;
+	if (x2 > box->x2)
+		box->x2 = x2;
+	if (y2 > box->y2)
+		box->y2 = y2;
+}
+
+void
+imxexa_mark_pixmap_dirty(
+	IMXEXAPixmapPtr fPixmapPtr,
+	int x1, int y1,
+	int x2, int y2)
+{
+	if (NULL == fPixmapPtr)
+		return;
+
+	/* Clip the written rectangle to the pixmap. */
+	if (0 > x1)
+		x1 = 0;
+	if (0 > y1)
+		y1 = 0;
+	if (fPixmapPtr->width < x2)
+		x2 = fPixmapPtr->width;
+	if (fPixmapPtr->height < y2)
+		y2 = fPixmapPtr->height;
+
+	if (x1 >= x2 || y1 >= y2)
+		return;
+
+	imxexa_box_union(&fPixmapPtr->defined, x1, y1, x2, y2);
+
+	/* Writes to an evicted pixmap land in the backup itself. */
+	if (PIXMAP_STAMP_EVICTED != fPixmapPtr->stamp)
+		imxexa_box_union(&fPixmapPtr->dirty, x1, y1, x2, y2);
+}
+
+extern unsigned
+imxexa_pack_pixels(
+	void* dst,
+	unsigned dst_bytes,
+	const void* src,
+	int pitch,
+	int width,
+	int height,
+	int bytesPerPixel);
+
+extern Bool
+imxexa_unpack_pixels(
+	void* dst,
+	int pitch,
+	int width,
+	int height,
+	int bytesPerPixel,
+	const void* src,
+	unsigned src_bytes);
+
+static inline void
+imxexa_drop_packed_backup(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr->packPtr)
+		return;
+
+	fPtr->packedBackups -= 1;
+	fPtr->packedRawBytes -= fPixmapPtr->height * imxexa_calc_system_memory_pitch(fPixmapPtr->width, fPixmapPtr->bitsPerPixel);
+	fPtr->packedBytes -= fPixmapPtr->packBytes;
+
+	free(fPixmapPtr->packPtr);
+
+	fPixmapPtr->packPtr = NULL;
+	fPixmapPtr->packBytes = 0;
+}
+
+static Bool
+imxexa_unpack_backup(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Is there an uncompressed backup already, or no backup at all? */
+	if (NULL != fPixmapPtr->sysPtr || NULL == fPixmapPtr->packPtr)
+		return TRUE;
+
+	const int sysPitchBytes =
+		imxexa_calc_system_memory_pitch(fPixmapPtr->width, fPixmapPtr->bitsPerPixel);
+
+	void* const sysPtr = malloc(fPixmapPtr->height * sysPitchBytes);
+
+	if (NULL == sysPtr) {
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_unpack_backup failed to allocate backing storage for pixmap\n");
+		return FALSE;
+	}
+
+	if (!imxexa_unpack_pixels(sysPtr, sysPitchBytes,
+			fPixmapPtr->width, fPixmapPtr->height, fPixmapPtr->bitsPerPixel / 8,
+			fPixmapPtr->packPtr, fPixmapPtr->packBytes)) {
+
+		free(sysPtr);
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_unpack_backup encountered malformed compressed backup (priv rec %p)\n",
+			fPixmapPtr);
+		return FALSE;
+	}
+
+	/* Keep the compressed copy until the backup gets modified. */
+	fPixmapPtr->sysPtr = sysPtr;
+	fPixmapPtr->sysPitchBytes = sysPitchBytes;
+
+#if IMX_DEBUG_MASTER
+
+	++fPtr->numUnpacks;
+
+#endif
+
+	return TRUE;
+}
+
+static void
+imxexa_pack_backup(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (!fPtr->packEvicted || NULL == fPixmapPtr->sysPtr || 8 > fPixmapPtr->bitsPerPixel)
+		return;
+
+	const unsigned raw_bytes = fPixmapPtr->height * fPixmapPtr->sysPitchBytes;
+
+	if (fPtr->packMinBytes > raw_bytes)
+		return;
+
+	/* Does backup lack a compressed copy? */
+	if (NULL == fPixmapPtr->packPtr) {
+
+		/* Compression must save at least a quarter of the backup to pay for decompression later. */
+		const unsigned max_bytes = raw_bytes - raw_bytes / 4;
+		void* const packPtr = malloc(max_bytes);
+
+		if (NULL == packPtr)
+			return;
+
+		const unsigned bytes = imxexa_pack_pixels(packPtr, max_bytes,
+			fPixmapPtr->sysPtr, fPixmapPtr->sysPitchBytes,
+			fPixmapPtr->width, fPixmapPtr->height, fPixmapPtr->bitsPerPixel / 8);
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numPackAttempts;
+
+		if (0 == bytes)
+			++fPtr->numPackRejects;
+
+#endif
+
+		if (0 == bytes) {
+
+			free(packPtr);
+			return;
+		}
+
+		void* const packPtrShrunk = realloc(packPtr, bytes);
+
+		fPixmapPtr->packPtr = NULL != packPtrShrunk ? packPtrShrunk : packPtr;
+		fPixmapPtr->packBytes = bytes;
+
+		fPtr->packedBackups += 1;
+		fPtr->packedRawBytes += raw_bytes;
+		fPtr->packedBytes += bytes;
+	}
+
+	free(fPixmapPtr->sysPtr);
+	fPixmapPtr->sysPtr = NULL;
+}
+
+static inline void
+imxexa_drop_unpacked_backup(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Was a compressed backup unpacked just to be read? It is still up to date; keep only it. */
+	if (PIXMAP_STAMP_EVICTED != fPixmapPtr->stamp ||
+		NULL == fPixmapPtr->packPtr ||
+		NULL == fPixmapPtr->sysPtr) {
+
+		return;
+	}
+
+	imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+	free(fPixmapPtr->sysPtr);
+	fPixmapPtr->sysPtr = NULL;
+
+	imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+}
+
+static inline void
+imxexa_update_surface_from_backup(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return;
+
+	if (NULL == fPixmapPtr->surf)
+		return;
+
+	/* Pixels never written are undefined; a fresh surface holds them as well as the backup. */
+	const BoxRec* const box = &fPixmapPtr->defined;
+
+	if (imxexa_box_is_empty(box))
+		return;
+
+	if (!imxexa_unpack_backup(fPtr, fPixmapPtr))
+		return;
+
+	char* ptr_dst = fPixmapPtr->surfPtr;
+	char* ptr_src = fPixmapPtr->sysPtr;
+
+	if (NULL == fPixmapPtr->surfPtr) {
+
+		/* Access-lock the surface. */
+		const C2D_STATUS r = imxexa_lock_surface(fPtr, fPixmapPtr, (void**) &ptr_dst);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_update_surface_from_backup failed to lock GPU surface (code: 0x%08x)\n", r);
+			return;
+		}
+
+		fPixmapPtr->surfPtr = ptr_dst;
+	}
+
+	int pitch_dst = fPixmapPtr->surfDef.stride;
+	int pitch_src = fPixmapPtr->sysPitchBytes;
+
+	const int offs_bytes = box->x1 * fPixmapPtr->bitsPerPixel / 8;
+
+	ptr_dst += box->y1 * pitch_dst + offs_bytes;
+	ptr_src += box->y1 * pitch_src + offs_bytes;
+
+	int line_bytes = (box->x2 * fPixmapPtr->bitsPerPixel + 7) / 8 - offs_bytes;
+	int line_count = box->y2 - box->y1;
+
+#if IMX_DEBUG_MASTER
+
+	fPtr->reinstatedBytesCopied += line_bytes * line_count;
+
+#endif
+
+	while (0 != line_count--) {
+
+		memcpy(ptr_dst, ptr_src, line_bytes);
+		ptr_dst += pitch_dst;
+		ptr_src += pitch_src;
+	}
+
+	/* Backup stays valid while pixmap is resident; keep it compact. */
+	imxexa_pack_backup(fPtr, fPixmapPtr);
+}
+
+#if NEON
+
+extern void
+copy_rows_uncached(
+	uint8_t *dst,
+	const uint8_t *src,
+	int w,
+	int h,
+	int dw,
+	int sw);
+
+#endif
+
+static inline void
+imxexa_copy_rows_from_gpumem(
+	char* ptr_dst,
+	int pitch_dst,
+	const char* ptr_src,
+	int pitch_src,
+	int line_bytes,
+	int line_count)
+{
+	if (0 >= line_count)
+		return;
+
+#if NEON
+
+	/* GPU memory is mapped uncached; reading it in wide NEON bursts is considerably */
+	/* faster than memcpy's word-sized loads, so copy the bulk of each row that way. */
+	const int bulk_bytes = line_bytes & ~63;
+
+	if (0 != bulk_bytes) {
+
+		copy_rows_uncached((uint8_t*) ptr_dst, (const uint8_t*) ptr_src,
+			bulk_bytes, line_count, pitch_dst, pitch_src);
+
+		ptr_dst += bulk_bytes;
+		ptr_src += bulk_bytes;
+		line_bytes -= bulk_bytes;
+	}
+
+	if (0 == line_bytes)
+		return;
+
+#endif
+
+	while (0 != line_count--) {
+
+		memcpy(ptr_dst, ptr_src, line_bytes);
+		ptr_dst += pitch_dst;
+		ptr_src += pitch_src;
+	}
+}
+
+static Bool
+imxexa_update_backup_from_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return FALSE;
+
+	if (NULL == fPixmapPtr->surf)
+		return FALSE;
+
+	BoxPtr const box = &fPixmapPtr->dirty;
+
+	/* Is compressed backup up to date? */
+	if (imxexa_box_is_empty(box) && NULL != fPixmapPtr->packPtr) {
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numCleanEvictions;
+
+#endif
+
+		return TRUE;
+	}
+
+	if (!imxexa_unpack_backup(fPtr, fPixmapPtr))
+		return FALSE;
+
+	/* Has surface ever been evicted? */
+	if (NULL == fPixmapPtr->sysPtr) {
+
+		/* Compute number of pitch bytes for sysmem pixmaps of the specified geometry. */
+		const int sysPitchBytes =
+			imxexa_calc_system_memory_pitch(fPixmapPtr->width, fPixmapPtr->bitsPerPixel);
+
+		/* Allocate contiguous height * sysPitchBytes from heap. */
+		void* const sysPtr = malloc(fPixmapPtr->height * sysPitchBytes);
+
+		if (NULL != sysPtr) {
+
+			fPixmapPtr->sysPtr = sysPtr;
+			fPixmapPtr->sysPitchBytes = sysPitchBytes;
+		}
+		else {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_update_backup_from_surface failed to allocate backing storage for GPU surface\n");
+			return FALSE;
+		}
+	}
+
+	/* Is backup up to date? Then there is nothing to copy, and no need to sync with the GPU. */
+	/* A backup allocated just now is no exception, as all content written since pixmap */
+	/* creation is dirty. */
+	if (imxexa_box_is_empty(box)) {
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numCleanEvictions;
+
+#endif
+
+		return TRUE;
+	}
+
+	/* Backup is about to change, which renders its compressed copy stale. */
+	imxexa_drop_packed_backup(fPtr, fPixmapPtr);
+
+	char* ptr_dst = fPixmapPtr->sysPtr;
+	char* ptr_src = fPixmapPtr->surfPtr;
+
+	if (NULL == fPixmapPtr->surfPtr) {
+
+		/* Access-lock the surface. */
+		const C2D_STATUS r = imxexa_lock_surface(fPtr, fPixmapPtr, (void**) &ptr_src);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_update_backup_from_surface failed to lock GPU surface (code: 0x%08x)\n", r);
+			return FALSE;
+		}
+
+		fPixmapPtr->surfPtr = ptr_src;
+	}
+
+	const int pitch_dst = fPixmapPtr->sysPitchBytes;
+	const int pitch_src = fPixmapPtr->surfDef.stride;
+
+	const int offs_bytes = box->x1 * fPixmapPtr->bitsPerPixel / 8;
+	const int line_bytes = (box->x2 * fPixmapPtr->bitsPerPixel + 7) / 8 - offs_bytes;
+	const int line_count = box->y2 - box->y1;
+
+	imxexa_copy_rows_from_gpumem(
+		ptr_dst + box->y1 * pitch_dst + offs_bytes,
+		pitch_dst,
+		ptr_src + box->y1 * pitch_src + offs_bytes,
+		pitch_src,
+		line_bytes,
+		line_count);
+
+#if IMX_DEBUG_MASTER
+
+	fPtr->evictedBytesCopied += line_bytes * line_count;
+
+#endif
+
+	/* Backup and surface are in sync. */
+	box->x2 = box->x1;
+
+	return TRUE;
+}
+
+static inline Bool
+imxexa_can_evict_pixmap(
+	const IMXEXAPtr fPtr,
+	const IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return FALSE;
+
+	if (PIXMAP_STAMP_PINNED == fPixmapPtr->stamp)
+		return FALSE;
+
+	/* Is pixmap not in gpumem, or was it not allocated via the standard allocator? */
+	if (NULL == fPixmapPtr->surf || 0 != (C2D_SURFACE_NO_BUFFER_ALLOC & fPixmapPtr->surfDef.flags))
+		return FALSE;
+
+	/* Is pixmap participating in an ongoing op? */
+	if (fPtr->pPixDst == fPixmapPtr ||
+		fPtr->pPixSrc == fPixmapPtr ||
+		fPtr->pPixMsk == fPixmapPtr) {
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static double
+imxexa_eviction_score_lru(
+	const struct _IMXEXARec* fPtr,
+	const struct _IMXEXAPixmapRec* fPixmapPtr)
+{
+	/* Least recently used goes first. */
+	return (double) (fPtr->heartbeat - fPixmapPtr->stamp);
+}
+
+static double
+imxexa_eviction_score_gds(
+	const struct _IMXEXARec* fPtr,
+	const struct _IMXEXAPixmapRec* fPixmapPtr)
+{
+	/* GreedyDual-Size flavor: the benefit of evicting a pixmap is the bytes it frees, its cost */
+	/* is that of a reinstate (fixed overhead plus bytes copied back) times the odds of one, */
+	/* the latter growing with the use count and decaying with the time since last use. */
+	const double bytes = fPixmapPtr->surfDef.height * fPixmapPtr->surfDef.stride;
+	const double age = 1 + fPtr->heartbeat - fPixmapPtr->stamp;
+
+	unsigned uses = fPixmapPtr->n_uses;
+	unsigned freq = 1;
+
+	while (0 != (uses >>= 1))
+		++freq;
+
+	return age * bytes / (freq * (IMX_EXA_EVICTION_FIXED_COST + bytes));
+}
+
+/* Available eviction policies; the first one is the default. */
+static const IMXEXAEvictionPolicyRec imxexa_eviction_policies[] = {
+	{
+		.name = "gds",
+		.score = imxexa_eviction_score_gds
+	},
+	{
+		.name = "lru",
+		.score = imxexa_eviction_score_lru
+	}
+};
+
+/* Eviction score multipliers by priority class of pixmap. */
+static const double imxexa_eviction_weights[IMXEXA_PRIORITY_COUNT] = {
+	8.0,	/* IMXEXA_PRIORITY_SCRATCH */
+	1.0,	/* IMXEXA_PRIORITY_NORMAL */
+	0.5,	/* IMXEXA_PRIORITY_GLYPH */
+	0.125	/* IMXEXA_PRIORITY_BACKING */
+};
+
+static inline imxexa_priority_t
+imxexa_priority_from_usage(
+	int usage)
+{
+	switch (usage) {
+	case CREATE_PIXMAP_USAGE_SCRATCH:
+		return IMXEXA_PRIORITY_SCRATCH;
+	case CREATE_PIXMAP_USAGE_GLYPH_PICTURE:
+		return IMXEXA_PRIORITY_GLYPH;
+	case CREATE_PIXMAP_USAGE_BACKING_PIXMAP:
+		return IMXEXA_PRIORITY_BACKING;
+	}
+
+	return IMXEXA_PRIORITY_NORMAL;
+}
+
+static inline Bool
+imxexa_gpumem_under_pressure(
+	const IMXEXAPtr fPtr)
+{
+	return 0 != fPtr->lastEvictionStamp &&
+		fPtr->heartbeat - fPtr->lastEvictionStamp < IMX_EXA_PRESSURE_WINDOW;
+}
+
+static inline Bool
+imxexa_atlas_accepts_pixmap(
+	const IMXEXAPtr fPtr,
+	int width, int height,
+	int depth)
+{
+	return fPtr->useAtlas && 8 <= depth &&
+		IMX_EXA_ATLAS_MAX_PIXMAP_WIDTH >= width &&
+		IMX_EXA_ATLAS_MAX_PIXMAP_HEIGHT >= height;
+}
+
+static imxexa_placement_t
+imxexa_place_pixmap(
+	const IMXEXAPtr fPtr,
+	int width, int height,
+	int depth,
+	int usage)
+{
+	/* Too large for the GPU to address? */
+	if (fPtr->maxSurfDim < width || fPtr->maxSurfDim < height)
+		return IMXEXA_PLACEMENT_SYSMEM;
+
+	/* Too short for a surface of its own? Sub-surfaces in atlases are just as short, so this is no */
+	/* remedy for Z160 and its trouble with short surfaces; that is why atlases are off there by default. */
+	if (fPtr->minSurfHeight > height) {
+
+		return imxexa_atlas_accepts_pixmap(fPtr, width, height, depth) ?
+			IMXEXA_PLACEMENT_ATLAS : IMXEXA_PLACEMENT_SYSMEM;
+	}
+
+	/* Backing pixmaps of redirected windows get composited on every frame; */
+	/* they are worth gpumem regardless of their size. */
+	if (CREATE_PIXMAP_USAGE_BACKING_PIXMAP == usage && 8 <= depth)
+		return IMXEXA_PLACEMENT_GPUMEM;
+
+	/* Too small to pay for a surface of its own? Atlases share the surface overhead. */
+	if (fPtr->minSurfArea > width * height) {
+
+		return imxexa_atlas_accepts_pixmap(fPtr, width, height, depth) ?
+			IMXEXA_PLACEMENT_ATLAS : IMXEXA_PLACEMENT_SYSMEM;
+	}
+
+	/* Under gpumem pressure, short-lived or small pixmaps must not push out established ones. */
+	if (imxexa_gpumem_under_pressure(fPtr)) {
+
+		if (CREATE_PIXMAP_USAGE_SCRATCH == usage)
+			return IMXEXA_PLACEMENT_GPUMEM_IF_FREE;
+
+		if (CREATE_PIXMAP_USAGE_GLYPH_PICTURE != usage &&
+			IMX_EXA_PRESSURE_AREA_FACTOR * fPtr->minSurfArea > width * height) {
+
+			return IMXEXA_PLACEMENT_GPUMEM_IF_FREE;
+		}
+	}
+
+	return IMXEXA_PLACEMENT_GPUMEM;
+}
+
+static unsigned
+imxexa_select_eviction_victims(
+	IMXEXAPtr fPtr,
+	unsigned bytes_needed,
+	Bool mapped_only,
+	IMXEXAPixmapPtr victim[IMX_EXA_EVICTION_BATCH],
+	unsigned* bytes_selected)
+{
+	double score[IMX_EXA_EVICTION_BATCH];
+	unsigned count = 0;
+	unsigned bytes_collected = 0;
+
+	/* Sweep the clock hand over the pixmaps, giving referenced ones a second chance by */
+	/* clearing their reference, and collecting unreferenced ones as candidates, sorted by */
+	/* descending score, until they cover a multiple of the needed bytes or fill a batch. */
+	/* The sweep is bounded by two revolutions, after which every reference is cleared. */
+	IMXEXAPixmapPtr const start = NULL != fPtr->pClockHand ? fPtr->pClockHand : fPtr->pFirstPix;
+	IMXEXAPixmapPtr p = start;
+	unsigned laps = 0;
+
+	while (NULL != p && 2 > laps &&
+		IMX_EXA_EVICTION_BATCH > count &&
+		IMX_EXA_CLOCK_WINDOW_FACTOR * bytes_needed > bytes_collected) {
+
+		IMXEXAPixmapPtr const q = p;
+
+		p = NULL != p->next ? p->next : fPtr->pFirstPix;
+
+		if (start == p)
+			++laps;
+
+		if (!imxexa_can_evict_pixmap(fPtr, q))
+			continue;
+
+		if (mapped_only && NULL == q->surfPtr)
+			continue;
+
+		if (q->referenced) {
+
+			q->referenced = FALSE;
+			continue;
+		}
+
+		const double s = fPtr->evictionPolicy->score(fPtr, q) * imxexa_eviction_weights[q->priority];
+		unsigned i = count++;
+
+		for (; 0 < i && score[i - 1] < s; --i) {
+
+			score[i] = score[i - 1];
+			victim[i] = victim[i - 1];
+		}
+
+		score[i] = s;
+		victim[i] = q;
+
+		bytes_collected += q->surfDef.height * q->surfDef.stride;
+	}
+
+	fPtr->pClockHand = p;
+
+	/* Keep the shortest run of best-scored candidates that frees the needed bytes. */
+	unsigned bytes = 0;
+	unsigned n = 0;
+
+	while (n < count && bytes < bytes_needed) {
+
+		bytes += victim[n]->surfDef.height * victim[n]->surfDef.stride;
+		++n;
+	}
+
+	*bytes_selected = bytes;
+
+	return n;
+}
+
+static inline unsigned
+imxexa_estimate_surface_bytes(
+	const C2D_SURFACE_DEF* surfDef)
+{
+	/* Stride is not known before allocation; assume rows padded to 32 pixels. */
+	return ((surfDef->width + 31) & ~31) * imxexa_bpp_from_c2d_format(surfDef->format) / 8 * surfDef->height;
+}
+
+static Bool
+imxexa_evict_pixmap(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr);
+
+static C2D_STATUS
+imxexa_alloc_c2d_surface_ex(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE_DEF* surfDef,
+	C2D_SURFACE* surf,
+	Bool may_evict)
+{
+	/* Allocations that may not evict must not take gpumem beyond the budget either. */
+	if (!may_evict && 0 != fPtr->gpumemBudget &&
+		imxexa_calc_c2d_allocated_mem(fPtr) + imxexa_estimate_surface_bytes(surfDef) > fPtr->gpumemBudget) {
+
+		return C2D_STATUS_OUT_OF_MEMORY;
+	}
+
+	C2D_STATUS r = c2dSurfAlloc(fPtr->gpuContext, surf, surfDef);
+
+	/* In case of failure due to running out of memory, first give up all recycled surfaces. */
+	if (C2D_STATUS_OUT_OF_MEMORY == r && 0 != fPtr->surfPoolCount) {
+
+		imxexa_surf_pool_trim(fPtr, 0);
+
+		r = c2dSurfAlloc(fPtr->gpuContext, surf, surfDef);
+	}
+
+	/* Still out of memory? Evict sets of victims picked by the eviction policy, each set */
+	/* expected to free enough memory for the allocation, until the allocation succeeds. */
+	const unsigned bytes_needed = imxexa_estimate_surface_bytes(surfDef);
+	unsigned bytes_evicted = 0;
+
+	while (may_evict && C2D_STATUS_OUT_OF_MEMORY == r) {
+
+		IMXEXAPixmapPtr victim[IMX_EXA_EVICTION_BATCH];
+		unsigned bytes_selected;
+
+		/* Surfaces still access-locked from CPU access can be copied out without waiting */
+		/* on the GPU; prefer those, and resort to surfaces that need locking only if the */
+		/* former can't cover the request. Locking the first of those syncs with the GPU, */
+		/* after which the remaining locks of the pass come for free. */
+		unsigned count = imxexa_select_eviction_victims(fPtr, bytes_needed, TRUE, victim, &bytes_selected);
+
+		if (bytes_selected < bytes_needed)
+			count = imxexa_select_eviction_victims(fPtr, bytes_needed, FALSE, victim, &bytes_selected);
+
+		unsigned bytes_evicted_pass = 0;
+		unsigned i;
+
+		for (i = 0; i < count; ++i) {
+
+			const unsigned bytes = victim[i]->surfDef.height * victim[i]->surfDef.stride;
+
+#if IMX_DEBUG_MASTER
+
+			const Bool mapped = NULL != victim[i]->surfPtr;
+
+#endif
+
+			if (!imxexa_evict_pixmap(fPtr, victim[i]))
+				continue;
+
+			bytes_evicted_pass += bytes;
+
+#if IMX_DEBUG_MASTER
+
+			++fPtr->numEvictedPixmaps;
+
+			if (!mapped)
+				++fPtr->numEvictedUnmapped;
+
+#endif
+		}
+
+		/* Has nothing been evicted in this pass? Further passes won't fare better. */
+		if (0 == bytes_evicted_pass)
+			break;
+
+		bytes_evicted += bytes_evicted_pass;
+
+		r = c2dSurfAlloc(fPtr->gpuContext, surf, surfDef);
+	}
+
+	if (0 != bytes_evicted)
+		fPtr->lastEvictionStamp = fPtr->heartbeat;
+
+#if IMX_DEBUG_MASTER
+
+	if (0 != bytes_evicted) {
+
+		++fPtr->numEvictingAllocs;
+		fPtr->evictedBytesTotal += bytes_evicted;
+
+		if (bytes_evicted > fPtr->evictedBytesMax)
+			fPtr->evictedBytesMax = bytes_evicted;
+	}
+
+#endif
+
+#if IMX_EXA_DEBUG_EVICTION
+
+	if (0 != bytes_evicted) {
+
+		xf86DrvMsg(0, X_INFO,
+			"imxexa_alloc_c2d_surface evicted %u bytes for a request of %u bytes (code: 0x%08x)\n",
+			bytes_evicted, bytes_needed, r);
+	}
+
+#endif
+
+	return r;
+}
+
+C2D_STATUS
+imxexa_alloc_c2d_surface(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE_DEF* surfDef,
+	C2D_SURFACE* surf)
+{
+	return imxexa_alloc_c2d_surface_ex(fPtr, surfDef, surf, TRUE);
+}
+
+static void
+imxexa_vidmem_release_space(
+	IMXEXAPtr fPtr,
+	unsigned offset,
+	unsigned bytes)
+{
+	IMXEXAVidmemBlockRec* const block = fPtr->vidmemBlock;
+	unsigned i;
+
+	/* Find the first free block past the space, and coalesce the space with its neighbors. */
+	for (i = 0; i < fPtr->vidmemBlockCount && block[i].offset < offset; ++i)
+		;
+
+	const Bool join_prev = 0 < i && block[i - 1].offset + block[i - 1].size == offset;
+	const Bool join_next = fPtr->vidmemBlockCount > i && offset + bytes == block[i].offset;
+
+	if (join_prev && join_next) {
+
+		block[i - 1].size += bytes + block[i].size;
+
+		memmove(block + i, block + i + 1, (--fPtr->vidmemBlockCount - i) * sizeof(*block));
+	}
+	else
+	if (join_prev) {
+
+		block[i - 1].size += bytes;
+	}
+	else
+	if (join_next) {
+
+		block[i].offset = offset;
+		block[i].size += bytes;
+	}
+	else {
+
+		memmove(block + i + 1, block + i, (fPtr->vidmemBlockCount++ - i) * sizeof(*block));
+
+		block[i].offset = offset;
+		block[i].size = bytes;
+	}
+
+	fPtr->vidmemFree += bytes;
+}
+
+static Bool
+imxexa_vidmem_alloc_pixmap_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Every surface in the heap may leave a free block of its own behind; never let */
+	/* surfaces outnumber the free block slots, so that releasing space can't run out of them. */
+	if (0 == fPtr->vidmemSize || IMXEXA_VIDMEM_MAX_BLOCKS - 1 <= fPtr->vidmemLiveCount)
+		return FALSE;
+
+	const C2D_COLORFORMAT format = fPixmapPtr->surfDef.format;
+	const unsigned bpp = imxexa_bpp_from_c2d_format(format);
+
+	if (0 == bpp)
+		return FALSE;
+
+	/* Rows are padded to 32 pixels, as by the C2D allocator. */
+	const unsigned stride = ((fPixmapPtr->surfDef.width + 31) & ~31) * bpp / 8;
+	const unsigned bytes = (stride * fPixmapPtr->surfDef.height + IMX_EXA_VIDMEM_ALIGN_BYTES - 1) &
+		~(IMX_EXA_VIDMEM_ALIGN_BYTES - 1);
+
+	IMXEXAVidmemBlockRec* const block = fPtr->vidmemBlock;
+	unsigned i;
+
+	/* First fit keeps the surfaces towards the bottom of the heap, and free space together at its top. */
+	for (i = 0; i < fPtr->vidmemBlockCount && block[i].size < bytes; ++i)
+		;
+
+	if (fPtr->vidmemBlockCount == i) {
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numVidmemFailures;
+
+#endif
+
+		return FALSE;
+	}
+
+	const unsigned offset = block[i].offset;
+
+	block[i].offset += bytes;
+	block[i].size -= bytes;
+
+	if (0 == block[i].size)
+		memmove(block + i, block + i + 1, (--fPtr->vidmemBlockCount - i) * sizeof(*block));
+
+	fPtr->vidmemFree -= bytes;
+
+	/* Surface wraps its block of the heap. */
+	C2D_SURFACE_DEF surfDef;
+	memcpy(&surfDef, &fPixmapPtr->surfDef, sizeof(surfDef));
+
+	surfDef.stride = stride;
+	surfDef.buffer = (char *) fPtr->vidmemBuffer + offset;
+	surfDef.host = (char *) fPtr->vidmemHost + offset;
+	surfDef.flags = C2D_SURFACE_NO_BUFFER_ALLOC;
+
+	C2D_SURFACE surf;
+	const C2D_STATUS r = c2dSurfAlloc(fPtr->gpuContext, &surf, &surfDef);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_vidmem_alloc_pixmap_surface failed to allocate surface (code: 0x%08x)\n", r);
+
+		imxexa_vidmem_release_space(fPtr, offset, bytes);
+		return FALSE;
+	}
+
+	memcpy(&fPixmapPtr->surfDef, &surfDef, sizeof(surfDef));
+	fPixmapPtr->surf = surf;
+
+	fPixmapPtr->vidmemOffset = offset;
+	fPixmapPtr->vidmemBytes = bytes;
+
+	/* Ops on earlier users of the space may still be in flight. */
+	fPixmapPtr->gpuSerial = fPtr->releasedSerial;
+
+	++fPtr->vidmemLiveCount;
+
+#if IMX_DEBUG_MASTER
+
+	++fPtr->numVidmemAllocs;
+
+#endif
+
+	return TRUE;
+}
+
+static void
+imxexa_vidmem_release_pixmap(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Surface of pixmap must have been freed by the caller. */
+	if (0 == fPixmapPtr->vidmemBytes)
+		return;
+
+	if (fPixmapPtr->gpuSerial > fPtr->releasedSerial)
+		fPtr->releasedSerial = fPixmapPtr->gpuSerial;
+
+	imxexa_vidmem_release_space(fPtr, fPixmapPtr->vidmemOffset, fPixmapPtr->vidmemBytes);
+
+	--fPtr->vidmemLiveCount;
+	fPixmapPtr->vidmemBytes = 0;
+}
+
+static inline C2D_STATUS
+imxexa_alloc_pixmap_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr,
+	Bool may_evict)
+{
+	/* Spare framebuffer memory goes first, as nothing else uses it. */
+	if (imxexa_vidmem_alloc_pixmap_surface(fPtr, fPixmapPtr))
+		return C2D_STATUS_OK;
+
+	/* Recycle a pooled surface if possible, resort to the allocator otherwise. */
+	uint64_t serial;
+
+	if (imxexa_surf_pool_acquire(fPtr, &fPixmapPtr->surfDef, &fPixmapPtr->surf, &serial)) {
+
+		/* Ops on the earlier user of the surface may still be in flight. */
+		if (serial > fPixmapPtr->gpuSerial)
+			fPixmapPtr->gpuSerial = serial;
+
+		return C2D_STATUS_OK;
+	}
+
+	return imxexa_alloc_c2d_surface_ex(fPtr, &fPixmapPtr->surfDef, &fPixmapPtr->surf, may_evict);
+}
+
+static inline Bool
+imxexa_reinstate_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return TRUE;
+
+	/* Is surface currently evicted? Reinstate it. */
+	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
+
+		imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+		const C2D_COLORFORMAT format = fPixmapPtr->surfDef.format;
+		memset(&fPixmapPtr->surfDef, 0, sizeof(fPixmapPtr->surfDef));
+
+		fPixmapPtr->surfDef.format = format;
+        fPixmapPtr->surfDef.width = fPixmapPtr->width;
+        fPixmapPtr->surfDef.height = fPixmapPtr->height;
+
+		const C2D_STATUS r = imxexa_alloc_pixmap_surface(fPtr, fPixmapPtr, TRUE);
+
+		if (C2D_STATUS_OK == r) {
+
+			imxexa_update_surface_from_backup(fPtr, fPixmapPtr);
+
+			/* Surface and backup are in sync. */
+			fPixmapPtr->dirty.x2 = fPixmapPtr->dirty.x1;
+			fPixmapPtr->stamp = 0;
+			fPixmapPtr->demoted = FALSE;
+
+			imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+		}
+		else {
+
+			imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_unlock_surface failed to reinstate surface (code: 0x%08x), c2d mem utilization %u\n",
+				r, imxexa_calc_c2d_allocated_mem(fPtr));
+
+			return FALSE;
+		}
+
+#if IMX_EXA_DEBUG_EVICTION
+
+		xf86DrvMsg(0, X_INFO,
+			"imxexa_reinstate_pixmap %s\n",
+			imxexa_string_from_priv_pixmap(fPixmapPtr));
+#endif
+
+	}
+
+	return TRUE;
+}
+
+static inline Bool
+imxexa_unlock_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (!imxexa_reinstate_surface(fPtr, fPixmapPtr))
+		return FALSE;
+
+	/* Is surface not locked? */
+	if (NULL == fPixmapPtr || NULL == fPixmapPtr->surfPtr)
+		return TRUE;
+
+	c2dSurfUnlock(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapPtr));
+
+	fPixmapPtr->surfPtr = NULL;
+
+	return TRUE;
+}
+
+static inline Bool
+imxexa_evict_pixmap(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (!imxexa_can_evict_pixmap(fPtr, fPixmapPtr))
+		return FALSE;
+
+	if (!imxexa_update_backup_from_surface(fPtr, fPixmapPtr))
+		return FALSE;
+
+	imxexa_unlock_surface(fPtr, fPixmapPtr);
+
+	/* Surfaces must not go while queued draws may still target them. */
+	imxexa_flush_pixmap_draws(fPtr, fPixmapPtr);
+
+	/* Is pixmap using an alias? */
+	if (NULL != fPixmapPtr->alias && fPixmapPtr->surf != fPixmapPtr->alias) {
+
+		const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPixmapPtr->alias);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_evict_pixmap failed to free pixmap alias (priv rec %p) (code: 0x%08x)\n",
+				fPixmapPtr, r);
+
+			return FALSE;
+		}
+	}
+
+	const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPixmapPtr->surf);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_evict_pixmap failed to free surface (priv rec %p) (code: 0x%08x)\n",
+			fPixmapPtr, r);
+
+		return FALSE;
+	}
+
+	imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+	fPixmapPtr->alias = NULL;
+	fPixmapPtr->surf = NULL;
+	fPixmapPtr->stamp = PIXMAP_STAMP_EVICTED;
+
+	imxexa_pack_backup(fPtr, fPixmapPtr);
+
+	imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+#if IMX_EXA_DEBUG_EVICTION
+
+	xf86DrvMsg(0, X_INFO,
+		"imxexa_evict_pixmap %s\n",
+		imxexa_string_from_priv_pixmap(fPixmapPtr));
+#endif
+
+	return TRUE;
+}
+
+static inline unsigned
+imxexa_atlas_align(
+	C2D_COLORFORMAT format)
+{
+	/* Sub-surfaces start at 64-byte boundaries; returns the alignment in pixels, 0 if none fits. */
+	const unsigned bytespp = imxexa_bpp_from_c2d_format(format) / 8;
+
+	if (0 == bytespp || 0 != IMX_EXA_ATLAS_ALIGN_BYTES % bytespp)
+		return 0;
+
+	return IMX_EXA_ATLAS_ALIGN_BYTES / bytespp;
+}
+
+static Bool
+imxexa_atlas_place(
+	IMXEXAAtlasPtr atlas,
+	unsigned width,
+	unsigned height,
+	unsigned* shelf_index,
+	unsigned* x)
+{
+	/* Shelves hold sub-surfaces of heights between 2/3 and all of the shelf height; */
+	/* pick the lowest such shelf with room left, otherwise open a new shelf on top. */
+	unsigned best = IMXEXA_ATLAS_MAX_SHELVES;
+	unsigned i;
+
+	for (i = 0; i < atlas->shelfCount; ++i) {
+
+		const IMXEXAAtlasShelfRec* const shelf = atlas->shelf + i;
+
+		if (shelf->height < height || 2 * shelf->height > 3 * height)
+			continue;
+
+		if (shelf->x + width > atlas->surfDef.width)
+			continue;
+
+		if (IMXEXA_ATLAS_MAX_SHELVES == best || shelf->height < atlas->shelf[best].height)
+			best = i;
+	}
+
+	if (IMXEXA_ATLAS_MAX_SHELVES == best) {
+
+		if (IMXEXA_ATLAS_MAX_SHELVES == atlas->shelfCount ||
+			atlas->top + height > atlas->surfDef.height) {
+
+			return FALSE;
+		}
+
+		best = atlas->shelfCount++;
+
+		atlas->shelf[best].y = atlas->top;
+		atlas->shelf[best].height = height;
+		atlas->shelf[best].x = 0;
+		atlas->shelf[best].count = 0;
+
+		atlas->top += height;
+	}
+
+	*shelf_index = best;
+	*x = atlas->shelf[best].x;
+
+	atlas->shelf[best].x += width;
+	++atlas->shelf[best].count;
+
+	return TRUE;
+}
+
+static void
+imxexa_atlas_free(
+	IMXEXAPtr fPtr,
+	IMXEXAAtlasPtr atlas)
+{
+	if (NULL == atlas->surf)
+		return;
+
+	imxexa_flush_pending_draws(fPtr);
+
+	const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, atlas->surf);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_atlas_free failed to free atlas surface (code: 0x%08x)\n", r);
+	}
+
+	fPtr->atlasBytes -= atlas->surfDef.height * atlas->surfDef.stride;
+
+	atlas->surf = NULL;
+	atlas->top = 0;
+	atlas->liveCount = 0;
+	atlas->liveArea = 0;
+	atlas->shelfCount = 0;
+}
+
+static void
+imxexa_atlas_release_space(
+	IMXEXAPtr fPtr,
+	IMXEXAAtlasPtr atlas,
+	unsigned shelf_index,
+	unsigned area)
+{
+	IMXEXAAtlasShelfRec* const shelf = atlas->shelf + shelf_index;
+
+	/* Space within a shelf is reclaimed only once the whole shelf is vacant. */
+	if (0 == --shelf->count)
+		shelf->x = 0;
+
+	--atlas->liveCount;
+	atlas->liveArea -= area;
+
+	/* Give vacant shelves at the top back to the atlas. */
+	while (0 != atlas->shelfCount && 0 == atlas->shelf[atlas->shelfCount - 1].count) {
+
+		--atlas->shelfCount;
+		atlas->top = atlas->shelf[atlas->shelfCount].y;
+	}
+
+	if (0 == atlas->liveCount)
+		imxexa_atlas_free(fPtr, atlas);
+}
+
+static Bool
+imxexa_atlas_alloc_pixmap_surface(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr,
+	const IMXEXAAtlasPtr exclude)
+{
+	const C2D_COLORFORMAT format = fPixmapPtr->surfDef.format;
+	const unsigned align = imxexa_atlas_align(format);
+
+	if (0 == align)
+		return FALSE;
+
+	const unsigned width = (fPixmapPtr->width + align - 1) & ~(align - 1);
+	const unsigned height = (fPixmapPtr->height + IMX_EXA_ATLAS_HEIGHT_GRAIN - 1) & ~(IMX_EXA_ATLAS_HEIGHT_GRAIN - 1);
+
+	IMXEXAAtlasPtr atlas = NULL;
+	IMXEXAAtlasPtr vacant = NULL;
+	unsigned shelf_index;
+	unsigned x;
+	unsigned i;
+
+	/* Find room in the atlases of the same format. */
+	for (i = 0; i < IMXEXA_ATLAS_MAX_COUNT && NULL == atlas; ++i) {
+
+		IMXEXAAtlasPtr a = fPtr->atlas + i;
+
+		if (NULL == a->surf) {
+
+			if (NULL == vacant)
+				vacant = a;
+
+			continue;
+		}
+
+		if (exclude != a && format == a->surfDef.format &&
+			imxexa_atlas_place(a, width, height, &shelf_index, &x)) {
+
+			atlas = a;
+		}
+	}
+
+	/* No room? Start a new atlas, without evicting pixmaps to make space for it. */
+	if (NULL == atlas) {
+
+		if (NULL == vacant)
+			return FALSE;
+
+		memset(&vacant->surfDef, 0, sizeof(vacant->surfDef));
+
+		vacant->surfDef.format = format;
+		vacant->surfDef.width = IMX_EXA_ATLAS_WIDTH;
+		vacant->surfDef.height = IMX_EXA_ATLAS_HEIGHT;
+
+		if (C2D_STATUS_OK != imxexa_alloc_c2d_surface_ex(fPtr, &vacant->surfDef, &vacant->surf, FALSE)) {
+
+			vacant->surf = NULL;
+			return FALSE;
+		}
+
+		fPtr->atlasBytes += vacant->surfDef.height * vacant->surfDef.stride;
+
+#if IMX_DEBUG_MASTER
+
+		const uint32_t gpumem = imxexa_calc_c2d_allocated_mem(fPtr);
+
+		if (gpumem > fPtr->gpumem_watermark)
+			fPtr->gpumem_watermark = gpumem;
+#endif
+
+		if (!imxexa_atlas_place(vacant, width, height, &shelf_index, &x)) {
+
+			imxexa_atlas_free(fPtr, vacant);
+			return FALSE;
+		}
+
+		atlas = vacant;
+	}
+
+	++atlas->liveCount;
+	atlas->liveArea += fPixmapPtr->width * fPixmapPtr->height;
+
+	/* Sub-surface inherits the definition of the atlas, stride included, offset to its position. */
+	const unsigned offset = atlas->shelf[shelf_index].y * atlas->surfDef.stride +
+		x * (imxexa_bpp_from_c2d_format(format) / 8);
+
+	C2D_SURFACE_DEF surfDef;
+	memcpy(&surfDef, &atlas->surfDef, sizeof(surfDef));
+
+	surfDef.width = fPixmapPtr->width;
+	surfDef.height = fPixmapPtr->height;
+	surfDef.buffer = (char *) surfDef.buffer + offset;
+	surfDef.host = NULL != surfDef.host ? (char *) surfDef.host + offset : NULL;
+	surfDef.flags = C2D_SURFACE_NO_BUFFER_ALLOC;
+
+	C2D_SURFACE surf;
+	const C2D_STATUS r = c2dSurfAlloc(fPtr->gpuContext, &surf, &surfDef);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_atlas_alloc_pixmap_surface failed to allocate sub-surface (code: 0x%08x)\n", r);
+
+		imxexa_atlas_release_space(fPtr, atlas, shelf_index, fPixmapPtr->width * fPixmapPtr->height);
+		return FALSE;
+	}
+
+	memcpy(&fPixmapPtr->surfDef, &surfDef, sizeof(surfDef));
+	fPixmapPtr->surf = surf;
+
+	fPixmapPtr->atlas = atlas;
+	fPixmapPtr->atlasShelf = shelf_index;
+	fPixmapPtr->atlasX = x;
+
+	/* Ops on earlier users of the space may still be in flight. */
+	fPixmapPtr->gpuSerial = fPtr->releasedSerial;
+
+#if IMX_DEBUG_MASTER
+
+	++fPtr->numAtlasAllocs;
+
+#endif
+
+	return TRUE;
+}
+
+static IMXEXAAtlasPtr
+imxexa_atlas_release_pixmap(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Surface of pixmap must have been freed by the caller. Returns the atlas if it remains in use. */
+	IMXEXAAtlasPtr atlas = fPixmapPtr->atlas;
+
+	if (NULL == atlas)
+		return NULL;
+
+	fPixmapPtr->atlas = NULL;
+
+	if (fPixmapPtr->gpuSerial > fPtr->releasedSerial)
+		fPtr->releasedSerial = fPixmapPtr->gpuSerial;
+
+	imxexa_atlas_release_space(fPtr, atlas, fPixmapPtr->atlasShelf, fPixmapPtr->width * fPixmapPtr->height);
+
+	return NULL != atlas->surf ? atlas : NULL;
+}
+
+static inline Bool
+imxexa_atlas_is_sparse(
+	const IMXEXAAtlasPtr atlas)
+{
+	/* Are the shelves reaching halfway up the atlas, yet less than a quarter of them in use? */
+	return NULL != atlas->surf &&
+		2 * atlas->top >= atlas->surfDef.height &&
+		4 * atlas->liveArea < atlas->top * atlas->surfDef.width;
+}
+
+static void
+imxexa_atlas_repack(
+	IMXEXAPtr fPtr,
+	IMXEXAAtlasPtr atlas)
+{
+	IMXEXAPixmapPtr p;
+
+	/* Pixmaps of an ongoing op, or pinned ones, must stay where they are. */
+	if (NULL != fPtr->pPixDst)
+		return;
+
+	for (p = fPtr->pFirstPix; p != NULL; p = p->next) {
+
+		if (atlas == p->atlas && PIXMAP_STAMP_PINNED == p->stamp)
+			return;
+	}
+
+	/* Move the live pixmaps of atlas into the other atlases, new ones if need be; the atlas */
+	/* gets freed along with its last pixmap. Pixmaps that fail to move stay where they are. */
+	unsigned moved = 0;
+
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
+	imxexa_set_blend_mode(fPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_plain_sampling(fPtr);
+	imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
+
+	for (p = fPtr->pFirstPix; p != NULL && NULL != atlas->surf; p = p->next) {
+
+		if (atlas != p->atlas)
+			continue;
+
+		imxexa_unlock_surface(fPtr, p);
+
+		const C2D_SURFACE surf = p->surf;
+		const C2D_SURFACE_DEF surfDef = p->surfDef;
+		const unsigned shelf_index = p->atlasShelf;
+		const unsigned x = p->atlasX;
+
+		if (!imxexa_atlas_alloc_pixmap_surface(fPtr, p, atlas))
+			break;
+
+		C2D_RECT rect = {
+			.x = 0,
+			.y = 0,
+			.width = p->width,
+			.height = p->height
+		};
+
+		imxexa_set_dst_surface(fPtr, p->surf);
+		imxexa_set_src_surface(fPtr, surf);
+		c2dSetDstRectangle(fPtr->gpuContext, &rect);
+		c2dSetSrcRectangle(fPtr->gpuContext, &rect);
+
+		const C2D_STATUS r = c2dDrawBlit(fPtr->gpuContext);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_atlas_repack failed to perform GPU draw (code: 0x%08x)\n", r);
+
+			/* Undo the move. */
+			imxexa_free_c2d_surface(fPtr, p->surf);
+			imxexa_atlas_release_pixmap(fPtr, p);
+
+			p->surf = surf;
+			p->surfDef = surfDef;
+			p->atlas = atlas;
+			p->atlasShelf = shelf_index;
+			p->atlasX = x;
+			break;
+		}
+
+		imxexa_queue_draw(fPtr);
+		p->gpuSerial = imxexa_current_serial(fPtr);
+
+		/* Any alias refers to the old location; a new one gets made on demand. */
+		if (NULL != p->alias && surf != p->alias)
+			imxexa_free_c2d_surface(fPtr, p->alias);
+
+		p->alias = NULL;
+
+		imxexa_free_c2d_surface(fPtr, surf);
+		++moved;
+
+		/* Atlas must not be freed before the GPU is done reading from it. */
+		if (1 == atlas->liveCount)
+			imxexa_finish_gpu(fPtr);
+
+		imxexa_atlas_release_space(fPtr, atlas, shelf_index, p->width * p->height);
+	}
+
+	if (0 != moved)
+		imxexa_flush_pending_draws(fPtr);
+
+#if IMX_DEBUG_MASTER
+
+	++fPtr->numAtlasRepacks;
+
+#endif
+
+#if IMX_EXA_DEBUG_ATLAS
+
+	xf86DrvMsg(0, X_INFO,
+		"imxexa_atlas_repack moved %u pixmaps\n", moved);
+
+#endif
+}
+
+static Bool
+imxexa_evict_idle_batch(
+	IMXEXAPtr fPtr)
+{
+	/* Evict a batch of cold pixmaps towards the low watermark. Returns TRUE if more are to go. */
+	unsigned allocated = imxexa_calc_c2d_allocated_mem(fPtr);
+
+	if (allocated <= fPtr->gpumemLowMark)
+		return FALSE;
+
+	/* Recycled surfaces go first, as they hold no content. */
+	const unsigned excess = allocated - fPtr->gpumemLowMark;
+
+	imxexa_surf_pool_trim(fPtr, excess < fPtr->surfPoolBytes ? fPtr->surfPoolBytes - excess : 0);
+
+	allocated = imxexa_calc_c2d_allocated_mem(fPtr);
+
+	if (allocated <= fPtr->gpumemLowMark)
+		return FALSE;
+
+	/* Pick victims as an evicting allocation would, mapped ones first. */
+	const unsigned bytes_needed = allocated - fPtr->gpumemLowMark;
+	IMXEXAPixmapPtr victim[IMX_EXA_EVICTION_BATCH];
+	unsigned bytes_selected;
+
+	unsigned count = imxexa_select_eviction_victims(fPtr, bytes_needed, TRUE, victim, &bytes_selected);
+
+	if (bytes_selected < bytes_needed)
+		count = imxexa_select_eviction_victims(fPtr, bytes_needed, FALSE, victim, &bytes_selected);
+
+	unsigned bytes_evicted = 0;
+	unsigned i;
+
+	for (i = 0; i < count; ++i) {
+
+		/* Leave recently used pixmaps be, even if that means staying above the low watermark. */
+		if (fPtr->heartbeat - victim[i]->stamp < IMX_EXA_IDLE_EVICTION_MIN_AGE)
+			continue;
+
+		const unsigned bytes = victim[i]->surfDef.height * victim[i]->surfDef.stride;
+
+		if (!imxexa_evict_pixmap(fPtr, victim[i]))
+			continue;
+
+		bytes_evicted += bytes;
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numIdleEvictedPixmaps;
+		fPtr->idleEvictedBytes += bytes;
+
+#endif
+	}
+
+	return 0 != bytes_evicted && imxexa_calc_c2d_allocated_mem(fPtr) > fPtr->gpumemLowMark;
+}
+
+static unsigned
+imxexa_probe_free_block(
+	IMXEXAPtr fPtr,
+	unsigned max_bytes,
+	C2D_SURFACE* surf)
+{
+	/* Find by bisection of its height the tallest probe surface of up to max_bytes that can be */
+	/* allocated, and leave it allocated. Probes are 32bpp and as wide as the widest pixmap surface, */
+	/* so the largest of them is as large as the largest pixmap surface. Returns its size, 0 if none fits. */
+	C2D_SURFACE_DEF surfDef;
+	C2D_SURFACE probe;
+	const unsigned row_bytes = fPtr->maxSurfDim * 4;
+	int lo = 0;
+	int hi = fPtr->maxSurfDim;
+
+	if (max_bytes / row_bytes < (unsigned) hi)
+		hi = max_bytes / row_bytes;
+
+	memset(&surfDef, 0, sizeof(surfDef));
+
+	surfDef.format = C2D_COLOR_8888;
+	surfDef.width = fPtr->maxSurfDim;
+
+	while (lo < hi) {
+
+		surfDef.height = (lo + hi + 1) / 2;
+
+		if (C2D_STATUS_OK == c2dSurfAlloc(fPtr->gpuContext, &probe, &surfDef)) {
+
+			imxexa_free_c2d_surface(fPtr, probe);
+			lo = surfDef.height;
+		}
+		else
+			hi = surfDef.height - 1;
+	}
+
+	*surf = NULL;
+
+	if (0 == lo)
+		return 0;
+
+	surfDef.height = lo;
+
+	if (C2D_STATUS_OK != c2dSurfAlloc(fPtr->gpuContext, surf, &surfDef)) {
+
+		*surf = NULL;
+		return 0;
+	}
+
+	return surfDef.height * surfDef.stride;
+}
+
+static void
+imxexa_measure_gpumem_fragmentation(
+	IMXEXAPtr fPtr)
+{
+	/* C2D does not tell about its heap; take free gpumem in the largest blocks available, one */
+	/* after the other, then give it all back. The first block is the largest free one, and the */
+	/* blocks add up to the free gpumem, short of holes smaller than a probe row. Only so much */
+	/* gets taken; beyond that, free gpumem is plenty, and the measure is of its first part. */
+	C2D_SURFACE block[IMX_EXA_DEFRAG_PROBE_BLOCKS];
+	unsigned total = 0;
+	unsigned largest = 0;
+	unsigned count;
+
+	for (count = 0; count < IMX_EXA_DEFRAG_PROBE_BLOCKS && IMX_EXA_DEFRAG_PROBE_MAX_BYTES > total; ++count) {
+
+		const unsigned bytes = imxexa_probe_free_block(fPtr, IMX_EXA_DEFRAG_PROBE_MAX_BYTES - total, block + count);
+
+		if (0 == bytes)
+			break;
+
+		if (0 == count)
+			largest = bytes;
+
+		total += bytes;
+	}
+
+	while (0 != count)
+		imxexa_free_c2d_surface(fPtr, block[--count]);
+
+	fPtr->gpumemFreeTotal = total;
+	fPtr->gpumemFreeLargest = largest;
+	fPtr->defragCheckStamp = fPtr->heartbeat;
+
+#if IMX_EXA_DEBUG_DEFRAG
+
+	xf86DrvMsg(0, X_INFO,
+		"imxexa_measure_gpumem_fragmentation found %u bytes free, largest block %u, fragmentation %u%%\n",
+		total, largest, imxexa_calc_gpumem_fragmentation(fPtr));
+
+#endif
+}
+
+static inline Bool
+imxexa_can_relocate_pixmap(
+	imxexa_backend_t backend,
+	const IMXEXAPtr fPtr,
+	const IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Movable pixmaps are those that could be evicted, less the locked ones, less those in */
+	/* atlases, which get repacked on their own, and less those the backend cannot blit to, */
+	/* as 8bpp-or-narrower ones unless backend is Z160. */
+	return imxexa_can_evict_pixmap(fPtr, fPixmapPtr) &&
+		NULL == fPixmapPtr->surfPtr &&
+		NULL == fPixmapPtr->atlas &&
+		(8 < fPixmapPtr->bitsPerPixel || IMXEXA_BACKEND_Z160 == backend);
+}
+
+static unsigned
+imxexa_relocate_pixmaps(
+	imxexa_backend_t backend,
+	IMXEXAPtr fPtr)
+{
+	/* Move the highest-addressed movable surfaces into fresh allocations by GPU blits. Those fill */
+	/* the lowest holes that fit, so freeing the old surfaces lets free space coalesce at the top. */
+	/* Moves that wouldn't go down are not made. Returns the number of pixmaps relocated. */
+	IMXEXAPixmapPtr cand[IMX_EXA_DEFRAG_BATCH];
+	unsigned count = 0;
+	IMXEXAPixmapPtr p;
+
+	if (NULL != fPtr->pPixDst)
+		return 0;
+
+	for (p = fPtr->pFirstPix; p != NULL; p = p->next) {
+
+		if (!imxexa_can_relocate_pixmap(backend, fPtr, p))
+			continue;
+
+		const uintptr_t addr = (uintptr_t) p->surfDef.buffer;
+		unsigned i = count < IMX_EXA_DEFRAG_BATCH ? count++ : IMX_EXA_DEFRAG_BATCH;
+
+		for (; 0 < i && (uintptr_t) cand[i - 1]->surfDef.buffer < addr; --i) {
+
+			if (IMX_EXA_DEFRAG_BATCH > i)
+				cand[i] = cand[i - 1];
+		}
+
+		if (IMX_EXA_DEFRAG_BATCH > i)
+			cand[i] = p;
+	}
+
+	C2D_SURFACE old_surf[IMX_EXA_DEFRAG_BATCH];
+	C2D_SURFACE old_alias[IMX_EXA_DEFRAG_BATCH];
+	unsigned moved = 0;
+	unsigned i;
+
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
+	imxexa_set_blend_mode(fPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_plain_sampling(fPtr);
+	imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
+
+	for (i = 0; i < count; ++i) {
+
+		p = cand[i];
+
+		C2D_SURFACE_DEF surfDef;
+		C2D_SURFACE surf;
+
+		memset(&surfDef, 0, sizeof(surfDef));
+
+		surfDef.format = p->surfDef.format;
+		surfDef.width = p->surfDef.width;
+		surfDef.height = p->surfDef.height;
+
+		/* Nothing fits anymore? */
+		if (C2D_STATUS_OK != c2dSurfAlloc(fPtr->gpuContext, &surf, &surfDef))
+			break;
+
+		/* No lower hole for this one? Smaller ones may still find some. */
+		if ((uintptr_t) surfDef.buffer >= (uintptr_t) p->surfDef.buffer) {
+
+			imxexa_free_c2d_surface(fPtr, surf);
+			continue;
+		}
+
+		C2D_RECT rect = {
+			.x = 0,
+			.y = 0,
+			.width = p->width,
+			.height = p->height
+		};
+
+		imxexa_set_dst_surface(fPtr, surf);
+		imxexa_set_src_surface(fPtr, p->surf);
+		c2dSetDstRectangle(fPtr->gpuContext, &rect);
+		c2dSetSrcRectangle(fPtr->gpuContext, &rect);
+
+		const C2D_STATUS r = c2dDrawBlit(fPtr->gpuContext);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_relocate_pixmaps failed to perform GPU draw (code: 0x%08x)\n", r);
+
+			imxexa_free_c2d_surface(fPtr, surf);
+			break;
+		}
+
+		imxexa_queue_draw(fPtr);
+		imxexa_account_pixmap(fPtr, p, -1);
+
+		/* Old surface and any alias of it go once the GPU is done reading; a new alias gets made on demand. */
+		old_surf[moved] = p->surf;
+		old_alias[moved] = p->surf != p->alias ? p->alias : NULL;
+
+		p->surf = surf;
+		p->surfDef = surfDef;
+		p->alias = NULL;
+
+		imxexa_account_pixmap(fPtr, p, 1);
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numRelocatedPixmaps;
+		fPtr->relocatedBytes += surfDef.height * surfDef.stride;
+
+#endif
+
+		++moved;
+	}
+
+	if (0 == moved)
+		return 0;
+
+	imxexa_finish_gpu(fPtr);
+
+	for (i = 0; i < moved; ++i) {
+
+		if (NULL != old_alias[i])
+			imxexa_free_c2d_surface(fPtr, old_alias[i]);
+
+		imxexa_free_c2d_surface(fPtr, old_surf[i]);
+	}
+
+	return moved;
+}
+
+static inline Bool
+imxexa_defrag_check_due(
+	const IMXEXAPtr fPtr)
+{
+	/* Check after enough exa ops, or sooner if allocations had to evict since the last check. */
+	return fPtr->defragGpumem && !fPtr->defragmenting &&
+		(fPtr->heartbeat - fPtr->defragCheckStamp >= IMX_EXA_DEFRAG_CHECK_INTERVAL ||
+		fPtr->lastEvictionStamp > fPtr->defragCheckStamp);
+}
+
+static void
+imxexa_defrag_idle(
+	imxexa_backend_t backend,
+	IMXEXAPtr fPtr)
+{
+	/* Compacting? Relocate a batch of pixmaps; once nothing moves anymore, check again. */
+	if (fPtr->defragmenting) {
+
+		if (0 != imxexa_relocate_pixmaps(backend, fPtr))
+			return;
+
+		fPtr->defragmenting = FALSE;
+
+		imxexa_measure_gpumem_fragmentation(fPtr);
+		return;
+	}
+
+	if (!imxexa_defrag_check_due(fPtr))
+		return;
+
+	/* Recycled surfaces hold no content, yet keep free space from coalescing; give them up first. */
+	imxexa_surf_pool_trim(fPtr, 0);
+
+	imxexa_measure_gpumem_fragmentation(fPtr);
+
+	if (IMX_EXA_DEFRAG_MIN_FREE <= fPtr->gpumemFreeTotal &&
+		IMX_EXA_DEFRAG_THRESHOLD <= imxexa_calc_gpumem_fragmentation(fPtr)) {
+
+		fPtr->defragmenting = TRUE;
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numDefragPasses;
+
+#endif
+	}
+}
+
+static void
+imxexa_block_handler(
+	pointer blockData,
+	OSTimePtr pTimeout,
+	pointer pReadmask)
+{
+	ScrnInfoPtr pScrn = (ScrnInfoPtr) blockData;
+	IMXEXAPtr fPtr = IMXEXAPTR(IMXPTR(pScrn));
+
+	if (NULL == fPtr->gpuContext)
+		return;
+
+	/* Nothing is to stay queued while the server sleeps. */
+	imxexa_flush_pending_draws(fPtr);
+	imxexa_update_flush_rate(fPtr);
+
+	/* Has gpumem usage crossed the high watermark? Evict down to the low one at idle time; */
+	/* after a pass that freed nothing, not before exa ops have aged the pixmaps. */
+	if (!fPtr->idleEvicting && 0 != fPtr->gpumemBudget &&
+		fPtr->idleStallStamp != fPtr->heartbeat &&
+		imxexa_calc_c2d_allocated_mem(fPtr) > fPtr->gpumemHighMark) {
+
+		fPtr->idleEvicting = TRUE;
+	}
+
+	/* Don't sleep while there is eviction or compaction to do; wake up right away unless clients keep us busy. */
+	if (fPtr->idleEvicting || fPtr->defragmenting || imxexa_defrag_check_due(fPtr))
+		AdjustWaitForDelay(pTimeout, 0);
+}
+
+static void
+imxexa_wakeup_handler(
+	pointer blockData,
+	int result,
+	pointer pReadmask)
+{
+	ScrnInfoPtr pScrn = (ScrnInfoPtr) blockData;
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	if (NULL == fPtr->gpuContext)
+		return;
+
+	/* Was the server woken up by clients? Leave eviction and compaction for the next idle moment. */
+	if (0 != result)
+		return;
+
+	/* Compact gpumem only once eviction is done; eviction frees up space to compact into. */
+	if (!fPtr->idleEvicting) {
+
+		imxexa_defrag_idle(imxPtr->backend, fPtr);
+		return;
+	}
+
+	const unsigned allocated = imxexa_calc_c2d_allocated_mem(fPtr);
+
+	if (!imxexa_evict_idle_batch(fPtr)) {
+
+		fPtr->idleEvicting = FALSE;
+
+		/* Were all candidates too young, pinned or otherwise stuck? Don't spin on them. */
+		if (imxexa_calc_c2d_allocated_mem(fPtr) >= allocated)
+			fPtr->idleStallStamp = fPtr->heartbeat;
+
+#if IMX_EXA_DEBUG_EVICTION
+
+		xf86DrvMsg(0, X_INFO,
+			"imxexa_wakeup_handler finished idle eviction at %u bytes of gpumem\n",
+			imxexa_calc_c2d_allocated_mem(fPtr));
+#endif
+	}
+}
+
+static inline Bool
+imxexa_migration_held_off(
+	const IMXEXAPtr fPtr,
+	const IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Hysteresis: a pixmap recently migrated one way must not migrate back yet. */
+	return 0 != fPixmapPtr->migrateStamp &&
+		fPtr->heartbeat - fPixmapPtr->migrateStamp < IMX_EXA_MIGRATION_HOLDOFF;
+}
+
+static inline unsigned
+imxexa_heat_pixmap(
+	const IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Decay the heat by the exa ops passed since the last request, then count this request. */
+	const uint64_t half_lives = (fPtr->heartbeat - fPixmapPtr->heatStamp) / IMX_EXA_HEAT_HALF_LIFE;
+
+	fPixmapPtr->heat = 32 > half_lives ? (fPixmapPtr->heat >> half_lives) + 1 : 1;
+	fPixmapPtr->heatStamp = fPtr->heartbeat;
+
+	return fPixmapPtr->heat;
+}
+
+static inline void
+imxexa_reset_pixmap_record(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Pixmap starts a new acceleration record in its new residency. */
+	fPixmapPtr->n_uses = 0;
+	fPixmapPtr->n_failures = 0;
+	fPixmapPtr->heat = 0;
+	fPixmapPtr->migrateStamp = fPtr->heartbeat;
+}
+
+static Bool
+imxexa_is_pixmap_held_in_sysmem(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Demoted pixmaps are served from their backup, and fall back to software, until */
+	/* requested for acceleration often enough; then they get reinstated at first use. */
+	if (NULL == fPixmapPtr || !fPixmapPtr->demoted)
+		return FALSE;
+
+	if (IMX_EXA_PROMOTE_HEAT > imxexa_heat_pixmap(fPtr, fPixmapPtr) ||
+		imxexa_migration_held_off(fPtr, fPixmapPtr)) {
+
+		return TRUE;
+	}
+
+	fPixmapPtr->demoted = FALSE;
+	imxexa_reset_pixmap_record(fPtr, fPixmapPtr);
+
+	++fPtr->numPromotions;
+
+#if IMX_EXA_DEBUG_PROMOTION
+
+	xf86DrvMsg(0, X_INFO,
+		"imxexa_is_pixmap_held_in_sysmem promoted demoted pixmap %s\n",
+		imxexa_string_from_priv_pixmap(fPixmapPtr));
+#endif
+
+	return FALSE;
+}
+
+static Bool
+imxexa_promote_pixmap(
+	imxexa_backend_t backend,
+	IMXEXAPtr fPtr,
+	PixmapPtr pPixmap,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Only driver-allocated sysmem pixmaps of geometry fit for the GPU qualify. */
+	if (NULL == fPixmapPtr->sysPtr || NULL != fPixmapPtr->surf ||
+		PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
+
+		return FALSE;
+	}
+
+	if (fPtr->maxSurfDim < fPixmapPtr->width || fPtr->maxSurfDim < fPixmapPtr->height)
+		return FALSE;
+
+	if (!imxexa_surf_format_from_bpp(backend, fPixmapPtr->bitsPerPixel, &fPixmapPtr->surfDef.format))
+		return FALSE;
+
+	fPixmapPtr->surfDef.width = fPixmapPtr->width;
+	fPixmapPtr->surfDef.height = fPixmapPtr->height;
+
+	/* Short or small pixmaps go in atlases, if anywhere. Promotion never evicts other pixmaps. */
+	const Bool small = fPtr->minSurfHeight > fPixmapPtr->height ||
+		fPtr->minSurfArea > fPixmapPtr->width * fPixmapPtr->height;
+
+	if (small) {
+
+		if (!imxexa_atlas_accepts_pixmap(fPtr, fPixmapPtr->width, fPixmapPtr->height, fPixmapPtr->depth) ||
+			!imxexa_atlas_alloc_pixmap_surface(fPtr, fPixmapPtr, NULL)) {
+
+			return FALSE;
+		}
+	}
+	else
+	if (C2D_STATUS_OK != imxexa_alloc_pixmap_surface(fPtr, fPixmapPtr, FALSE)) {
+
+		fPixmapPtr->surf = NULL;
+		return FALSE;
+	}
+
+	/* Move the content into the surface; leave the surface locked for a lazy unlock. */
+	void* bits;
+
+	C2D_STATUS r = imxexa_lock_surface(fPtr, fPixmapPtr, &bits);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(0, X_ERROR,
+			"imxexa_promote_pixmap failed to lock GPU surface (code: 0x%08x)\n", r);
+
+		imxexa_free_c2d_surface(fPtr, fPixmapPtr->surf);
+		imxexa_atlas_release_pixmap(fPtr, fPixmapPtr);
+		imxexa_vidmem_release_pixmap(fPtr, fPixmapPtr);
+		fPixmapPtr->surf = NULL;
+
+		return FALSE;
+	}
+
+	const unsigned row_bytes = (fPixmapPtr->width * fPixmapPtr->bitsPerPixel + 7) / 8;
+	const uint8_t* src = fPixmapPtr->sysPtr;
+	uint8_t* dst = bits;
+	int y;
+
+	for (y = 0; y < fPixmapPtr->height; ++y) {
+
+		memcpy(dst, src, row_bytes);
+
+		src += fPixmapPtr->sysPitchBytes;
+		dst += fPixmapPtr->surfDef.stride;
+	}
+
+	fPixmapPtr->surfPtr = bits;
+
+	free(fPixmapPtr->sysPtr);
+	fPixmapPtr->sysPtr = NULL;
+	fPixmapPtr->sysPitchBytes = 0;
+
+	fPixmapPtr->stamp = fPtr->heartbeat;
+	fPixmapPtr->dirty.x2 = fPixmapPtr->dirty.x1;
+	fPixmapPtr->defined.x2 = fPixmapPtr->defined.x1;
+	imxexa_mark_pixmap_dirty(fPixmapPtr, 0, 0, fPixmapPtr->width, fPixmapPtr->height);
+
+	imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+	/* Pixmap header must not refer to the sysmem storage any more. */
+	pPixmap->devKind = fPixmapPtr->surfDef.stride;
+	pPixmap->devPrivate.ptr = NULL;
+
+	return TRUE;
+}
+
+static Bool
+imxexa_promote_blocking_pixmaps(
+	imxexa_backend_t backend,
+	IMXEXAPtr fPtr,
+	PixmapPtr pPixmap[],
+	unsigned count)
+{
+	/* Sysmem pixmaps blocking ops with pixmaps otherwise fit for acceleration get promoted */
+	/* once hot enough. Returns TRUE if all pixmaps are fit for acceleration thereafter. */
+	unsigned blocking = 0;
+	unsigned present = 0;
+	unsigned i;
+
+	for (i = 0; i < count; ++i) {
+
+		if (NULL == pPixmap[i])
+			continue;
+
+		++present;
+
+		if (!imxexa_can_accelerate_pixmap((IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap[i])))
+			++blocking;
+	}
+
+	if (0 == blocking)
+		return TRUE;
+
+	if (present == blocking)
+		return FALSE;
+
+	for (i = 0; i < count; ++i) {
+
+		if (NULL == pPixmap[i])
+			continue;
+
+		IMXEXAPixmapPtr fPixmapPtr = (IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap[i]);
+
+		if (NULL == fPixmapPtr || imxexa_can_accelerate_pixmap(fPixmapPtr))
+			continue;
+
+		if (IMX_EXA_PROMOTE_HEAT > imxexa_heat_pixmap(fPtr, fPixmapPtr) ||
+			imxexa_migration_held_off(fPtr, fPixmapPtr) ||
+			!imxexa_promote_pixmap(backend, fPtr, pPixmap[i], fPixmapPtr)) {
+
+			continue;
+		}
+
+		imxexa_reset_pixmap_record(fPtr, fPixmapPtr);
+		--blocking;
+
+		++fPtr->numPromotions;
+
+#if IMX_EXA_DEBUG_PROMOTION
+
+		xf86DrvMsg(0, X_INFO,
+			"imxexa_promote_blocking_pixmaps promoted sysmem pixmap %s\n",
+			imxexa_string_from_priv_pixmap(fPixmapPtr));
+#endif
+	}
+
+	return 0 == blocking;
+}
+
+static inline void
+imxexa_update_pixmap_on_failure(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return;
+
+	/* Update pixmap's failure count. */
+	++fPixmapPtr->n_failures;
+
+	/* Is pixmap excepted from demotion? */
+	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp ||
+		PIXMAP_STAMP_PINNED == fPixmapPtr->stamp) {
+
+		return;
+	}
+
+	/* Has pixmap passed a threshold number of failures, and is its */
+	/* ratio of failures to successful uses above another threshold? */
+	if (IMX_EXA_DEMOTE_MIN_FAILURES < fPixmapPtr->n_failures &&
+		fPixmapPtr->n_failures >= IMX_EXA_DEMOTE_FAILURES_PER_USE * fPixmapPtr->n_uses &&
+		!imxexa_migration_held_off(fPtr, fPixmapPtr)) {
+
+#if IMX_EXA_DEBUG_DEMOTION
+
+		xf86DrvMsg(0, X_INFO,
+			"imxexa_update_pixmap_on_failure demoted offscreen pixmap after %u uses, %u failures\n",
+			fPixmapPtr->n_uses, fPixmapPtr->n_failures);
+#endif
+
+		if (imxexa_evict_pixmap(fPtr, fPixmapPtr)) {
+
+			fPixmapPtr->demoted = TRUE;
+			imxexa_reset_pixmap_record(fPtr, fPixmapPtr);
+
+			++fPtr->numDemotions;
+		}
+	}
+}
+
+static inline void
+imxexa_update_pixmap_on_use(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	if (NULL == fPixmapPtr)
+		return;
+
+	/* No need to do anything if pixmap is pinned. */
+	if (PIXMAP_STAMP_PINNED	== fPixmapPtr->stamp)
+		return;
+
+	/* Reference pixmap for the clock hand; ordering is left to eviction time. */
+	fPixmapPtr->referenced = TRUE;
+
+	/* Restamp pixmap. */
+	fPixmapPtr->stamp = fPtr->heartbeat;
+
+	/* Update pixmap's use count. */
+	++fPixmapPtr->n_uses;
+}
+
+static IMXEXAPixmapPtr
+imxexa_alloc_pixmap_rec(
+	IMXEXAPtr fPtr)
+{
+	/* Records are laid out at cache-line strides, so the hot fields share a single line. */
+	const unsigned stride = (sizeof(IMXEXAPixmapRec) + IMXEXA_CACHE_LINE_BYTES - 1) & ~(IMXEXA_CACHE_LINE_BYTES - 1);
+
+	/* Out of free records? Carve a new slab into records; the first line of the slab links slabs. */
+	if (NULL == fPtr->pFreePixRecs) {
+
+		void* slab;
+
+		if (0 != posix_memalign(&slab, IMXEXA_CACHE_LINE_BYTES, IMXEXA_PIXMAP_SLAB_BYTES))
+			FatalError("imxexa_alloc_pixmap_rec failed to allocate %u bytes\n", IMXEXA_PIXMAP_SLAB_BYTES);
+
+		*(void**) slab = fPtr->pPixSlabs;
+		fPtr->pPixSlabs = slab;
+
+		uint8_t* rec = (uint8_t*) slab + IMXEXA_CACHE_LINE_BYTES;
+		uint8_t* const end = (uint8_t*) slab + IMXEXA_PIXMAP_SLAB_BYTES;
+
+		for (; rec + stride <= end; rec += stride) {
+
+			((IMXEXAPixmapPtr) rec)->next = fPtr->pFreePixRecs;
+			fPtr->pFreePixRecs = (IMXEXAPixmapPtr) rec;
+		}
+
+#if IMX_DEBUG_MASTER
+
+		++fPtr->numPixSlabs;
+
+#endif
+	}
+
+	IMXEXAPixmapPtr fPixmapPtr = fPtr->pFreePixRecs;
+	fPtr->pFreePixRecs = fPixmapPtr->next;
+
+	memset(fPixmapPtr, 0, sizeof(IMXEXAPixmapRec));
+
+	return fPixmapPtr;
+}
+
+static inline void
+imxexa_free_pixmap_rec(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Records go back to the free list; slabs live as long as the screen. */
+	fPixmapPtr->next = fPtr->pFreePixRecs;
+	fPtr->pFreePixRecs = fPixmapPtr;
+}
+
+void
+IMX_EXA_GetRec(ScrnInfoPtr pScrn)
+{
+	IMXPtr imxPtr = IMXPTR(pScrn);
+
+	if (NULL != imxPtr->exaDriverPrivate)
+		return;
+
+	imxPtr->exaDriverPrivate = xnfcalloc(1, sizeof(IMXEXARec));
+}
+
+void
+IMX_EXA_FreeRec(ScrnInfoPtr pScrn)
+{
+	IMXPtr imxPtr = IMXPTR(pScrn);
+
+	if (NULL == imxPtr->exaDriverPrivate)
+		return;
+
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Dispose of the slabs of pixmap records. */
+	while (NULL != fPtr->pPixSlabs) {
+
+		void* const slab = fPtr->pPixSlabs;
+
+		fPtr->pPixSlabs = *(void**) slab;
+		free(slab);
+	}
+
+	fPtr->pFreePixRecs = NULL;
+
+	free(imxPtr->exaDriverPrivate);
+	imxPtr->exaDriverPrivate = NULL;
+}
+
+Bool
+IMX_EXA_GetPixmapProperties(
+	PixmapPtr pPixmap,
+	void** pPhysAddr,
+	int* pPitch)
+{
+	/* Initialize values to be returned. */
+	*pPhysAddr = NULL;
+	*pPitch = 0;
+
+	if (NULL == pPixmap)
+		return FALSE;
+
+	/* Access screen info associated with this pixmap. */
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Access driver private data associated with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr =
+		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+
+	/* Reinstate and/or unlock pixmap as needed. */
+	if (NULL == fPixmapPtr || !imxexa_unlock_surface(fPtr, fPixmapPtr))
+		return FALSE;
+
+	/* Is pixmap not in gpumem? It has no physical address. */
+	if (NULL == fPixmapPtr->surf)
+		return FALSE;
+
+	/* Get the physical address of pixmap and its pitch. */
+	*pPhysAddr = fPixmapPtr->surfDef.buffer;
+	*pPitch = fPixmapPtr->surfDef.stride;
+
+	/* Pin pixmap so that data we just submitted stays valid. The pin is a lease */
+	/* the caller must give back via IMX_EXA_UnpinPixmap; pins are counted. */
+	imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+	++fPixmapPtr->pinCount;
+	fPixmapPtr->stamp = PIXMAP_STAMP_PINNED;
+	imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+	return TRUE;
+}
+
+void
+IMX_EXA_UnpinPixmap(
+	PixmapPtr pPixmap)
+{
+	if (NULL == pPixmap)
+		return;
+
+	/* Access screen info associated with this pixmap. */
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Access driver private data associated with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr =
+		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+
+	if (NULL == fPixmapPtr || 0 == fPixmapPtr->pinCount)
+		return;
+
+	/* Was this the last pin? Pixmap becomes subject to eviction again, as if just used. */
+	if (0 != --fPixmapPtr->pinCount)
+		return;
+
+	/* Clients may have written through the physical address during the lease, */
+	/* which a backup from an earlier eviction knows nothing about. */
+	imxexa_mark_pixmap_dirty(fPixmapPtr, 0, 0, fPixmapPtr->width, fPixmapPtr->height);
+
+	imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+	fPixmapPtr->stamp = fPtr->heartbeat;
+	imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+}
+
+static void*
+IMXEXACreatePixmap2(
+	ScreenPtr pScreen,
+	int width, int height,
+	int depth, int usage_hint, int bitsPerPixel,
+	int *pPitch)
+{
+	/* Access screen info associated with this screen. */
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Allocate the private data structure to be stored with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr = imxexa_alloc_pixmap_rec(fPtr);
+
+	/* Initialize pixmap properties passed in. */
+	fPixmapPtr->width = width;
+	fPixmapPtr->height = height;
+	fPixmapPtr->depth = depth;
+	fPixmapPtr->bitsPerPixel = bitsPerPixel;
+	fPixmapPtr->usage = usage_hint;
+	fPixmapPtr->priority = imxexa_priority_from_usage(usage_hint);
+
+	imxexa_register_pixmap_with_driver(fPtr, fPixmapPtr);
+	*pPitch = 0;
+
+#if IMX_EXA_DEBUG_TRACE
+
+	if (IMX_EXA_TRACE_MAGIC_WIDTH == width &&
+		IMX_EXA_TRACE_MAGIC_HEIGHT == height) {
+
+		++trace;
+
+		if (is_tracing())
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO, "tracing on\n");
+		else
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO, "tracing off\n");
+	}
+
+#endif
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"IMXEXACreatePixmap2 called with: %dx%dx%d %dbpp %s (priv rec %p)\n",
+		width, height, depth, bitsPerPixel, imxexa_string_from_pixmap_usage(usage_hint), fPixmapPtr);
+
+#endif
+
+	/* Nothing more to do if width, height or bitsPerPixel is nil. */
+	if (0 >= width || 0 >= height || 0 >= bitsPerPixel)
+		return fPixmapPtr;
+
+	/* Consult the placement policy as to where the pixmap should go. */
+	const imxexa_placement_t placement = NULL != fPtr->gpuContext ?
+		imxexa_place_pixmap(fPtr, width, height, depth, usage_hint) : IMXEXA_PLACEMENT_SYSMEM;
+
+	/* Attempt to allocate from gpumem if placement and bitsPerPixel are eligible. */
+	if (IMXEXA_PLACEMENT_SYSMEM != placement &&
+		imxexa_surf_format_from_bpp(imxPtr->backend, bitsPerPixel, &fPixmapPtr->surfDef.format)) {
+
+		fPixmapPtr->surfDef.width = width;
+		fPixmapPtr->surfDef.height = height;
+
+		C2D_STATUS r;
+
+		/* Small pixmaps get sub-allocated from atlases; those that don't fit go to sysmem. */
+		if (IMXEXA_PLACEMENT_ATLAS == placement) {
+
+			r = imxexa_atlas_alloc_pixmap_surface(fPtr, fPixmapPtr, NULL) ?
+				C2D_STATUS_OK : C2D_STATUS_OUT_OF_MEMORY;
+
+#if IMX_DEBUG_MASTER
+
+			if (C2D_STATUS_OK != r)
+				++fPtr->numAtlasFailures;
+
+#endif
+		}
+		else {
+
+			r = imxexa_alloc_pixmap_surface(fPtr, fPixmapPtr, IMXEXA_PLACEMENT_GPUMEM == placement);
+		}
+
+		if (C2D_STATUS_OK == r) {
+
+			*pPitch = fPixmapPtr->surfDef.stride;
+
+			imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				"IMXEXACreatePixmap2 allocated offscreen pixmap of stride %u - %s\n",
+				fPixmapPtr->surfDef.stride, (fPixmapPtr->surfDef.stride % (32 / 8 * bitsPerPixel) ? "wrong" : "ok"));
+#endif
+		}
+		else
+		if (IMXEXA_PLACEMENT_GPUMEM == placement) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				"IMXEXACreatePixmap2 failed to allocate GPU surface (code: 0x%08x), c2d mem utilization %u\n",
+				r, imxexa_calc_c2d_allocated_mem(fPtr));
+		}
+	}
+
+	if (NULL == fPixmapPtr->surf) {
+
+		/* Allocate heap storage for sysmem pixmap. */
+
+		/* Compute number of pitch bytes for sysmem pixmaps of the specified geometry. */
+		const int sysPitchBytes =
+			imxexa_calc_system_memory_pitch(width, bitsPerPixel);
+
+		/* Allocate contiguous height * sysPitchBytes from heap. */
+		void* const sysPtr = malloc(height * sysPitchBytes);
+
+		if (NULL != sysPtr) {
+
+			fPixmapPtr->sysPtr = sysPtr;
+			fPixmapPtr->sysPitchBytes = sysPitchBytes;
+
+			*pPitch = sysPitchBytes;
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				"IMXEXACreatePixmap2 allocated system-memory pixmap of stride %d\n",
+				sysPitchBytes);
+#endif
+		}
+		else {
+
+			/* Unregister and free the driver private data associated with pixmap. */
+			imxexa_unregister_pixmap_from_driver(fPtr, fPixmapPtr);
+			imxexa_free_pixmap_rec(fPtr, fPixmapPtr);
+
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				"IMXEXACreatePixmap2 failed to allocate system memory; no pixmap allocated\n");
+
+			return NULL;
+		}
+	}
+
+	return fPixmapPtr;
+}
+
+static void
+IMXEXADestroyPixmap(
+	ScreenPtr pScreen,
+	void *driverPriv)
+{
+	if (NULL == pScreen)
+		return;
+
+	if (NULL == driverPriv)
+		return;
+
+	IMXEXAPixmapPtr fPixmapPtr = (IMXEXAPixmapPtr) driverPriv;
+
+	/* Access screen info associated with this screen. */
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Withdraw pixmap from the memory accounting. */
+	imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+	/* Conclude any pending lazy unlocks on this pixmap, but don't reinstate it if evicted. */
+	if (NULL != fPixmapPtr->surfPtr)
+		imxexa_unlock_surface(fPtr, fPixmapPtr);
+
+	/* Is pixmap allocated from offscreen memory? */
+	if (NULL != fPixmapPtr->surf && fPtr->screenSurf != fPixmapPtr->surf) {
+
+		/* Surfaces must not go, or get recycled, while queued draws may still target them. */
+		imxexa_flush_pixmap_draws(fPtr, fPixmapPtr);
+
+		/* Is pixmap using an alias? */
+		if (NULL != fPixmapPtr->alias && fPixmapPtr->surf != fPixmapPtr->alias) {
+
+			const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPixmapPtr->alias);
+
+			if (C2D_STATUS_OK == r) {
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+				xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+					"IMXEXADestroyPixmap freed offscreen pixmap alias (priv rec %p)\n",
+					fPixmapPtr);
+#endif
+			}
+			else {
+
+				xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+					"IMXEXADestroyPixmap failed to free offscreen pixmap alias (priv rec %p) (code: 0x%08x)\n",
+					fPixmapPtr, r);
+			}
+		}
+
+		/* Hand the surface over to the recycling pool, or free it if the pool won't take it. */
+		if (imxexa_surf_pool_release(fPtr, &fPixmapPtr->surfDef, fPixmapPtr->surf, fPixmapPtr->gpuSerial)) {
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				"IMXEXADestroyPixmap recycled offscreen pixmap %dx%dx%d %dbpp (priv rec %p)\n",
+				fPixmapPtr->width,
+				fPixmapPtr->height,
+				fPixmapPtr->depth,
+				fPixmapPtr->bitsPerPixel,
+				fPixmapPtr);
+#endif
+		}
+		else {
+
+			const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPixmapPtr->surf);
+
+			if (C2D_STATUS_OK == r) {
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+				xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+					"IMXEXADestroyPixmap freed offscreen pixmap %dx%dx%d %dbpp (priv rec %p)\n",
+					fPixmapPtr->width,
+					fPixmapPtr->height,
+					fPixmapPtr->depth,
+					fPixmapPtr->bitsPerPixel,
+					fPixmapPtr);
+#endif
+			}
+			else {
+
+				xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+					"IMXEXADestroyPixmap failed to free offscreen pixmap (priv rec %p) (code: 0x%08x)\n",
+					fPixmapPtr, r);
+			}
+		}
+	}
+
+	/* Give the space of the surface back to its atlas; repack the atlas if that leaves it sparse. */
+	if (NULL != fPixmapPtr->atlas) {
+
+		IMXEXAAtlasPtr atlas = imxexa_atlas_release_pixmap(fPtr, fPixmapPtr);
+
+		if (NULL != atlas && imxexa_atlas_is_sparse(atlas))
+			imxexa_atlas_repack(fPtr, atlas);
+	}
+
+	/* Give the space of the surface back to the vidmem heap. */
+	imxexa_vidmem_release_pixmap(fPtr, fPixmapPtr);
+
+	imxexa_drop_packed_backup(fPtr, fPixmapPtr);
+
+	/* Is pixmap allocated in system memory or does pixmap have backing storage? */
+	if (NULL != fPixmapPtr->sysPtr) {
+
+		if (imxPtr->fbstart != fPixmapPtr->sysPtr)
+			free(fPixmapPtr->sysPtr);
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"IMXEXADestroyPixmap freed system-memory pixmap %dx%dx%d %dbpp (priv rec %p)\n",
+			fPixmapPtr->width,
+			fPixmapPtr->height,
+			fPixmapPtr->depth,
+			fPixmapPtr->bitsPerPixel,
+			fPixmapPtr);
+#endif
+
+	}
+
+	/* Unregister pixmap from driver and free the driver private data associated with pixmap. */
+	imxexa_unregister_pixmap_from_driver(fPtr, fPixmapPtr);
+	imxexa_free_pixmap_rec(fPtr, fPixmapPtr);
+}
+
+static Bool
+IMXEXAModifyPixmapHeader(
+	PixmapPtr pPixmap,
+	int width,
+	int height,
+	int depth,
+	int bitsPerPixel,
+	int devKind,
+	pointer pPixData)
+{
+	if (NULL == pPixmap)
+		return FALSE;
+
+	/* Access screen info associated with this pixmap. */
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Access driver private data associated with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr =
+		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"IMXEXAModifyPixmapHeader called with %dx%dx%d %dbpp stride %d pixdata %p (priv rec %p)\n",
+		width, height, depth, bitsPerPixel, devKind, pPixData, fPixmapPtr);
+
+#endif
+
+	/* Refuse to patch pixmaps receiving a custom data ptr of unknown origin. */
+	if (NULL != pPixData && pPixData != imxPtr->fbstart && pPixData != fPixmapPtr->sysPtr) {
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"IMXEXAModifyPixmapHeader detected attempt to patch pixmap with foreign pixdata; bailing out\n");
+#endif
+		return FALSE;
+	}
+
+	/* Is this an attempt to patch the screen pixmap? */
+	if (pPixData == imxPtr->fbstart) {
+
+		if (NULL == fPtr->gpuContext) {
+
+			fPixmapPtr->width = width;
+			fPixmapPtr->height = height;
+
+			fPixmapPtr->sysPitchBytes = devKind;
+			fPixmapPtr->sysPtr = pPixData;
+		}
+		else /* Is pixmap not using the screen surface? */
+		if (fPtr->screenSurf != fPixmapPtr->surf) {
+
+			imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+			/* Does pixmap already have a genuine surface? */
+			if (NULL != fPixmapPtr->surf) {
+
+				imxexa_flush_pixmap_draws(fPtr, fPixmapPtr);
+
+				/* Is pixmap using an alias? */
+				if (NULL != fPixmapPtr->alias && fPixmapPtr->surf != fPixmapPtr->alias) {
+
+					xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+						"IMXEXAModifyPixmapHeader encountered invalid screen pixmap with an alias\n");
+
+					const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPixmapPtr->alias);
+
+					if (C2D_STATUS_OK != r) {
+
+						xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+							"IMXEXAModifyPixmapHeader failed to free invalid screen alias (code: 0x%08x)\n", r);
+					}
+				}
+				else {
+
+					xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+						"IMXEXAModifyPixmapHeader encountered invalid screen pixmap\n");
+				}
+
+				const C2D_STATUS r = imxexa_free_c2d_surface(fPtr, fPixmapPtr->surf);
+
+				if (C2D_STATUS_OK != r) {
+
+					xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+						"IMXEXAModifyPixmapHeader failed to free invalid screen surface (code: 0x%08x)\n", r);
+				}
+
+				imxexa_atlas_release_pixmap(fPtr, fPixmapPtr);
+				imxexa_vidmem_release_pixmap(fPtr, fPixmapPtr);
+			}
+
+			/* Update the surface params of this pixmap from the screen surface. */
+			fPixmapPtr->alias = NULL;
+			fPixmapPtr->surf = fPtr->screenSurf;
+			memcpy(&fPixmapPtr->surfDef, &fPtr->screenSurfDef, sizeof(fPixmapPtr->surfDef));
+
+			fPixmapPtr->width = fPtr->screenSurfDef.width;
+			fPixmapPtr->height = fPtr->screenSurfDef.height;
+
+			imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				"IMXEXAModifyPixmapHeader patched screen pixmap\n");
+#endif
+		}
+	}
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+	/* Try to catch any violations of offscreen pixmap params. For diagnostics. */
+	if (NULL != fPixmapPtr->surf) {
+
+		if (0 < width && width != fPixmapPtr->width) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify width of offscreen pixmap (old: %d, new: %d)\n",
+				fPixmapPtr->width, width);
+		}
+
+		if (0 < height && height != fPixmapPtr->height) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify height of offscreen pixmap (old: %d, new: %d)\n",
+				fPixmapPtr->height, height);
+		}
+
+		if (0 < depth && depth != fPixmapPtr->depth) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify depth of offscreen pixmap (old: %d, new: %d)\n",
+				fPixmapPtr->depth, depth);
+		}
+
+		if (0 < bitsPerPixel && bitsPerPixel != fPixmapPtr->bitsPerPixel) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify bitsPerPixel of offscreen pixmap (old: %d, new: %d)\n",
+				fPixmapPtr->bitsPerPixel, bitsPerPixel);
+		}
+
+		if (0 < devKind && devKind != fPixmapPtr->surfDef.stride) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify stride of offscreen pixmap (old: %d, new: %d)\n",
+				fPixmapPtr->surfDef.stride, devKind);
+		}
+
+		if (NULL != pPixData && pPixData != fPixmapPtr->surfDef.host) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify virtual address of offscreen pixmap (old: %p, new: %p)\n",
+				fPixmapPtr->surfDef.host, pPixData);
+		}
+	}
+	/* Pixmap is not offscreen. */
+	else {
+
+		if (0 < width && width != fPixmapPtr->width) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify width of driver-allocated system-memory pixmap\n");
+		}
+
+		if (0 < height && height != fPixmapPtr->height) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify height of driver-allocated system-memory pixmap\n");
+		}
+
+		if (0 < depth && depth != fPixmapPtr->depth) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify depth of driver-allocated system-memory pixmap\n");
+		}
+
+		if (0 < bitsPerPixel && bitsPerPixel != fPixmapPtr->bitsPerPixel) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify bitsPerPixel of driver-allocated system-memory pixmap\n");
+		}
+
+		if (0 < devKind && devKind != fPixmapPtr->sysPitchBytes) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify stride of driver-allocated system-memory pixmap\n");
+		}
+
+		if (NULL != pPixData && pPixData != fPixmapPtr->sysPtr) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAModifyPixmapHeader attempted to modify address of driver-allocated system-memory pixmap\n");
+		}
+	}
+
+#endif /* IMX_EXA_DEBUG_PIXMAPS */
+
+	/* Update the pixmap header with our info. */
+	pPixmap->drawable.width			= fPixmapPtr->width;
+	pPixmap->drawable.height		= fPixmapPtr->height;
+	pPixmap->drawable.depth			= fPixmapPtr->depth;
+	pPixmap->drawable.bitsPerPixel	= fPixmapPtr->bitsPerPixel;
+
+	if (NULL != fPixmapPtr->surf) {
+
+		pPixmap->devKind = fPixmapPtr->surfDef.stride;
+		pPixmap->devPrivate.ptr = NULL;
+	}
+	else {
+
+		pPixmap->devKind = fPixmapPtr->sysPitchBytes;
+		pPixmap->devPrivate.ptr = fPixmapPtr->sysPtr;
+	}
+
+#if IMX_EXA_DEBUG_PIXMAPS
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"IMXEXAModifyPixmapHeader returned pixmap: %dx%dx%d %dbpp\n",
+		pPixmap->drawable.width,
+		pPixmap->drawable.height,
+		pPixmap->drawable.depth,
+		pPixmap->drawable.bitsPerPixel);
+
+#endif
+
+	return TRUE;
+}
+
+static Bool
+IMXEXAPrepareAccess(
+	PixmapPtr pPixmap,
+	int index)
+{
+	if (NULL == pPixmap)
+		return FALSE;
+
+	/* Access screen info associated with this pixmap. */
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Access driver private data associated with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr =
+		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+
+	if (!imxexa_can_accelerate_pixmap(fPixmapPtr)) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"IMXEXAPrepareAccess called with sysmem pixmap\n");
+		return FALSE;
+	}
+
+	/* Is access for writing? No telling what region will be written, so assume all of it. */
+	if (EXA_PREPARE_DEST == index || EXA_PREPARE_AUX_DEST == index)
+		imxexa_mark_pixmap_dirty(fPixmapPtr, 0, 0, fPixmapPtr->width, fPixmapPtr->height);
+
+	/* Is surface currently evicted? */
+	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
+
+		imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+		const Bool unpacked = imxexa_unpack_backup(fPtr, fPixmapPtr);
+
+		if (unpacked && (EXA_PREPARE_DEST == index || EXA_PREPARE_AUX_DEST == index))
+			imxexa_drop_packed_backup(fPtr, fPixmapPtr);
+
+		imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+		if (!unpacked)
+			return FALSE;
+
+		pPixmap->devKind = fPixmapPtr->sysPitchBytes;
+		pPixmap->devPrivate.ptr = fPixmapPtr->sysPtr;
+
+		return TRUE;
+	}
+
+	/* Is surface already locked? */
+	if (NULL != fPixmapPtr->surfPtr) {
+
+		pPixmap->devKind = fPixmapPtr->surfDef.stride;
+		pPixmap->devPrivate.ptr = fPixmapPtr->surfPtr;
+
+		return TRUE;
+	}
+
+	void* bits;
+
+	/* Access-lock the surface. */
+	const C2D_STATUS r = imxexa_lock_surface(fPtr, fPixmapPtr, &bits);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"IMXEXAPrepareAccess failed to lock GPU surface (code: 0x%08x)\n", r);
+		return FALSE;
+	}
+
+	pPixmap->devKind = fPixmapPtr->surfDef.stride;
+	pPixmap->devPrivate.ptr = bits;
+
+	fPixmapPtr->surfPtr = bits;
+
+#if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
+
+	++fPtr->numAccessBeforeSync;
+
+#endif
+
+	return TRUE;
+}
+
+static void
+IMXEXAFinishAccess(
+	PixmapPtr pPixmap,
+	int index)
+{
+	if (NULL == pPixmap)
+		return;
+
+	/* Access screen info associated with this pixmap. */
+	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Access driver private data associated with pixmap. */
+	IMXEXAPixmapPtr fPixmapPtr =
+		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
 
-		/* Access-lock the surface. */
-		const C2D_STATUS r = c2dSurfLock(fPtr->gpuContext,
-			imxexa_get_preferred_surface(fPixmapPtr), (void**) &ptr_dst);
+	if (!imxexa_can_accelerate_pixmap(fPixmapPtr)) {
 
-		if (C2D_STATUS_OK != r) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"IMXEXAFinishAccess called with sysmem pixmap\n");
+		return;
+	}
 
-			xf86DrvMsg(0, X_ERROR,
-				"imxexa_update_surface_from_backup failed to lock GPU surface (code: 0x%08x)\n", r);
-			return;
-		}
+	/* Is the surface neither locked nor evicted? */
+	if (NULL == fPixmapPtr->surfPtr && PIXMAP_STAMP_EVICTED != fPixmapPtr->stamp) {
 
-		fPixmapPtr->surfPtr = ptr_dst;
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"IMXEXAFinishAccess called with pixmap not being accessed\n");
+		return;
 	}
 
-	int pitch_dst = fPixmapPtr->surfDef.stride;
-	int pitch_src = fPixmapPtr->sysPitchBytes;
+	/* To relieve the GPU pipeline of EXA's enormous access pressure, surface will be unlocked upon */
+	/* first use (lazy unlock). Just notify clients that access to the pixmap content is no more. */
+	pPixmap->devPrivate.ptr = NULL;
 
-	int line_bytes = fPixmapPtr->width * fPixmapPtr->bitsPerPixel / 8;
-	int line_count = fPixmapPtr->height;
+	/* Writes have dropped any compressed backup, so one that is left was only read from. */
+	imxexa_drop_unpacked_backup(fPtr, fPixmapPtr);
+}
 
-	while (0 != line_count--) {
+static inline void
+imxexa_unlock_op_surfaces(
+	IMXEXAPtr fPtr)
+{
+	/* Surfaces of an op get unlocked at its first GPU draw, leaving them to the CPU until then. */
+	imxexa_unlock_surface(fPtr, fPtr->pPixDst);
+	imxexa_unlock_surface(fPtr, fPtr->pPixSrc);
+	imxexa_unlock_surface(fPtr, fPtr->pPixMsk);
 
-		memcpy(ptr_dst, ptr_src, line_bytes);
-		ptr_dst += pitch_dst;
-		ptr_src += pitch_src;
-	}
+	fPtr->opOnGpu = TRUE;
 }
 
 static Bool
-imxexa_update_backup_from_surface(
+imxexa_cpu_is_cheaper(
 	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr)
+	int width,
+	int height,
+	unsigned pixel_cost)
 {
-	if (NULL == fPixmapPtr)
+	/* Once a rect of the op has gone to the GPU, the rest follow to keep them in order. */
+	if (!fPtr->opCpuCapable || fPtr->opOnGpu)
 		return FALSE;
 
-	if (NULL == fPixmapPtr->surf)
+	const unsigned area = width * height;
+
+	if (IMX_EXA_CPU_OP_MAX_AREA < area)
 		return FALSE;
 
-	/* Has surface ever been evicted? */
-	if (NULL == fPixmapPtr->sysPtr) {
+	uint64_t cpu = (uint64_t) area * pixel_cost / 1000;
+	uint64_t gpu = fPtr->costGpuDraw;
 
-		/* Compute number of pitch bytes for sysmem pixmaps of the specified geometry. */
-		const int sysPitchBytes =
-			imxexa_calc_system_memory_pitch(fPixmapPtr->width, fPixmapPtr->bitsPerPixel);
+	const IMXEXAPixmapPtr pix[] = {
+		fPtr->pPixDst,
+		fPtr->pPixSrc,
+		fPtr->pPixMsk
+	};
 
-		/* Allocate contiguous height * sysPitchBytes from heap. */
-		void* const sysPtr = malloc(fPixmapPtr->height * sysPitchBytes);
+	unsigned i;
 
-		if (NULL != sysPtr) {
+	for (i = 0; i < sizeof(pix) / sizeof(pix[0]); ++i) {
 
-			fPixmapPtr->sysPtr = sysPtr;
-			fPixmapPtr->sysPitchBytes = sysPitchBytes;
-		}
-		else {
+		if (NULL == pix[i])
+			continue;
 
-			xf86DrvMsg(0, X_ERROR,
-				"imxexa_update_backup_from_surface failed to allocate backing storage for GPU surface\n");
-			return FALSE;
+		/* A locked surface is idle; the GPU would have to unlock it, the next CPU access lock it again. */
+		if (NULL != pix[i]->surfPtr) {
+
+			gpu += fPtr->costLock;
+			continue;
 		}
+
+		cpu += fPtr->costLock;
+
+		/* Draws on pixmap still outstanding would have to be waited for, draining the queue. */
+		if (pix[i]->gpuSerial > fPtr->retiredSerial)
+			cpu += (uint64_t) fPtr->costGpuDraw * (fPtr->pendingDraws + 1);
 	}
 
-	char* ptr_dst = fPixmapPtr->sysPtr;
-	char* ptr_src = fPixmapPtr->surfPtr;
+	return cpu < gpu;
+}
 
+static inline uint8_t*
+imxexa_map_pixmap(
+	IMXEXAPtr fPtr,
+	IMXEXAPixmapPtr fPixmapPtr)
+{
+	/* Surface stays locked for later CPU access, as after PrepareAccess. */
 	if (NULL == fPixmapPtr->surfPtr) {
 
-		/* Access-lock the surface. */
-		const C2D_STATUS r = c2dSurfLock(fPtr->gpuContext,
-			imxexa_get_preferred_surface(fPixmapPtr), (void**) &ptr_src);
+		void* bits;
 
-		if (C2D_STATUS_OK != r) {
+		if (C2D_STATUS_OK != imxexa_lock_surface(fPtr, fPixmapPtr, &bits))
+			return NULL;
 
-			xf86DrvMsg(0, X_ERROR,
-				"imxexa_update_backup_from_surface failed to lock GPU surface (code: 0x%08x)\n", r);
-			return FALSE;
-		}
+		fPixmapPtr->surfPtr = bits;
+	}
 
-		fPixmapPtr->surfPtr = ptr_src;
+	return fPixmapPtr->surfPtr;
+}
+
+static void
+imxexa_fill_rows(
+	uint8_t* row,
+	int pitch,
+	int width,
+	int height,
+	int bytesPerPixel,
+	Pixel color)
+{
+	int x;
+
+	for (; 0 != height--; row += pitch) {
+
+		switch (bytesPerPixel) {
+		case 1:
+			memset(row, color, width);
+			break;
+		case 2:
+			for (x = 0; x < width; ++x)
+				((uint16_t*) row)[x] = color;
+			break;
+		case 4:
+			for (x = 0; x < width; ++x)
+				((uint32_t*) row)[x] = color;
+			break;
+		default:
+			for (x = 0; x < width * 3; x += 3) {
+
+				row[x + 0] = color;
+				row[x + 1] = color >> 8;
+				row[x + 2] = color >> 16;
+			}
+			break;
+		}
 	}
+}
 
-	int pitch_dst = fPixmapPtr->sysPitchBytes;
-	int pitch_src = fPixmapPtr->surfDef.stride;
+static Bool
+imxexa_cpu_solid(
+	IMXEXAPtr fPtr,
+	int x1, int y1,
+	int x2, int y2)
+{
+	const IMXEXAPixmapPtr fPixmapPtr = fPtr->pPixDst;
+	uint8_t* const bits = imxexa_map_pixmap(fPtr, fPixmapPtr);
 
-	int line_bytes = fPixmapPtr->width * fPixmapPtr->bitsPerPixel / 8;
-	int line_count = fPixmapPtr->height;
+	if (NULL == bits)
+		return FALSE;
 
-	while (0 != line_count--) {
+	const int bytesPerPixel = fPixmapPtr->bitsPerPixel / 8;
+	const int pitch = fPixmapPtr->surfDef.stride;
 
-		memcpy(ptr_dst, ptr_src, line_bytes);
-		ptr_dst += pitch_dst;
-		ptr_src += pitch_src;
-	}
+	imxexa_fill_rows(bits + y1 * pitch + x1 * bytesPerPixel, pitch,
+		x2 - x1, y2 - y1, bytesPerPixel, fPtr->solidColor);
+
+	imxexa_mark_pixmap_dirty(fPixmapPtr, x1, y1, x2, y2);
+
+#if IMX_DEBUG_MASTER
+	++fPtr->numCpuRects;
+#endif
 
 	return TRUE;
 }
 
 static Bool
-imxexa_evict_pixmap(
-	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr);
-
-C2D_STATUS
-imxexa_alloc_c2d_surface(
+imxexa_cpu_copy(
 	IMXEXAPtr fPtr,
-	C2D_SURFACE_DEF* surfDef,
-	C2D_SURFACE* surf)
+	int srcX, int srcY,
+	int dstX, int dstY,
+	int width, int height)
 {
-	C2D_STATUS r = c2dSurfAlloc(fPtr->gpuContext, surf, surfDef);
+	const IMXEXAPixmapPtr fPixmapDstPtr = fPtr->pPixDst;
+	const IMXEXAPixmapPtr fPixmapSrcPtr = fPtr->pPixSrc;
 
-	/* In case of failure due to running out of memory, start evicting from the top eviction candidate. */
-	IMXEXAPixmapPtr p = fPtr->pFirstEvictionCandidate;
+	/* Overlapping rects within a pixmap are left to the GPU. */
+	if (fPixmapDstPtr == fPixmapSrcPtr &&
+		dstX < srcX + width && srcX < dstX + width &&
+		dstY < srcY + height && srcY < dstY + height) {
 
-	for (; NULL != p && C2D_STATUS_OUT_OF_MEMORY == r; p = p->prev) {
+		return FALSE;
+	}
 
-		if (!imxexa_evict_pixmap(fPtr, p))
-			continue;
+	uint8_t* const bitsDst = imxexa_map_pixmap(fPtr, fPixmapDstPtr);
+	uint8_t* const bitsSrc = imxexa_map_pixmap(fPtr, fPixmapSrcPtr);
 
-		r = c2dSurfAlloc(fPtr->gpuContext, surf, surfDef);
-	}
+	if (NULL == bitsDst || NULL == bitsSrc)
+		return FALSE;
 
-	return r;
+	const int bytesPerPixel = fPixmapDstPtr->bitsPerPixel / 8;
+	const int pitchDst = fPixmapDstPtr->surfDef.stride;
+	const int pitchSrc = fPixmapSrcPtr->surfDef.stride;
+
+	imxexa_copy_rows_from_gpumem(
+		(char*) bitsDst + dstY * pitchDst + dstX * bytesPerPixel, pitchDst,
+		(const char*) bitsSrc + srcY * pitchSrc + srcX * bytesPerPixel, pitchSrc,
+		width * bytesPerPixel, height);
+
+	imxexa_mark_pixmap_dirty(fPixmapDstPtr, dstX, dstY, dstX + width, dstY + height);
+
+#if IMX_DEBUG_MASTER
+	++fPtr->numCpuRects;
+#endif
+
+	return TRUE;
 }
 
-static inline Bool
-imxexa_unlock_surface(
+static Bool
+imxexa_cpu_composite_ca(
 	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr)
+	int op,
+	int srcX, int srcY,
+	int mskX, int mskY,
+	int dstX, int dstY,
+	int width, int height)
 {
-	if (NULL == fPixmapPtr)
-		return TRUE;
+	const IMXEXAPixmapPtr fPixmapDstPtr = fPtr->pPixDst;
+	const IMXEXAPixmapPtr fPixmapSrcPtr = fPtr->pPixSrc;
+	const IMXEXAPixmapPtr fPixmapMskPtr = fPtr->pPixMsk;
+
+	/* PrepareComposite has mapped the pixmaps and allocated the cached rows. */
+	uint8_t* const bitsDst = fPixmapDstPtr->surfPtr;
+	uint8_t* const bitsSrc = fPixmapSrcPtr->surfPtr;
+	uint8_t* const bitsMsk = fPixmapMskPtr->surfPtr;
+
+	/* Cached rows are padded to whole words, as pixman takes them. */
+	const int bytesDst = fPixmapDstPtr->bitsPerPixel / 8;
+	const int bytesSrc = fPixmapSrcPtr->bitsPerPixel / 8;
+	const int bytesMsk = fPixmapMskPtr->bitsPerPixel / 8;
+	const int pitchDst = fPixmapDstPtr->surfDef.stride;
+	const int pitchSrc = fPixmapSrcPtr->surfDef.stride;
+	const int pitchMsk = fPixmapMskPtr->surfDef.stride;
+	const int lineDst = (width * bytesDst + 3) & ~3;
+	const int lineSrc = (width * bytesSrc + 3) & ~3;
+	const int lineMsk = (width * bytesMsk + 3) & ~3;
+
+	const int rows = IMX_EXA_CA_CHUNK_BYTES / (width * 4);
+
+	uint8_t* const rowsDst = fPtr->caRows;
+	uint8_t* const rowsSrc = rowsDst + IMX_EXA_CA_CHUNK_BYTES;
+	uint8_t* const rowsMsk = rowsSrc + IMX_EXA_CA_CHUNK_BYTES;
+
+	/* A repeating src, usually the 1x1 of a solid color, gets read in place. */
+	pixman_image_t* imageRepeat = NULL;
+
+	if (RepeatNone != fPtr->composSrcRepeat) {
+
+		imageRepeat = pixman_image_create_bits(
+			(pixman_format_code_t) fPtr->composSrcFormat,
+			fPixmapSrcPtr->width, fPixmapSrcPtr->height, (uint32_t*) bitsSrc, pitchSrc);
+
+		if (NULL == imageRepeat)
+			return FALSE;
 
-	/* Is surface currently evicted? Reinstate it first. */
-	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
+		pixman_image_set_repeat(imageRepeat, (pixman_repeat_t) fPtr->composSrcRepeat);
+	}
 
-		const C2D_COLORFORMAT format = fPixmapPtr->surfDef.format;
-		memset(&fPixmapPtr->surfDef, 0, sizeof(fPixmapPtr->surfDef));
+	Bool success = TRUE;
+	int done, n;
 
-		fPixmapPtr->surfDef.format = format;
-        fPixmapPtr->surfDef.width = fPixmapPtr->width;
-        fPixmapPtr->surfDef.height = fPixmapPtr->height;
+	/* Read chunks of rows out of gpumem in bursts, composite them in cached memory, write them back. */
+	for (done = 0; done < height && success; done += n) {
 
-		const C2D_STATUS r = imxexa_alloc_c2d_surface(fPtr, &fPixmapPtr->surfDef, &fPixmapPtr->surf);
+		n = rows < height - done ? rows : height - done;
 
-		if (C2D_STATUS_OK == r) {
+		imxexa_copy_rows_from_gpumem((char*) rowsDst, lineDst,
+			(const char*) bitsDst + (dstY + done) * pitchDst + dstX * bytesDst, pitchDst,
+			width * bytesDst, n);
 
-			imxexa_update_surface_from_backup(fPtr, fPixmapPtr);
+		imxexa_copy_rows_from_gpumem((char*) rowsMsk, lineMsk,
+			(const char*) bitsMsk + (mskY + done) * pitchMsk + mskX * bytesMsk, pitchMsk,
+			width * bytesMsk, n);
 
-			fPixmapPtr->stamp = 0;
+		if (NULL == imageRepeat) {
+
+			imxexa_copy_rows_from_gpumem((char*) rowsSrc, lineSrc,
+				(const char*) bitsSrc + (srcY + done) * pitchSrc + srcX * bytesSrc, pitchSrc,
+				width * bytesSrc, n);
 		}
-		else {
 
-			xf86DrvMsg(0, X_ERROR,
-				"imxexa_unlock_surface failed to reinstate surface (code: 0x%08x), c2d mem utilization %u\n",
-				r, imxexa_calc_c2d_allocated_mem(fPtr));
+		pixman_image_t* const imageDst = pixman_image_create_bits(
+			(pixman_format_code_t) fPtr->composDstFormat, width, n, (uint32_t*) rowsDst, lineDst);
+		pixman_image_t* const imageMsk = pixman_image_create_bits(
+			(pixman_format_code_t) fPtr->composMskFormat, width, n, (uint32_t*) rowsMsk, lineMsk);
+		pixman_image_t* const imageSrc = NULL != imageRepeat ? pixman_image_ref(imageRepeat) :
+			pixman_image_create_bits(
+				(pixman_format_code_t) fPtr->composSrcFormat, width, n, (uint32_t*) rowsSrc, lineSrc);
 
-			return FALSE;
+		success = NULL != imageDst && NULL != imageMsk && NULL != imageSrc;
+
+		if (success) {
+
+			pixman_image_set_component_alpha(imageMsk, TRUE);
+
+			pixman_image_composite32((pixman_op_t) op, imageSrc, imageMsk, imageDst,
+				NULL != imageRepeat ? srcX : 0, NULL != imageRepeat ? srcY + done : 0,
+				0, 0, 0, 0, width, n);
+
+			const uint8_t* row = rowsDst;
+			uint8_t* out = bitsDst + (dstY + done) * pitchDst + dstX * bytesDst;
+			int i;
+
+			for (i = 0; i < n; ++i, row += lineDst, out += pitchDst)
+				memcpy(out, row, width * bytesDst);
 		}
 
-#if IMX_EXA_DEBUG_EVICTION
+		if (NULL != imageDst)
+			pixman_image_unref(imageDst);
 
-		xf86DrvMsg(0, X_INFO,
-			"imxexa_reinstate_pixmap %s\n",
-			imxexa_string_from_priv_pixmap(fPixmapPtr));
-#endif
+		if (NULL != imageMsk)
+			pixman_image_unref(imageMsk);
 
+		if (NULL != imageSrc)
+			pixman_image_unref(imageSrc);
 	}
 
-	/* Is surface not locked? */
-	if (NULL == fPixmapPtr->surfPtr)
-		return TRUE;
+	if (NULL != imageRepeat)
+		pixman_image_unref(imageRepeat);
 
-	c2dSurfUnlock(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapPtr));
+	imxexa_mark_pixmap_dirty(fPixmapDstPtr, dstX, dstY, dstX + width, dstY + height);
 
-	fPixmapPtr->surfPtr = NULL;
+#if IMX_DEBUG_MASTER
+	++fPtr->numCpuRects;
+	++fPtr->numCpuRectsCA;
+#endif
 
-	return TRUE;
+	return success;
 }
 
-static inline Bool
-imxexa_evict_pixmap(
-	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr)
+static inline uint64_t
+imxexa_elapsed_ns(
+	const struct timespec* t0)
 {
-	if (NULL == fPixmapPtr)
-		return FALSE;
+	struct timespec t1;
 
-	if (PIXMAP_STAMP_PINNED == fPixmapPtr->stamp)
-		return FALSE;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
 
-	/* Is pixmap not in gpumem, or was it not allocated via the standard allocator? */
-	if (NULL == fPixmapPtr->surf || 0 != (C2D_SURFACE_NO_BUFFER_ALLOC & fPixmapPtr->surfDef.flags))
-		return FALSE;
+	return (uint64_t) (t1.tv_sec - t0->tv_sec) * 1000000000U + t1.tv_nsec - t0->tv_nsec;
+}
 
-	/* Is pixmap participating in an ongoing op? */
-	if (fPtr->pPixDst == fPixmapPtr ||
-		fPtr->pPixSrc == fPixmapPtr ||
-		fPtr->pPixMsk == fPixmapPtr) {
+static void
+imxexa_calibrate_cpu_op_costs(
+	ScrnInfoPtr pScrn)
+{
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
-		return FALSE;
-	}
+	C2D_SURFACE_DEF surfDef;
+	C2D_SURFACE surf;
 
-	if (!imxexa_update_backup_from_surface(fPtr, fPixmapPtr))
-		return FALSE;
+	memset(&surfDef, 0, sizeof(surfDef));
 
-	imxexa_unlock_surface(fPtr, fPixmapPtr);
+	surfDef.format = C2D_COLOR_8888;
+	surfDef.width = IMX_EXA_CALIBRATE_WIDTH;
+	surfDef.height = IMX_EXA_CALIBRATE_HEIGHT;
 
-	/* Is pixmap using an alias? */
-	if (NULL != fPixmapPtr->alias && fPixmapPtr->surf != fPixmapPtr->alias) {
+	C2D_STATUS r = c2dSurfAlloc(fPtr->gpuContext, &surf, &surfDef);
 
-		const C2D_STATUS r = c2dSurfFree(fPtr->gpuContext, fPixmapPtr->alias);
+	if (C2D_STATUS_OK != r) {
 
-		if (C2D_STATUS_OK != r) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			"Unable to calibrate costs of small ops (code: 0x%08x), using defaults\n", r);
+		return;
+	}
 
-			xf86DrvMsg(0, X_ERROR,
-				"imxexa_evict_pixmap failed to free pixmap alias (priv rec %p) (code: 0x%08x)\n",
-				fPixmapPtr, r);
+	struct timespec t0;
+	void* bits;
+	unsigned i;
 
-			return FALSE;
-		}
-	}
+	/* Time a batch worth of single-pixel GPU fills, flushed and waited for. */
+	imxexa_finish_gpu(fPtr);
 
-	const C2D_STATUS r = c2dSurfFree(fPtr->gpuContext, fPixmapPtr->surf);
+	C2D_RECT rect = {
+		0, 0, 1, 1
+	};
 
-	if (C2D_STATUS_OK != r) {
+	imxexa_set_dst_surface(fPtr, surf);
+	imxexa_set_src_surface(fPtr, NULL);
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
+	imxexa_set_blend_mode(fPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_plain_sampling(fPtr);
+	imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
+	c2dSetFgColor(fPtr->gpuContext, 0);
+	c2dSetDstRectangle(fPtr->gpuContext, &rect);
 
-		xf86DrvMsg(0, X_ERROR,
-			"imxexa_evict_pixmap failed to free surface (priv rec %p) (code: 0x%08x)\n",
-			fPixmapPtr, r);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 
-		return FALSE;
-	}
+	for (i = 0; i < IMX_EXA_FLUSH_MAX_PENDING_DRAWS; ++i)
+		c2dDrawRect(fPtr->gpuContext, C2D_PARAM_FILL_BIT);
 
-	fPixmapPtr->alias = NULL;
-	fPixmapPtr->surf = NULL;
-	fPixmapPtr->stamp = PIXMAP_STAMP_EVICTED;
+	c2dFlush(fPtr->gpuContext);
+	c2dFinish(fPtr->gpuContext);
 
-#if IMX_EXA_DEBUG_EVICTION
+	const uint64_t draw_ns = imxexa_elapsed_ns(&t0) / IMX_EXA_FLUSH_MAX_PENDING_DRAWS;
 
-	xf86DrvMsg(0, X_INFO,
-		"imxexa_evict_pixmap %s\n",
-		imxexa_string_from_priv_pixmap(fPixmapPtr));
-#endif
+	/* Time lock and unlock pairs. */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 
-	return TRUE;
-}
+	for (i = 0; i < IMX_EXA_CALIBRATE_REPEATS; ++i) {
 
-static inline void
-imxexa_update_pixmap_on_failure(
-	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr)
-{
-	if (NULL == fPixmapPtr)
-		return;
+		c2dSurfLock(fPtr->gpuContext, surf, &bits);
+		c2dSurfUnlock(fPtr->gpuContext, surf);
+	}
 
-	/* Update pixmap's failure count. */
-	++fPixmapPtr->n_failures;
+	const uint64_t lock_ns = imxexa_elapsed_ns(&t0) / IMX_EXA_CALIBRATE_REPEATS;
 
-	/* Is pixmap excepted from demotion? */
-	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp ||
-		PIXMAP_STAMP_PINNED == fPixmapPtr->stamp) {
+	/* Time CPU fills of the entire surface, and copies of its top half to its bottom half. */
+	r = c2dSurfLock(fPtr->gpuContext, surf, &bits);
 
-		return;
-	}
+	if (C2D_STATUS_OK == r) {
 
-#if 0
-	/* Has pixmap passed a threshold number of failures, and is its */
-	/* ratio of successful uses to failures below another threshold? */
-	if (4 < fPixmapPtr->n_failures &&
-		2 * fPixmapPtr->n_failures >= 5 * fPixmapPtr->n_uses) {
+		const unsigned pixels = IMX_EXA_CALIBRATE_WIDTH * IMX_EXA_CALIBRATE_HEIGHT;
+		const int half = IMX_EXA_CALIBRATE_HEIGHT / 2;
 
-#if IMX_EXA_DEBUG_DEMOTION
+		clock_gettime(CLOCK_MONOTONIC, &t0);
 
-		xf86DrvMsg(0, X_INFO,
-			"imxexa_update_pixmap_on_failure demoted offscreen pixmap after %u uses, %u failures\n",
-			fPixmapPtr->n_uses, fPixmapPtr->n_failures);
-#endif
+		for (i = 0; i < IMX_EXA_CALIBRATE_REPEATS; ++i)
+			imxexa_fill_rows(bits, surfDef.stride, IMX_EXA_CALIBRATE_WIDTH, IMX_EXA_CALIBRATE_HEIGHT, 4, i);
 
-		imxexa_evict_pixmap(fPtr, fPixmapPtr);
-	}
-#endif
-}
+		const uint64_t fill_ps = imxexa_elapsed_ns(&t0) * 1000 / (IMX_EXA_CALIBRATE_REPEATS * pixels);
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+
+		for (i = 0; i < IMX_EXA_CALIBRATE_REPEATS; ++i) {
 
-static inline void
-imxexa_update_pixmap_on_use(
-	IMXEXAPtr fPtr,
-	IMXEXAPixmapPtr fPixmapPtr)
-{
-	if (NULL == fPixmapPtr)
-		return;
+			imxexa_copy_rows_from_gpumem((char*) bits + half * surfDef.stride, surfDef.stride,
+				bits, surfDef.stride, IMX_EXA_CALIBRATE_WIDTH * 4, half);
+		}
 
-	/* No need to do anything if pixmap is pinned. */
-	if (PIXMAP_STAMP_PINNED	== fPixmapPtr->stamp)
-		return;
+		const uint64_t copy_ps = imxexa_elapsed_ns(&t0) * 1000 / (IMX_EXA_CALIBRATE_REPEATS * pixels / 2);
 
-	/* Make pixmap last candidate for eviction. Re-registering the */
-	/* pixmap sends it to the tail of the eviction-candidates list. */
-	imxexa_unregister_pixmap_from_driver(fPtr, fPixmapPtr);
-	imxexa_register_pixmap_with_driver(fPtr, fPixmapPtr);
+		c2dSurfUnlock(fPtr->gpuContext, surf);
 
-	/* Restamp pixmap. */
-	fPixmapPtr->stamp = fPtr->heartbeat;
+		fPtr->costGpuDraw = draw_ns ? draw_ns : 1;
+		fPtr->costLock = lock_ns ? lock_ns : 1;
+		fPtr->costCpuFill = fill_ps ? fill_ps : 1;
+		fPtr->costCpuCopy = copy_ps ? copy_ps : 1;
+	}
+	else {
 
-	/* Update pixmap's use count. */
-	++fPixmapPtr->n_uses;
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			"Unable to calibrate costs of small ops (code: 0x%08x), using defaults\n", r);
+	}
+
+	imxexa_free_c2d_surface(fPtr, surf);
 }
 
-void
-IMX_EXA_GetRec(ScrnInfoPtr pScrn)
+/* C2D raster ops equivalent to the X ones, by alu; the fill color is the source at solids. */
+static const unsigned imxexa_rop4_from_alu[16] = {
+	0x0000,	/* GXclear */
+	0x8888,	/* GXand */
+	0x4444,	/* GXandReverse */
+	0xcccc,	/* GXcopy */
+	0x2222,	/* GXandInverted */
+	0xaaaa,	/* GXnoop */
+	0x6666,	/* GXxor */
+	0xeeee,	/* GXor */
+	0x1111,	/* GXnor */
+	0x9999,	/* GXequiv */
+	0x5555,	/* GXinvert */
+	0xdddd,	/* GXorReverse */
+	0x3333,	/* GXcopyInverted */
+	0xbbbb,	/* GXorInverted */
+	0x7777,	/* GXnand */
+	0xffff	/* GXset */
+};
+
+/* X raster ops taken on by each backend for Solid and Copy, as masks by 1 << alu. Solids fold */
+/* GXclear, GXcopyInverted and GXset into a GXcopy of the adjusted color beforehand. */
+static const struct {
+	unsigned solid;
+	unsigned copy;
+} imxexa_alu_caps[] = {
+	[IMXEXA_BACKEND_NONE] = {
+		.solid = 0,
+		.copy = 0
+	},
+	[IMXEXA_BACKEND_Z160] = {
+		.solid = 1U << GXcopy,
+		.copy = 1U << GXcopy
+	},
+	[IMXEXA_BACKEND_Z430] = {
+		.solid = 0xffff & ~(1U << GXclear | 1U << GXcopyInverted | 1U << GXset),
+		.copy = 0xffff
+	}
+};
+
+/* Result of alu on the src and dst bits, as fb computes it. */
+static inline CARD32
+imxexa_apply_alu(
+	int alu,
+	CARD32 src,
+	CARD32 dst)
 {
-	IMXPtr imxPtr = IMXPTR(pScrn);
+	CARD32 r = 0;
 
-	if (NULL != imxPtr->exaDriverPrivate)
-		return;
+	if (alu & 1)
+		r |= src & dst;
+	if (alu & 2)
+		r |= src & ~dst;
+	if (alu & 4)
+		r |= ~src & dst;
+	if (alu & 8)
+		r |= ~src & ~dst;
 
-	imxPtr->exaDriverPrivate = xnfcalloc(1, sizeof(IMXEXARec));
+	return r;
 }
 
-void
-IMX_EXA_FreeRec(ScrnInfoPtr pScrn)
+/* Bits of a pixel of bitsPerPixel bits, as fb masks fill values and planemasks. */
+static inline Pixel
+imxexa_pixel_bits(
+	int bitsPerPixel)
 {
-	IMXPtr imxPtr = IMXPTR(pScrn);
+	return 32 <= bitsPerPixel ? (Pixel) 0xffffffffU : ((Pixel) 1 << bitsPerPixel) - 1;
+}
 
-	if (NULL == imxPtr->exaDriverPrivate)
-		return;
+/* Alu taking the dst of a copy as its source and the src as its destination, yielding */
+/* alu(src, dst) ^ dst; that is the change the copy makes to dst. */
+static inline int
+imxexa_masked_copy_alu(
+	int alu)
+{
+	/* Evaluated on source 0x3 and destination 0x5, a function of two bits yields its X alu. */
+	const CARD32 dst = 0x3;	/* source of the resulting alu */
+	const CARD32 src = 0x5;	/* destination of the resulting alu */
 
-	free(imxPtr->exaDriverPrivate);
-	imxPtr->exaDriverPrivate = NULL;
+	return (imxexa_apply_alu(alu, src, dst) ^ dst) & 0xf;
 }
 
-Bool
-IMX_EXA_GetPixmapProperties(
-	PixmapPtr pPixmap,
-	void** pPhysAddr,
-	int* pPitch)
+static C2D_STATUS
+imxexa_alloc_check_surfaces(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE* dstSurf,
+	C2D_SURFACE* srcSurf)
 {
-	/* Initialize values to be returned. */
-	*pPhysAddr = NULL;
-	*pPitch = 0;
-
-	if (NULL == pPixmap)
-		return FALSE;
+	C2D_SURFACE_DEF surfDef;
 
-	/* Access screen info associated with this pixmap. */
-	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+	memset(&surfDef, 0, sizeof(surfDef));
 
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	surfDef.format = C2D_COLOR_8888;
+	surfDef.width = IMX_EXA_ROP_CHECK_WIDTH;
+	surfDef.height = 1;
 
-	/* Access driver private data associated with pixmap. */
-	IMXEXAPixmapPtr fPixmapPtr =
-		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+	C2D_STATUS r = c2dSurfAlloc(fPtr->gpuContext, dstSurf, &surfDef);
 
-	/* Reinstate and/or unlock pixmap as needed. */
-	if (!imxexa_unlock_surface(fPtr, fPixmapPtr))
-		return FALSE;
+	if (C2D_STATUS_OK == r) {
 
-	/* Get the physical address of pixmap and its pitch. */
-	*pPhysAddr = fPixmapPtr->surfDef.buffer;
-	*pPitch = fPixmapPtr->surfDef.stride;
+		r = c2dSurfAlloc(fPtr->gpuContext, srcSurf, &surfDef);
 
-	/* Pin pixmap for the rest of its life, so that data we just submitted stays valid. */
-	fPixmapPtr->stamp = PIXMAP_STAMP_PINNED;
+		if (C2D_STATUS_OK != r)
+			imxexa_free_c2d_surface(fPtr, *dstSurf);
+	}
 
-	return TRUE;
+	return r;
 }
 
-static void*
-IMXEXACreatePixmap2(
-	ScreenPtr pScreen,
-	int width, int height,
-	int depth, int usage_hint, int bitsPerPixel,
-	int *pPitch)
+static Bool
+imxexa_write_check_row(
+	IMXEXAPtr fPtr,
+	C2D_SURFACE surf,
+	const CARD32* pixels)
 {
-	/* Access screen info associated with this screen. */
-	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	void* bits;
 
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	if (C2D_STATUS_OK != c2dSurfLock(fPtr->gpuContext, surf, &bits))
+		return FALSE;
 
-	/* Allocate the private data structure to be stored with pixmap. */
-	IMXEXAPixmapPtr fPixmapPtr =
-		(IMXEXAPixmapPtr) xnfcalloc(1, sizeof(IMXEXAPixmapRec));
+	memcpy(bits, pixels, IMX_EXA_ROP_CHECK_WIDTH * sizeof(CARD32));
+	c2dSurfUnlock(fPtr->gpuContext, surf);
 
-	/* Initialize pixmap properties passed in. */
-	fPixmapPtr->width = width;
-	fPixmapPtr->height = height;
-	fPixmapPtr->depth = depth;
-	fPixmapPtr->bitsPerPixel = bitsPerPixel;
+	return TRUE;
+}
 
-	imxexa_register_pixmap_with_driver(fPtr, fPixmapPtr);
-	*pPitch = 0;
+static Bool
+imxexa_check_rop(
+	IMXEXAPtr fPtr,
+	int alu,
+	C2D_SURFACE dstSurf,
+	C2D_SURFACE srcSurf,
+	CARD32 fg)
+{
+	CARD32 src[IMX_EXA_ROP_CHECK_WIDTH];
+	CARD32 dst[IMX_EXA_ROP_CHECK_WIDTH];
+	void* bits;
+	int i;
 
-#if IMX_EXA_DEBUG_TRACE
+	/* Vary the patterns across pixels, each pixel having all four pairs of src and dst bits. */
+	for (i = 0; i < IMX_EXA_ROP_CHECK_WIDTH; ++i) {
 
-	if (IMX_EXA_TRACE_MAGIC_WIDTH == width &&
-		IMX_EXA_TRACE_MAGIC_HEIGHT == height) {
+		src[i] = NULL == srcSurf ? fg : 0xccccccccU ^ i * 0x01010101U;
+		dst[i] = 0xaaaaaaaaU ^ i * 0x10101010U;
+	}
 
-		++trace;
+	if (!imxexa_write_check_row(fPtr, dstSurf, dst) ||
+		(NULL != srcSurf && !imxexa_write_check_row(fPtr, srcSurf, src))) {
 
-		if (is_tracing())
-			xf86DrvMsg(pScrn->scrnIndex, X_INFO, "tracing on\n");
-		else
-			xf86DrvMsg(pScrn->scrnIndex, X_INFO, "tracing off\n");
+		return FALSE;
 	}
 
-#endif
+	C2D_RECT rect = {
+		0, 0, IMX_EXA_ROP_CHECK_WIDTH, 1
+	};
 
-#if IMX_EXA_DEBUG_PIXMAPS
+	imxexa_set_dst_surface(fPtr, dstSurf);
+	imxexa_set_src_surface(fPtr, srcSurf);
+	imxexa_set_rop(fPtr, imxexa_rop4_from_alu[alu]);
+	c2dSetFgColor(fPtr->gpuContext, fg);
+	c2dSetDstRectangle(fPtr->gpuContext, &rect);
+	c2dSetSrcRectangle(fPtr->gpuContext, &rect);
 
-	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-		"IMXEXACreatePixmap2 called with: %dx%dx%d %dbpp %s (priv rec %p)\n",
-		width, height, depth, bitsPerPixel, imxexa_string_from_pixmap_usage(usage_hint), fPixmapPtr);
+	C2D_STATUS r = NULL == srcSurf ?
+		c2dDrawRect(fPtr->gpuContext, C2D_PARAM_FILL_BIT) : c2dDrawBlit(fPtr->gpuContext);
 
-#endif
+	c2dFlush(fPtr->gpuContext);
+	c2dFinish(fPtr->gpuContext);
 
-	/* Nothing more to do if width, height or bitsPerPixel is nil. */
-	if (0 >= width || 0 >= height || 0 >= bitsPerPixel)
-		return fPixmapPtr;
+	if (C2D_STATUS_OK != r || C2D_STATUS_OK != c2dSurfLock(fPtr->gpuContext, dstSurf, &bits))
+		return FALSE;
 
-	/* Attempt to allocate from gpumem if surface geometry and bitsPerPixel are eligible. */
-	if (NULL != fPtr->gpuContext &&
-		IMX_EXA_MAX_SURF_DIM >= width && IMX_EXA_MAX_SURF_DIM >= height &&
-		IMX_EXA_MIN_SURF_AREA <= (width * height) && IMX_EXA_MIN_SURF_HEIGHT <= height &&
-		imxexa_surf_format_from_bpp(imxPtr->backend, bitsPerPixel, &fPixmapPtr->surfDef.format)) {
+	Bool match = TRUE;
 
-		fPixmapPtr->surfDef.width = width;
-		fPixmapPtr->surfDef.height = height;
+	for (i = 0; i < IMX_EXA_ROP_CHECK_WIDTH && match; ++i)
+		match = imxexa_apply_alu(alu, src[i], dst[i]) == ((const CARD32*) bits)[i];
 
-		const C2D_STATUS r = imxexa_alloc_c2d_surface(fPtr, &fPixmapPtr->surfDef, &fPixmapPtr->surf);
+	c2dSurfUnlock(fPtr->gpuContext, dstSurf);
 
-		if (C2D_STATUS_OK == r) {
+	return match;
+}
 
-			*pPitch = fPixmapPtr->surfDef.stride;
+static void
+imxexa_check_rops(
+	ScrnInfoPtr pScrn)
+{
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
-#if IMX_EXA_DEBUG_PIXMAPS
+	C2D_SURFACE dstSurf;
+	C2D_SURFACE srcSurf;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-				"IMXEXACreatePixmap2 allocated offscreen pixmap of stride %u - %s\n",
-				fPixmapPtr->surfDef.stride, (fPixmapPtr->surfDef.stride % (32 / 8 * bitsPerPixel) ? "wrong" : "ok"));
+	const C2D_STATUS r = imxexa_alloc_check_surfaces(fPtr, &dstSurf, &srcSurf);
 
-			const uint32_t gpumem = imxexa_calc_c2d_allocated_mem(fPtr);
+	if (C2D_STATUS_OK != r) {
 
-			if (gpumem > fPtr->gpumem_watermark)
-				fPtr->gpumem_watermark = gpumem;
-#endif
-		}
-		else {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			"Unable to check raster ops (code: 0x%08x), accelerating GXcopy only\n", r);
 
-			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
-				"IMXEXACreatePixmap2 failed to allocate GPU surface (code: 0x%08x), c2d mem utilization %u\n",
-				r, imxexa_calc_c2d_allocated_mem(fPtr));
-		}
+		fPtr->solidAlus &= 1U << GXcopy;
+		fPtr->copyAlus &= 1U << GXcopy;
+		return;
 	}
 
-	if (NULL == fPixmapPtr->surf) {
-
-		/* Allocate heap storage for sysmem pixmap. */
+	/* Compare the results of each raster op taken on against those of fb; drop mismatching ones. */
+	/* GXcopy is what all other ops are built on, and stays regardless. */
+	imxexa_finish_gpu(fPtr);
 
-		/* Compute number of pitch bytes for sysmem pixmaps of the specified geometry. */
-		const int sysPitchBytes =
-			imxexa_calc_system_memory_pitch(width, bitsPerPixel);
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
+	imxexa_set_blend_mode(fPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_plain_sampling(fPtr);
 
-		/* Allocate contiguous height * sysPitchBytes from heap. */
-		void* const sysPtr = malloc(height * sysPitchBytes);
+	int alu;
 
-		if (NULL != sysPtr) {
+	for (alu = 0; alu < 16; ++alu) {
 
-			fPixmapPtr->sysPtr = sysPtr;
-			fPixmapPtr->sysPitchBytes = sysPitchBytes;
+		if (GXcopy == alu)
+			continue;
 
-			*pPitch = sysPitchBytes;
+		if (0 != (fPtr->solidAlus & 1U << alu) &&
+			!imxexa_check_rop(fPtr, alu, dstSurf, NULL, 0xccccccccU)) {
 
-#if IMX_EXA_DEBUG_PIXMAPS
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				"GPU result of raster op 0x%x at solids differs from fb, not accelerating it\n", alu);
 
-			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-				"IMXEXACreatePixmap2 allocated system-memory pixmap of stride %d\n",
-				sysPitchBytes);
-#endif
+			fPtr->solidAlus &= ~(1U << alu);
 		}
-		else {
 
-			/* Unregister and free the driver private data associated with pixmap. */
-			imxexa_unregister_pixmap_from_driver(fPtr, fPixmapPtr);
-			free(fPixmapPtr);
+		if (0 != (fPtr->copyAlus & 1U << alu) &&
+			!imxexa_check_rop(fPtr, alu, dstSurf, srcSurf, 0)) {
 
 			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
-				"IMXEXACreatePixmap2 failed to allocate system memory; no pixmap allocated\n");
+				"GPU result of raster op 0x%x at copies differs from fb, not accelerating it\n", alu);
 
-			return NULL;
+			fPtr->copyAlus &= ~(1U << alu);
 		}
 	}
 
-	return fPixmapPtr;
+	imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
+
+	imxexa_free_c2d_surface(fPtr, srcSurf);
+	imxexa_free_c2d_surface(fPtr, dstSurf);
 }
 
-static void
-IMXEXADestroyPixmap(
-	ScreenPtr pScreen,
-	void *driverPriv)
+static inline C2D_STATUS
+imxexa_blit_pass(
+	IMXEXAPtr fPtr,
+	int dstX, int dstY,
+	int srcX, int srcY,
+	int width, int height)
 {
-	if (NULL == pScreen)
-		return;
-
-	if (NULL == driverPriv)
-		return;
+	C2D_RECT rectDst = {
+		.x = dstX,
+		.y = dstY,
+		.width = width,
+		.height = height
+	};
 
-	IMXEXAPixmapPtr fPixmapPtr = (IMXEXAPixmapPtr) driverPriv;
+	C2D_RECT rectSrc = {
+		.x = srcX,
+		.y = srcY,
+		.width = width,
+		.height = height
+	};
 
-	/* Access screen info associated with this screen. */
-	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	c2dSetDstRectangle(fPtr->gpuContext, &rectDst);
+	c2dSetSrcRectangle(fPtr->gpuContext, &rectSrc);
 
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	const C2D_STATUS r = c2dDrawBlit(fPtr->gpuContext);
 
-	/* Conclude any pending lazy unlocks on this pixmap, but don't reinstate it if evicted. */
-	if (NULL != fPixmapPtr->surfPtr)
-		imxexa_unlock_surface(fPtr, fPixmapPtr);
+	if (C2D_STATUS_OK == r)
+		imxexa_queue_draw(fPtr);
 
-	/* Is pixmap allocated from offscreen memory? */
-	if (NULL != fPixmapPtr->surf && fPtr->screenSurf != fPixmapPtr->surf) {
+	return r;
+}
 
-		/* Is pixmap using an alias? */
-		if (NULL != fPixmapPtr->alias && fPixmapPtr->surf != fPixmapPtr->alias) {
+static inline C2D_STATUS
+imxexa_fill_pass(
+	IMXEXAPtr fPtr,
+	int dstX, int dstY,
+	int width, int height)
+{
+	C2D_RECT rectDst = {
+		.x = dstX,
+		.y = dstY,
+		.width = width,
+		.height = height
+	};
 
-			const C2D_STATUS r = c2dSurfFree(fPtr->gpuContext, fPixmapPtr->alias);
+	c2dSetDstRectangle(fPtr->gpuContext, &rectDst);
 
-			if (C2D_STATUS_OK == r) {
+	const C2D_STATUS r = c2dDrawRect(fPtr->gpuContext, C2D_PARAM_FILL_BIT);
 
-#if IMX_EXA_DEBUG_PIXMAPS
+	if (C2D_STATUS_OK == r)
+		imxexa_queue_draw(fPtr);
 
-				xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-					"IMXEXADestroyPixmap freed offscreen pixmap alias (priv rec %p)\n",
-					fPixmapPtr);
-#endif
-			}
-			else {
+	return r;
+}
 
-				xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-					"IMXEXADestroyPixmap failed to free offscreen pixmap alias (priv rec %p) (code: 0x%08x)\n",
-					fPixmapPtr, r);
-			}
-		}
+static Bool
+imxexa_acquire_scratch_surface(
+	IMXEXAPtr fPtr,
+	C2D_COLORFORMAT format,
+	int width,
+	int height)
+{
+	C2D_SURFACE_DEF* const surfDef = &fPtr->scratchSurfDef;
 
-		const C2D_STATUS r = c2dSurfFree(fPtr->gpuContext, fPixmapPtr->surf);
+	if (NULL != fPtr->scratchSurf && format == surfDef->format &&
+		width <= (int) surfDef->width && height <= (int) surfDef->height) {
 
-		if (C2D_STATUS_OK == r) {
+		return TRUE;
+	}
 
-#if IMX_EXA_DEBUG_PIXMAPS
+	/* Replace the scratch surface, once draws still queued are done reading it. */
+	if (NULL != fPtr->scratchSurf) {
 
-			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-				"IMXEXADestroyPixmap freed offscreen pixmap %dx%dx%d %dbpp (priv rec %p)\n",
-				fPixmapPtr->width,
-				fPixmapPtr->height,
-				fPixmapPtr->depth,
-				fPixmapPtr->bitsPerPixel,
-				fPixmapPtr);
-#endif
-		}
-		else {
+		imxexa_finish_gpu(fPtr);
+		imxexa_free_c2d_surface(fPtr, fPtr->scratchSurf);
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXADestroyPixmap failed to free offscreen pixmap (priv rec %p) (code: 0x%08x)\n",
-				fPixmapPtr, r);
-		}
+		fPtr->scratchSurf = NULL;
 	}
 
-	/* Is pixmap allocated in system memory or does pixmap have backing storage? */
-	if (NULL != fPixmapPtr->sysPtr) {
-
-		if (imxPtr->fbstart != fPixmapPtr->sysPtr)
-			free(fPixmapPtr->sysPtr);
+	memset(surfDef, 0, sizeof(*surfDef));
 
-#if IMX_EXA_DEBUG_PIXMAPS
+	surfDef->format = format;
+	surfDef->width = width;
+	surfDef->height = height;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-			"IMXEXADestroyPixmap freed system-memory pixmap %dx%dx%d %dbpp (priv rec %p)\n",
-			fPixmapPtr->width,
-			fPixmapPtr->height,
-			fPixmapPtr->depth,
-			fPixmapPtr->bitsPerPixel,
-			fPixmapPtr);
-#endif
+	/* Never evict for it; the pixmaps of the op are in use. */
+	if (C2D_STATUS_OK != imxexa_alloc_c2d_surface_ex(fPtr, surfDef, &fPtr->scratchSurf, FALSE)) {
 
+		fPtr->scratchSurf = NULL;
+		return FALSE;
 	}
 
-	/* Unregister pixmap from driver and free the driver private data associated with pixmap. */
-	imxexa_unregister_pixmap_from_driver(fPtr, fPixmapPtr);
-	free(fPixmapPtr);
+	return TRUE;
 }
 
-static Bool
-IMXEXAModifyPixmapHeader(
-	PixmapPtr pPixmap,
-	int width,
-	int height,
-	int depth,
-	int bitsPerPixel,
-	int devKind,
-	pointer pPixData)
+static C2D_STATUS
+imxexa_blit_bounced(
+	IMXEXAPtr fPtr,
+	const BoxRec* dst,
+	int srcX, int srcY,
+	int rows)
 {
-	if (NULL == pPixmap)
-		return FALSE;
+	const IMXEXAPixmapPtr fPixmapPtr = fPtr->pPixDst;
+	const int width = dst->x2 - dst->x1;
+	const int height = dst->y2 - dst->y1;
+	const int dy = dst->y1 - srcY;
+	const unsigned rop = fPtr->ctxState.rop;
 
-	/* Access screen info associated with this pixmap. */
-	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+	C2D_STATUS r = C2D_STATUS_OK;
+	int done, n;
 
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	/* Bounce chunks of rows out to the scratch surface and back, through the genuine surface */
+	/* of the pixmap so that no format conversion applies. Chunks go against the direction */
+	/* of the move, so that none reads rows already written by another. Only the way back */
+	/* applies the raster op of the op. */
+	for (done = 0; done < height && C2D_STATUS_OK == r; done += n) {
 
-	/* Access driver private data associated with pixmap. */
-	IMXEXAPixmapPtr fPixmapPtr =
-		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+		n = rows < height - done ? rows : height - done;
 
-#if IMX_EXA_DEBUG_PIXMAPS
+		const int top = 0 < dy ? height - done - n : done;
 
-	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-		"IMXEXAModifyPixmapHeader called with %dx%dx%d %dbpp stride %d pixdata %p (priv rec %p)\n",
-		width, height, depth, bitsPerPixel, devKind, pPixData, fPixmapPtr);
+		imxexa_set_dst_surface(fPtr, fPtr->scratchSurf);
+		imxexa_set_src_surface(fPtr, fPixmapPtr->surf);
+		imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
 
-#endif
+		r = imxexa_blit_pass(fPtr, 0, 0, srcX, srcY + top, width, n);
 
-	/* Refuse to patch pixmaps receiving a custom data ptr of unknown origin. */
-	if (NULL != pPixData && pPixData != imxPtr->fbstart && pPixData != fPixmapPtr->sysPtr) {
+		if (C2D_STATUS_OK != r)
+			break;
 
-#if IMX_EXA_DEBUG_PIXMAPS
+		imxexa_set_dst_surface(fPtr, fPixmapPtr->surf);
+		imxexa_set_src_surface(fPtr, fPtr->scratchSurf);
+		imxexa_set_rop(fPtr, rop);
 
-		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-			"IMXEXAModifyPixmapHeader detected attempt to patch pixmap with foreign pixdata; bailing out\n");
-#endif
-		return FALSE;
+		r = imxexa_blit_pass(fPtr, dst->x1, dst->y1 + top, 0, 0, width, n);
 	}
 
-	/* Is this an attempt to patch the screen pixmap? */
-	if (pPixData == imxPtr->fbstart) {
+	/* Back to the surfaces of the op. */
+	imxexa_set_dst_surface(fPtr, imxexa_get_preferred_surface(fPixmapPtr));
+	imxexa_set_src_surface(fPtr, imxexa_get_preferred_surface(fPixmapPtr));
 
-		if (NULL == fPtr->gpuContext) {
+#if IMX_DEBUG_MASTER
+	++fPtr->numOverlapBounced;
+#endif
 
-			fPixmapPtr->width = width;
-			fPixmapPtr->height = height;
+	return r;
+}
 
-			fPixmapPtr->sysPitchBytes = devKind;
-			fPixmapPtr->sysPtr = pPixData;
-		}
-		else /* Is pixmap not using the screen surface? */
-		if (fPtr->screenSurf != fPixmapPtr->surf) {
+static C2D_STATUS
+imxexa_blit_rect(
+	IMXEXAPtr fPtr,
+	const BoxRec* dst,
+	int srcX, int srcY)
+{
+	const int width = dst->x2 - dst->x1;
+	const int height = dst->y2 - dst->y1;
+	const int dx = dst->x1 - srcX;
+	const int dy = dst->y1 - srcY;
 
-			/* Does pixmap already have a genuine surface? */
-			if (NULL != fPixmapPtr->surf) {
+	/* Do the rects not overlap? One blit does. */
+	if (fPtr->pPixSrc != fPtr->pPixDst || abs(dx) >= width || abs(dy) >= height)
+		return imxexa_blit_pass(fPtr, dst->x1, dst->y1, srcX, srcY, width, height);
 
-				/* Is pixmap using an alias? */
-				if (NULL != fPixmapPtr->alias && fPixmapPtr->surf != fPixmapPtr->alias) {
+	/* Is nothing moving? */
+	if (0 == dx && 0 == dy)
+		return C2D_STATUS_OK;
 
-					xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
-						"IMXEXAModifyPixmapHeader encountered invalid screen pixmap with an alias\n");
+	/* A blit reading what it writes has an undefined outcome. Either split the move in bands */
+	/* no thicker than the move, each reading rows or columns no band before has written, or */
+	/* bounce it through the scratch surface; whichever takes fewer GPU passes. */
+	const unsigned y_bands = 0 != dy ? (height + abs(dy) - 1) / abs(dy) : -1U;
+	const unsigned x_bands = 0 != dx ? (width + abs(dx) - 1) / abs(dx) : -1U;
+	const unsigned bands = y_bands < x_bands ? y_bands : x_bands;
 
-					const C2D_STATUS r = c2dSurfFree(fPtr->gpuContext, fPixmapPtr->alias);
+	const int line_bytes = width * (fPtr->pPixDst->bitsPerPixel / 8);
+	int rows = 0 != line_bytes ? IMX_EXA_SCRATCH_MAX_BYTES / line_bytes : 0;
 
-					if (C2D_STATUS_OK != r) {
+	if (rows > height)
+		rows = height;
 
-						xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-							"IMXEXAModifyPixmapHeader failed to free invalid screen alias (code: 0x%08x)\n", r);
-					}
-				}
-				else {
+	if (0 != rows && 2 * ((height + rows - 1) / rows) < bands &&
+		imxexa_acquire_scratch_surface(fPtr, fPtr->pPixDst->surfDef.format, width, rows)) {
 
-					xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
-						"IMXEXAModifyPixmapHeader encountered invalid screen pixmap\n");
-				}
+		return imxexa_blit_bounced(fPtr, dst, srcX, srcY, rows);
+	}
 
-				const C2D_STATUS r = c2dSurfFree(fPtr->gpuContext, fPixmapPtr->surf);
+#if IMX_DEBUG_MASTER
+	++fPtr->numOverlapBanded;
+#endif
 
-				if (C2D_STATUS_OK != r) {
+	C2D_STATUS r = C2D_STATUS_OK;
+	int done, n;
 
-					xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-						"IMXEXAModifyPixmapHeader failed to free invalid screen surface (code: 0x%08x)\n", r);
-				}
-			}
+	if (y_bands == bands) {
 
-			/* Update the surface params of this pixmap from the screen surface. */
-			fPixmapPtr->alias = NULL;
-			fPixmapPtr->surf = fPtr->screenSurf;
-			memcpy(&fPixmapPtr->surfDef, &fPtr->screenSurfDef, sizeof(fPixmapPtr->surfDef));
+		const int band = abs(dy);
 
-			fPixmapPtr->width = fPtr->screenSurfDef.width;
-			fPixmapPtr->height = fPtr->screenSurfDef.height;
+		/* Moving down takes the bottom band first, moving up the top one. */
+		for (done = 0; done < height && C2D_STATUS_OK == r; done += n) {
 
-#if IMX_EXA_DEBUG_PIXMAPS
+			n = band < height - done ? band : height - done;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-				"IMXEXAModifyPixmapHeader patched screen pixmap\n");
-#endif
+			const int top = 0 < dy ? height - done - n : done;
+
+			r = imxexa_blit_pass(fPtr, dst->x1, dst->y1 + top, srcX, srcY + top, width, n);
 		}
 	}
+	else {
 
-#if IMX_EXA_DEBUG_PIXMAPS
-
-	/* Try to catch any violations of offscreen pixmap params. For diagnostics. */
-	if (NULL != fPixmapPtr->surf) {
+		const int band = abs(dx);
 
-		if (0 < width && width != fPixmapPtr->width) {
+		/* Moving right takes the rightmost band first, moving left the leftmost one. */
+		for (done = 0; done < width && C2D_STATUS_OK == r; done += n) {
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify width of offscreen pixmap (old: %d, new: %d)\n",
-				fPixmapPtr->width, width);
-		}
+			n = band < width - done ? band : width - done;
 
-		if (0 < height && height != fPixmapPtr->height) {
+			const int left = 0 < dx ? width - done - n : done;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify height of offscreen pixmap (old: %d, new: %d)\n",
-				fPixmapPtr->height, height);
+			r = imxexa_blit_pass(fPtr, dst->x1 + left, dst->y1, srcX + left, srcY, n, height);
 		}
+	}
 
-		if (0 < depth && depth != fPixmapPtr->depth) {
+	return r;
+}
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify depth of offscreen pixmap (old: %d, new: %d)\n",
-				fPixmapPtr->depth, depth);
-		}
+static C2D_STATUS
+imxexa_fill_masked(
+	IMXEXAPtr fPtr,
+	const BoxRec* dst)
+{
+	const int width = dst->x2 - dst->x1;
+	const int height = dst->y2 - dst->y1;
 
-		if (0 < bitsPerPixel && bitsPerPixel != fPixmapPtr->bitsPerPixel) {
+	C2D_STATUS r = C2D_STATUS_OK;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify bitsPerPixel of offscreen pixmap (old: %d, new: %d)\n",
-				fPixmapPtr->bitsPerPixel, bitsPerPixel);
-		}
+	/* Within the planemask, the op comes down to keeping some dst bits and flipping others. */
+	if (imxexa_pixel_bits(fPtr->pPixDst->bitsPerPixel) != fPtr->maskedAnd) {
 
-		if (0 < devKind && devKind != fPixmapPtr->surfDef.stride) {
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[GXand]);
+		c2dSetFgColor(fPtr->gpuContext, fPtr->maskedAnd);
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify stride of offscreen pixmap (old: %d, new: %d)\n",
-				fPixmapPtr->surfDef.stride, devKind);
-		}
+		r = imxexa_fill_pass(fPtr, dst->x1, dst->y1, width, height);
+	}
 
-		if (NULL != pPixData && pPixData != fPixmapPtr->surfDef.host) {
+	if (C2D_STATUS_OK == r && 0 != fPtr->maskedXor) {
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify virtual address of offscreen pixmap (old: %p, new: %p)\n",
-				fPixmapPtr->surfDef.host, pPixData);
-		}
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[GXxor]);
+		c2dSetFgColor(fPtr->gpuContext, fPtr->maskedXor);
+
+		r = imxexa_fill_pass(fPtr, dst->x1, dst->y1, width, height);
 	}
-	/* Pixmap is not offscreen. */
-	else {
 
-		if (0 < width && width != fPixmapPtr->width) {
+	return r;
+}
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify width of driver-allocated system-memory pixmap\n");
-		}
+static C2D_STATUS
+imxexa_blit_masked(
+	IMXEXAPtr fPtr,
+	const BoxRec* dst,
+	int srcX, int srcY)
+{
+	const IMXEXAPixmapPtr fPixmapDstPtr = fPtr->pPixDst;
+	const IMXEXAPixmapPtr fPixmapSrcPtr = fPtr->pPixSrc;
+	const int width = dst->x2 - dst->x1;
+	const int height = dst->y2 - dst->y1;
+	const int dy = dst->y1 - srcY;
 
-		if (0 < height && height != fPixmapPtr->height) {
+	const int line_bytes = width * (fPixmapDstPtr->bitsPerPixel / 8);
+	int rows = 0 != line_bytes ? IMX_EXA_SCRATCH_MAX_BYTES / line_bytes : 0;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify height of driver-allocated system-memory pixmap\n");
-		}
+	if (rows > height)
+		rows = height;
 
-		if (0 < depth && depth != fPixmapPtr->depth) {
+	if (0 == rows || !imxexa_acquire_scratch_surface(fPtr, fPixmapDstPtr->surfDef.format, width, rows))
+		return C2D_STATUS_OUT_OF_MEMORY;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify depth of driver-allocated system-memory pixmap\n");
-		}
+	C2D_STATUS r = C2D_STATUS_OK;
+	int done, n;
 
-		if (0 < bitsPerPixel && bitsPerPixel != fPixmapPtr->bitsPerPixel) {
+	/* Work out the change the op makes to dst in the scratch surface, keep the part within the */
+	/* planemask and apply that to dst. The dst side goes through the genuine surface of the */
+	/* pixmap so that no format conversion applies. Chunks of rows go against the direction of */
+	/* the move, so that none reads rows already written by another. */
+	for (done = 0; done < height && C2D_STATUS_OK == r; done += n) {
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify bitsPerPixel of driver-allocated system-memory pixmap\n");
-		}
+		n = rows < height - done ? rows : height - done;
 
-		if (0 < devKind && devKind != fPixmapPtr->sysPitchBytes) {
+		const int top = 0 < dy ? height - done - n : done;
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify stride of driver-allocated system-memory pixmap\n");
-		}
+		/* scratch = src */
+		imxexa_set_dst_surface(fPtr, fPtr->scratchSurf);
+		imxexa_set_src_surface(fPtr, imxexa_get_preferred_surface(fPixmapSrcPtr));
+		imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
 
-		if (NULL != pPixData && pPixData != fPixmapPtr->sysPtr) {
+		r = imxexa_blit_pass(fPtr, 0, 0, srcX, srcY + top, width, n);
 
-			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-				"IMXEXAModifyPixmapHeader attempted to modify address of driver-allocated system-memory pixmap\n");
-		}
-	}
+		if (C2D_STATUS_OK != r)
+			break;
 
-#endif /* IMX_EXA_DEBUG_PIXMAPS */
+		/* scratch = op(src, dst) ^ dst */
+		imxexa_set_src_surface(fPtr, fPixmapDstPtr->surf);
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[fPtr->maskedAlu]);
 
-	/* Update the pixmap header with our info. */
-	pPixmap->drawable.width			= fPixmapPtr->width;
-	pPixmap->drawable.height		= fPixmapPtr->height;
-	pPixmap->drawable.depth			= fPixmapPtr->depth;
-	pPixmap->drawable.bitsPerPixel	= fPixmapPtr->bitsPerPixel;
+		r = imxexa_blit_pass(fPtr, 0, 0, dst->x1, dst->y1 + top, width, n);
 
-	if (NULL != fPixmapPtr->surf) {
+		if (C2D_STATUS_OK != r)
+			break;
 
-		pPixmap->devKind = fPixmapPtr->surfDef.stride;
-		pPixmap->devPrivate.ptr = NULL;
-	}
-	else {
+		/* scratch &= planemask */
+		imxexa_set_src_surface(fPtr, NULL);
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[GXand]);
+		c2dSetFgColor(fPtr->gpuContext, fPtr->planemask);
 
-		pPixmap->devKind = fPixmapPtr->sysPitchBytes;
-		pPixmap->devPrivate.ptr = fPixmapPtr->sysPtr;
-	}
+		r = imxexa_fill_pass(fPtr, 0, 0, width, n);
 
-#if IMX_EXA_DEBUG_PIXMAPS
+		if (C2D_STATUS_OK != r)
+			break;
 
-	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-		"IMXEXAModifyPixmapHeader returned pixmap: %dx%dx%d %dbpp\n",
-		pPixmap->drawable.width,
-		pPixmap->drawable.height,
-		pPixmap->drawable.depth,
-		pPixmap->drawable.bitsPerPixel);
+		/* dst ^= scratch */
+		imxexa_set_dst_surface(fPtr, fPixmapDstPtr->surf);
+		imxexa_set_src_surface(fPtr, fPtr->scratchSurf);
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[GXxor]);
 
-#endif
+		r = imxexa_blit_pass(fPtr, dst->x1, dst->y1 + top, 0, 0, width, n);
+	}
 
-	return TRUE;
+	/* Back to the surfaces of the op. */
+	imxexa_set_dst_surface(fPtr, imxexa_get_preferred_surface(fPixmapDstPtr));
+	imxexa_set_src_surface(fPtr, imxexa_get_preferred_surface(fPixmapSrcPtr));
+
+	return r;
 }
 
-static Bool
-IMXEXAPrepareAccess(
-	PixmapPtr pPixmap,
-	int index)
+static void
+imxexa_batch_submit(
+	IMXEXAPtr fPtr)
 {
-	if (NULL == pPixmap)
-		return FALSE;
-
-	/* Access screen info associated with this pixmap. */
-	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
-
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+	/* C2D takes one rect per draw; what batching saves is the draws merged away and the */
+	/* per-call overhead of Solid and Copy, which now only append to the batch. */
+	const IMXEXABatchRectRec* b = fPtr->batch;
+	const IMXEXABatchRectRec* const b_end = b + fPtr->batchCount;
 
-	/* Access driver private data associated with pixmap. */
-	IMXEXAPixmapPtr fPixmapPtr =
-		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+	fPtr->batchCount = 0;
 
-	if (!imxexa_can_accelerate_pixmap(fPixmapPtr)) {
+	if (b == b_end)
+		return;
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAPrepareAccess called with sysmem pixmap\n");
-		return FALSE;
-	}
+	imxexa_unlock_op_surfaces(fPtr);
 
-	/* Is surface currently evicted? */
-	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
+#if IMX_DEBUG_MASTER
+	++fPtr->numBatchSubmits;
+#endif
 
-		pPixmap->devKind = fPixmapPtr->sysPitchBytes;
-		pPixmap->devPrivate.ptr = fPixmapPtr->sysPtr;
+	for (; b < b_end; ++b) {
 
-		return TRUE;
-	}
+		C2D_STATUS r;
 
-	/* Is surface already locked? */
-	if (NULL != fPixmapPtr->surfPtr) {
+		if (fPtr->batchBlit) {
 
-		pPixmap->devKind = fPixmapPtr->surfDef.stride;
-		pPixmap->devPrivate.ptr = fPixmapPtr->surfPtr;
+			r = fPtr->opMasked ?
+				imxexa_blit_masked(fPtr, &b->dst, b->srcX, b->srcY) :
+				imxexa_blit_rect(fPtr, &b->dst, b->srcX, b->srcY);
+		}
+		else {
 
-		return TRUE;
-	}
+			r = fPtr->opMasked ?
+				imxexa_fill_masked(fPtr, &b->dst) :
+				imxexa_fill_pass(fPtr, b->dst.x1, b->dst.y1,
+					b->dst.x2 - b->dst.x1, b->dst.y2 - b->dst.y1);
+		}
 
-	void* bits;
+		if (C2D_STATUS_OK != r) {
 
-	/* Access-lock the surface. */
-	const C2D_STATUS r = c2dSurfLock(fPtr->gpuContext,
-		imxexa_get_preferred_surface(fPixmapPtr), &bits);
+			xf86DrvMsg(0, X_ERROR,
+				"imxexa_batch_submit failed to perform GPU %s (code: 0x%08x)\n",
+				fPtr->batchBlit ? "blit" : "fill", r);
+			break;
+		}
 
-	if (C2D_STATUS_OK != r) {
+		imxexa_mark_pixmap_dirty(fPtr->pPixDst, b->dst.x1, b->dst.y1, b->dst.x2, b->dst.y2);
+	}
+}
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAPrepareAccess failed to lock GPU surface (code: 0x%08x)\n", r);
+static inline Bool
+imxexa_batch_merge(
+	IMXEXAPtr fPtr,
+	IMXEXABatchRectRec* last,
+	const IMXEXABatchRectRec* rect)
+{
+	/* Only rects sharing an edge in full get merged, so that no pixel is drawn twice. */
+	/* Region fills and copies arrive as y-x banded boxes, which abut the previous one. */
+	BoxRec merged = last->dst;
+
+	if (rect->dst.y1 == last->dst.y1 && rect->dst.y2 == last->dst.y2 && rect->dst.x1 == last->dst.x2)
+		merged.x2 = rect->dst.x2;
+	else if (rect->dst.x1 == last->dst.x1 && rect->dst.x2 == last->dst.x2 && rect->dst.y1 == last->dst.y2)
+		merged.y2 = rect->dst.y2;
+	else
 		return FALSE;
-	}
 
-	pPixmap->devKind = fPixmapPtr->surfDef.stride;
-	pPixmap->devPrivate.ptr = bits;
+	if (fPtr->batchBlit) {
 
-	fPixmapPtr->surfPtr = bits;
+		const int dx = last->srcX - last->dst.x1;
+		const int dy = last->srcY - last->dst.y1;
 
-#if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
+		/* Blits merge only if they move by the same offset. */
+		if (rect->srcX - rect->dst.x1 != dx || rect->srcY - rect->dst.y1 != dy)
+			return FALSE;
 
-	++fPtr->numAccessBeforeSync;
+		/* Within a pixmap, the rects must not read what the merged blit writes, or the outcome */
+		/* could differ from that of the blits done one after the other. */
+		if (fPtr->pPixSrc == fPtr->pPixDst &&
+			merged.x1 + dx < merged.x2 && merged.x1 < merged.x2 + dx &&
+			merged.y1 + dy < merged.y2 && merged.y1 < merged.y2 + dy) {
 
-#endif
+			return FALSE;
+		}
+	}
+
+	last->dst = merged;
 
 	return TRUE;
 }
 
 static void
-IMXEXAFinishAccess(
-	PixmapPtr pPixmap,
-	int index)
+imxexa_batch_add(
+	IMXEXAPtr fPtr,
+	int dstX1, int dstY1,
+	int dstX2, int dstY2,
+	int srcX, int srcY)
 {
-	if (NULL == pPixmap)
+	if (dstX1 >= dstX2 || dstY1 >= dstY2)
 		return;
 
-	/* Access screen info associated with this pixmap. */
-	ScrnInfoPtr pScrn = xf86Screens[pPixmap->drawable.pScreen->myNum];
+	fPtr->opOnGpu = TRUE;
 
-#if 0
-	/* Access driver specific data associated with the screen. */
-	IMXPtr imxPtr = IMXPTR(pScrn);
-	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
-#endif
+	const IMXEXABatchRectRec rect = {
+		.dst = { dstX1, dstY1, dstX2, dstY2 },
+		.srcX = srcX,
+		.srcY = srcY
+	};
 
-	/* Access driver private data associated with pixmap. */
-	IMXEXAPixmapPtr fPixmapPtr =
-		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmap);
+#if IMX_DEBUG_MASTER
+	++fPtr->numBatchedRects;
+#endif
 
-	if (!imxexa_can_accelerate_pixmap(fPixmapPtr)) {
+	if (0 != fPtr->batchCount &&
+		imxexa_batch_merge(fPtr, &fPtr->batch[fPtr->batchCount - 1], &rect)) {
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAFinishAccess called with sysmem pixmap\n");
+#if IMX_DEBUG_MASTER
+		++fPtr->numMergedRects;
+#endif
 		return;
 	}
 
-	/* Is the surface neither locked nor evicted? */
-	if (NULL == fPixmapPtr->surfPtr && PIXMAP_STAMP_EVICTED != fPixmapPtr->stamp) {
-
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAFinishAccess called with pixmap not being accessed\n");
-		return;
-	}
+	if (IMXEXA_BATCH_MAX_RECTS == fPtr->batchCount)
+		imxexa_batch_submit(fPtr);
 
-	/* To relieve the GPU pipeline of EXA's enormous access pressure, surface will be unlocked upon */
-	/* first use (lazy unlock). Just notify clients that access to the pixmap content is no more. */
-	pPixmap->devPrivate.ptr = NULL;
+	fPtr->batch[fPtr->batchCount++] = rect;
 }
 
 static Bool
@@ -1816,6 +6079,10 @@ IMXEXAPrepareSolid(
 	if (!imxexa_can_accelerate_pixmap(fPixmapPtr))
 		return FALSE;
 
+	/* Keep demoted pixmaps in sysmem until they prove worthy of gpumem again. */
+	if (imxexa_is_pixmap_held_in_sysmem(fPtr, fPixmapPtr))
+		return FALSE;
+
 	/* Do not accelerate 8bpp-or-narrower targets unless backend is Z160. */
 	if (8 >= fPixmapPtr->bitsPerPixel && IMXEXA_BACKEND_Z160 != imxPtr->backend) {
 
@@ -1823,47 +6090,53 @@ IMXEXAPrepareSolid(
 		return FALSE;
 	}
 
-	/* Make sure that the input planemask specifies a solid */
-	if (!EXA_PM_IS_SOLID(&pPixmap->drawable, planemask)) {
-
-#if IMX_EXA_DEBUG_PREPARE_SOLID
-
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAPrepareSolid called with planemask 0x%08x which is not solid\n",
-			(unsigned)planemask);
-#endif
-		imxexa_update_pixmap_on_failure(fPtr, fPixmapPtr);
-		return FALSE;
-	}
+	const Pixel pixel_bits = imxexa_pixel_bits(fPixmapPtr->bitsPerPixel);
+	const Bool masked = !EXA_PM_IS_SOLID(&pPixmap->drawable, planemask);
 
-	/* Make sure that the raster op is supported. */
-	Bool rop_success = FALSE;
+	fg &= pixel_bits;
+	planemask &= pixel_bits;
 
+	/* Fold the raster ops that ignore the destination into a copy of the adjusted color. */
 	switch (alu) {
 	case GXclear:
 		fg = 0;
-		rop_success = TRUE;
-		break;
-	case GXcopy:
-		rop_success = TRUE;
+		alu = GXcopy;
 		break;
 	case GXcopyInverted:
 		fg = ~fg;
-		rop_success = TRUE;
+		alu = GXcopy;
 		break;
 	case GXset:
-		fg = -1U;
-		rop_success = TRUE;
+		fg = pixel_bits;
+		alu = GXcopy;
 		break;
 	}
 
-	if (!rop_success) {
+	/* Through a planemask, each dst bit within it gets kept, inverted, cleared or set by the op, */
+	/* that is dst & maskedAnd ^ maskedXor; written in two passes of GXand and GXxor. */
+	if (masked) {
+
+		const CARD32 r0 = imxexa_apply_alu(alu, fg, 0) & planemask;
+		const CARD32 r1 = (imxexa_apply_alu(alu, fg, ~0U) & planemask) | ~planemask;
+
+		fPtr->maskedAnd = (r0 ^ r1) & pixel_bits;
+		fPtr->maskedXor = r0 & pixel_bits;
+	}
+
+	/* Make sure that the raster ops are supported. */
+	const unsigned alus = masked ? 1U << GXand | 1U << GXxor : 1U << alu;
+
+	if (alus != (fPtr->solidAlus & alus)) {
 
 #if IMX_EXA_DEBUG_PREPARE_SOLID
 
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAPrepareSolid called with unsupported rop 0x%08x\n",
-			(unsigned) alu);
+			"IMXEXAPrepareSolid called with unsupported rop 0x%08x, planemask 0x%08x\n",
+			(unsigned) alu, (unsigned) planemask);
+#endif
+#if IMX_DEBUG_MASTER
+		if (masked)
+			++fPtr->numMaskedFallbacks;
 #endif
 		imxexa_update_pixmap_on_failure(fPtr, fPixmapPtr);
 		return FALSE;
@@ -1874,17 +6147,35 @@ IMXEXAPrepareSolid(
 	fPtr->pPixSrc = NULL;
 	fPtr->pPixMsk = NULL;
 
-	/* Set up draw state. */
-	if (!imxexa_unlock_surface(fPtr, fPixmapPtr))
+	fPtr->batchBlit = FALSE;
+	fPtr->batchCount = 0;
+
+	fPtr->solidColor = fg;
+	fPtr->opMasked = masked;
+	fPtr->opCpuCapable = fPtr->cpuSmallOps && !masked && GXcopy == alu && 0 == (fPixmapPtr->bitsPerPixel & 7);
+	fPtr->opOnGpu = FALSE;
+
+	/* Set up draw state; surface gets unlocked at the first GPU draw. */
+	if (!imxexa_reinstate_surface(fPtr, fPixmapPtr))
 		return FALSE;
 
-	c2dSetDstSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapPtr));
-	c2dSetSrcSurface(fPtr->gpuContext, NULL);
-	c2dSetBrushSurface(fPtr->gpuContext, NULL, NULL);
-	c2dSetMaskSurface(fPtr->gpuContext, NULL, NULL);
+	imxexa_set_dst_surface(fPtr, imxexa_get_preferred_surface(fPixmapPtr));
+	imxexa_set_src_surface(fPtr, NULL);
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
 
 	c2dSetFgColor(fPtr->gpuContext, fg);
-	c2dSetBlendMode(fPtr->gpuContext, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_blend_mode(fPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_plain_sampling(fPtr);
+
+	/* Masked fills set their raster ops and colors pass by pass. */
+	if (!masked)
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[alu]);
+
+#if IMX_DEBUG_MASTER
+	if (masked)
+		++fPtr->numMaskedSolids;
+#endif
 
 	/* Mark pixmap as used and update driver's heartbeat. */
 	imxexa_update_pixmap_on_use(fPtr, fPixmapPtr);
@@ -1906,21 +6197,11 @@ IMXEXASolid(
 	IMXPtr imxPtr = IMXPTR(pScrn);
 	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
-	C2D_RECT rect = {
-		.x = x1,
-		.y = y1,
-		.width = x2 - x1,
-		.height = y2 - y1
-	};
-
-	c2dSetDstRectangle(fPtr->gpuContext, &rect);
-
-	const C2D_STATUS r = c2dDrawRect(fPtr->gpuContext, C2D_PARAM_FILL_BIT);
-
-	if (C2D_STATUS_OK != r) {
+	/* Fill the rect on the CPU if cheaper, else hold it back for drawing along with the rest of the op. */
+	if (!imxexa_cpu_is_cheaper(fPtr, x2 - x1, y2 - y1, fPtr->costCpuFill) ||
+		!imxexa_cpu_solid(fPtr, x1, y1, x2, y2)) {
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXASolid failed to perform GPU draw (code: 0x%08x)\n", r);
+		imxexa_batch_add(fPtr, x1, y1, x2, y2, 0, 0);
 	}
 
 #if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
@@ -1961,8 +6242,11 @@ IMXEXADoneSolid(
 
 	if (NULL != fPtr->gpuContext) {
 
-		/* Flush pending operations to the GPU. */
-		c2dFlush(fPtr->gpuContext);
+		/* Draw the rects held back, leaving the draws queued; they get flushed in batches. */
+		imxexa_batch_submit(fPtr);
+
+		if (fPtr->opOnGpu)
+			imxexa_record_op_serial(fPtr);
 
 		fPtr->gpuSynced = FALSE;
 
@@ -1997,51 +6281,47 @@ IMXEXAPrepareCopy(
 	IMXEXAPixmapPtr fPixmapSrcPtr =
 		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmapSrc);
 
-	/* Make sure pixmaps can be accelerated in principle. */
-	if (!imxexa_can_accelerate_pixmap(fPixmapDstPtr) ||
-		!imxexa_can_accelerate_pixmap(fPixmapSrcPtr)) {
+	/* Make sure pixmaps can be accelerated in principle; sysmem pixmaps in the way may get promoted. */
+	PixmapPtr pPixmaps[] = { pPixmapDst, pPixmapSrc };
 
+	if (!imxexa_promote_blocking_pixmaps(imxPtr->backend, fPtr, pPixmaps, 2))
 		return FALSE;
-	}
 
-	/* Do not accelerate 8bpp-or-narrower targets unless backend is Z160. */
-	if (8 >= fPixmapDstPtr->bitsPerPixel && IMXEXA_BACKEND_Z160 != imxPtr->backend) {
+	/* Keep demoted pixmaps in sysmem until they prove worthy of gpumem again. */
+	const Bool held =
+		imxexa_is_pixmap_held_in_sysmem(fPtr, fPixmapDstPtr) |
+		imxexa_is_pixmap_held_in_sysmem(fPtr, fPixmapSrcPtr);
 
-		imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
-		imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
+	if (held)
 		return FALSE;
-	}
-
-	/* Make sure that the input planemask specifies a solid */
-	if (!EXA_PM_IS_SOLID(&pPixmapDst->drawable, planemask)) {
 
-#if IMX_EXA_DEBUG_PREPARE_COPY
+	/* Do not accelerate 8bpp-or-narrower targets unless backend is Z160. */
+	if (8 >= fPixmapDstPtr->bitsPerPixel && IMXEXA_BACKEND_Z160 != imxPtr->backend) {
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAPrepareCopy called with planemask 0x%08x which is not solid\n",
-			(unsigned)planemask);
-#endif
 		imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
 		imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
 		return FALSE;
 	}
 
-	/* Make sure that the raster op is supported. */
-	Bool rop_success = FALSE;
+	/* Through a planemask, the change the op makes to dst gets worked out in the scratch surface, */
+	/* masked by GXand and applied to dst by GXxor. */
+	const Bool masked = !EXA_PM_IS_SOLID(&pPixmapDst->drawable, planemask);
+	const int masked_alu = imxexa_masked_copy_alu(alu);
 
-	switch (alu) {
-	case GXcopy:
-		rop_success = TRUE;
-		break;
-	}
+	/* Make sure that the raster ops are supported. */
+	const unsigned alus = masked ? 1U << GXcopy | 1U << masked_alu | 1U << GXxor : 1U << alu;
 
-	if (!rop_success) {
+	if (alus != (fPtr->copyAlus & alus) || (masked && 0 == (fPtr->solidAlus & 1U << GXand))) {
 
 #if IMX_EXA_DEBUG_PREPARE_COPY
 
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAPrepareCopy called with unsupported rop 0x%08x\n",
-			(unsigned)alu);
+			"IMXEXAPrepareCopy called with unsupported rop 0x%08x, planemask 0x%08x\n",
+			(unsigned)alu, (unsigned)planemask);
+#endif
+#if IMX_DEBUG_MASTER
+		if (masked)
+			++fPtr->numMaskedFallbacks;
 #endif
 		imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
 		imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
@@ -2053,19 +6333,42 @@ IMXEXAPrepareCopy(
 	fPtr->pPixSrc = fPixmapSrcPtr;
 	fPtr->pPixMsk = NULL;
 
-	/* Set up draw state. */
-	if (!imxexa_unlock_surface(fPtr, fPixmapDstPtr) ||
-		!imxexa_unlock_surface(fPtr, fPixmapSrcPtr)) {
+	/* Boxes come ordered by xdir and ydir, an order the batch keeps; overlapping boxes of a */
+	/* pixmap are each drawn against the direction of their move by imxexa_blit_rect. */
+	fPtr->batchBlit = TRUE;
+	fPtr->batchCount = 0;
+
+	fPtr->opMasked = masked;
+	fPtr->planemask = planemask & imxexa_pixel_bits(fPixmapDstPtr->bitsPerPixel);
+	fPtr->maskedAlu = masked_alu;
+
+	fPtr->opCpuCapable = fPtr->cpuSmallOps && !masked && GXcopy == alu && 0 == (fPixmapDstPtr->bitsPerPixel & 7) &&
+		fPixmapDstPtr->bitsPerPixel == fPixmapSrcPtr->bitsPerPixel;
+	fPtr->opOnGpu = FALSE;
+
+	/* Set up draw state; surfaces get unlocked at the first GPU draw. */
+	if (!imxexa_reinstate_surface(fPtr, fPixmapDstPtr) ||
+		!imxexa_reinstate_surface(fPtr, fPixmapSrcPtr)) {
 
 		return FALSE;
 	}
 
-	c2dSetDstSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapDstPtr));
-	c2dSetSrcSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapSrcPtr));
-	c2dSetBrushSurface(fPtr->gpuContext, NULL, NULL);
-	c2dSetMaskSurface(fPtr->gpuContext, NULL, NULL);
+	imxexa_set_dst_surface(fPtr, imxexa_get_preferred_surface(fPixmapDstPtr));
+	imxexa_set_src_surface(fPtr, imxexa_get_preferred_surface(fPixmapSrcPtr));
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
+
+	imxexa_set_blend_mode(fPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_plain_sampling(fPtr);
 
-	c2dSetBlendMode(fPtr->gpuContext, C2D_ALPHA_BLEND_NONE);
+	/* Masked copies set their raster ops pass by pass. */
+	if (!masked)
+		imxexa_set_rop(fPtr, imxexa_rop4_from_alu[alu]);
+
+#if IMX_DEBUG_MASTER
+	if (masked)
+		++fPtr->numMaskedCopies;
+#endif
 
 	/* Mark pixmaps as used and update driver's heartbeat. */
 	imxexa_update_pixmap_on_use(fPtr, fPixmapDstPtr);
@@ -2089,29 +6392,11 @@ IMXEXACopy(
 	IMXPtr imxPtr = IMXPTR(pScrn);
 	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
-	C2D_RECT rectDst = {
-		.x = dstX,
-		.y = dstY,
-		.width = width,
-		.height = height
-	};
-
-	C2D_RECT rectSrc = {
-		.x = srcX,
-		.y = srcY,
-		.width = width,
-		.height = height
-	};
-
-	c2dSetDstRectangle(fPtr->gpuContext, &rectDst);
-	c2dSetSrcRectangle(fPtr->gpuContext, &rectSrc);
-
-	const C2D_STATUS r = c2dDrawBlit(fPtr->gpuContext);
-
-	if (C2D_STATUS_OK != r) {
+	/* Copy the rect on the CPU if cheaper, else hold it back for drawing along with the rest of the op. */
+	if (!imxexa_cpu_is_cheaper(fPtr, width, height, fPtr->costCpuCopy) ||
+		!imxexa_cpu_copy(fPtr, srcX, srcY, dstX, dstY, width, height)) {
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXACopy failed to perform GPU draw (code: 0x%08x)\n", r);
+		imxexa_batch_add(fPtr, dstX, dstY, dstX + width, dstY + height, srcX, srcY);
 	}
 
 #if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
@@ -2151,8 +6436,11 @@ IMXEXADoneCopy(
 
 	if (NULL != fPtr->gpuContext) {
 
-		/* Flush pending operations to the GPU. */
-		c2dFlush(fPtr->gpuContext);
+		/* Draw the rects held back, leaving the draws queued; they get flushed in batches. */
+		imxexa_batch_submit(fPtr);
+
+		if (fPtr->opOnGpu)
+			imxexa_record_op_serial(fPtr);
 
 		fPtr->gpuSynced = FALSE;
 
@@ -2207,6 +6495,18 @@ IMXEXAUploadToScreen(
 	/* Is surface currently evicted? */
 	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
 
+		imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+		const Bool unpacked = imxexa_unpack_backup(fPtr, fPixmapPtr);
+
+		if (unpacked)
+			imxexa_drop_packed_backup(fPtr, fPixmapPtr);
+
+		imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+		if (!unpacked)
+			return FALSE;
+
 		pitchDst = fPixmapPtr->sysPitchBytes;
 		pBufferDst = fPixmapPtr->sysPtr;
 	}
@@ -2214,8 +6514,7 @@ IMXEXAUploadToScreen(
 	if (NULL == fPixmapPtr->surfPtr) {
 
 		/* Access-lock the surface. */
-		const C2D_STATUS r = c2dSurfLock(fPtr->gpuContext,
-			imxexa_get_preferred_surface(fPixmapPtr), (void**) &pBufferDst);
+		const C2D_STATUS r = imxexa_lock_surface(fPtr, fPixmapPtr, (void**) &pBufferDst);
 
 		if (C2D_STATUS_OK != r) {
 
@@ -2227,6 +6526,8 @@ IMXEXAUploadToScreen(
 		fPixmapPtr->surfPtr = pBufferDst;
 	}
 
+	imxexa_mark_pixmap_dirty(fPixmapPtr, dstX, dstY, dstX + width, dstY + height);
+
 	/* Compute number of bytes per pixel to transfer. */
 	int bytesPerPixel = pPixmapDst->drawable.bitsPerPixel / 8;
 
@@ -2299,6 +6600,15 @@ IMXEXADownloadFromScreen(
 	/* Is surface currently evicted? */
 	if (PIXMAP_STAMP_EVICTED == fPixmapPtr->stamp) {
 
+		imxexa_account_pixmap(fPtr, fPixmapPtr, -1);
+
+		const Bool unpacked = imxexa_unpack_backup(fPtr, fPixmapPtr);
+
+		imxexa_account_pixmap(fPtr, fPixmapPtr, 1);
+
+		if (!unpacked)
+			return FALSE;
+
 		pitchSrc = fPixmapPtr->sysPitchBytes;
 		pBufferSrc = fPixmapPtr->sysPtr;
 	}
@@ -2306,8 +6616,7 @@ IMXEXADownloadFromScreen(
 	if (NULL == fPixmapPtr->surfPtr) {
 
 		/* Access-lock the surface. */
-		const C2D_STATUS r = c2dSurfLock(fPtr->gpuContext,
-			imxexa_get_preferred_surface(fPixmapPtr), (void**) &pBufferSrc);
+		const C2D_STATUS r = imxexa_lock_surface(fPtr, fPixmapPtr, (void**) &pBufferSrc);
 
 		if (C2D_STATUS_OK != r) {
 
@@ -2337,6 +6646,8 @@ IMXEXADownloadFromScreen(
 
 	/* Don't unlock the surface here - leave it to the lazy unlock. */
 
+	imxexa_drop_unpacked_backup(fPtr, fPixmapPtr);
+
 #if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
 
 	++fPtr->numDnloadBeforeSync;
@@ -2346,50 +6657,339 @@ IMXEXADownloadFromScreen(
 	return TRUE;
 }
 
+static int
+IMXEXAMarkSync(
+	ScreenPtr pScreen)
+{
+	/* Access screen info associated with this screen. */
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Marker is the serial of the batch holding the ops so far. */
+	return (int) imxexa_current_serial(fPtr);
+}
+
+static void
+IMXEXAWaitMarker(
+	ScreenPtr pScreen,
+	int marker)
+{
+	/* Access screen info associated with this screen. */
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+
+	/* Access driver specific data associated with the screen. */
+	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
+
+	/* Nothing to do if there has not been a GPU operation since last sync, */
+	/* or if the ops up to marker are known to be done. */
+	if (fPtr->gpuSynced || 0 >= (int) ((unsigned) marker - (unsigned) fPtr->retiredSerial))
+		return;
+
+#if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
+
+	/* Log how many calls were made to solid, copy, and composite before sync called. */
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"IMXEXAWaitMarker called after solid=%lu copy=%lu conv=%lu composite=%lu access=%lu up=%lu down=%lu\n",
+			fPtr->numSolidBeforeSync,
+			fPtr->numCopyBeforeSync,
+			fPtr->numConvBeforeSync,
+			fPtr->numCompositeBeforeSync,
+			fPtr->numAccessBeforeSync,
+			fPtr->numUploadBeforeSync,
+			fPtr->numDnloadBeforeSync);
+
+	/* Reset counters */
+	fPtr->numSolidBeforeSync = 0;
+	fPtr->numCopyBeforeSync = 0;
+	fPtr->numConvBeforeSync = 0;
+	fPtr->numCompositeBeforeSync = 0;
+	fPtr->numAccessBeforeSync = 0;
+	fPtr->numUploadBeforeSync = 0;
+	fPtr->numDnloadBeforeSync = 0;
+
+#endif
+
+	/* CPU access to GPU surfaces goes through a surface lock, which waits for the last op */
+	/* on the pixmap only, so no need to sync here. Just update the sync status. By doing so */
+	/* we achieve higher cpu-gpu concurrency. */
+	fPtr->gpuSynced = TRUE;
+}
+
+/* Factors the Porter-Duff ops weigh src and dst by. */
+#define IMX_EXA_BLEND_ZERO					0
+#define IMX_EXA_BLEND_ONE					1
+#define IMX_EXA_BLEND_SRC_ALPHA				2
+#define IMX_EXA_BLEND_INV_SRC_ALPHA			3
+#define IMX_EXA_BLEND_DST_ALPHA				4
+#define IMX_EXA_BLEND_INV_DST_ALPHA			5
+
+/* C2D blend modes doing the Porter-Duff ops, along with the factors the ops weigh src and dst by. */
+/* Clear gets done by a fill and Dst by nothing at all; Saturate has no blend mode. */
+static const struct {
+	C2D_ALPHA_BLEND_MODE mode;
+	int srcFactor;
+	int dstFactor;
+} imxexa_pict_op_blends[PictOpSaturate + 1] = {
+	[PictOpClear] =			{ C2D_ALPHA_BLEND_NONE,		IMX_EXA_BLEND_ZERO,				IMX_EXA_BLEND_ZERO },
+	[PictOpSrc] =			{ C2D_ALPHA_BLEND_NONE,		IMX_EXA_BLEND_ONE,				IMX_EXA_BLEND_ZERO },
+	[PictOpDst] =			{ C2D_ALPHA_BLEND_NONE,		IMX_EXA_BLEND_ZERO,				IMX_EXA_BLEND_ONE },
+	[PictOpOver] =			{ C2D_ALPHA_BLEND_SRCOVER,	IMX_EXA_BLEND_ONE,				IMX_EXA_BLEND_INV_SRC_ALPHA },
+	[PictOpOverReverse] =	{ C2D_ALPHA_BLEND_DSTOVER,	IMX_EXA_BLEND_INV_DST_ALPHA,	IMX_EXA_BLEND_ONE },
+	[PictOpIn] =			{ C2D_ALPHA_BLEND_SRCIN,	IMX_EXA_BLEND_DST_ALPHA,		IMX_EXA_BLEND_ZERO },
+	[PictOpInReverse] =		{ C2D_ALPHA_BLEND_DSTIN,	IMX_EXA_BLEND_ZERO,				IMX_EXA_BLEND_SRC_ALPHA },
+	[PictOpOut] =			{ C2D_ALPHA_BLEND_SRCOUT,	IMX_EXA_BLEND_INV_DST_ALPHA,	IMX_EXA_BLEND_ZERO },
+	[PictOpOutReverse] =	{ C2D_ALPHA_BLEND_DSTOUT,	IMX_EXA_BLEND_ZERO,				IMX_EXA_BLEND_INV_SRC_ALPHA },
+	[PictOpAtop] =			{ C2D_ALPHA_BLEND_SRCATOP,	IMX_EXA_BLEND_DST_ALPHA,		IMX_EXA_BLEND_INV_SRC_ALPHA },
+	[PictOpAtopReverse] =	{ C2D_ALPHA_BLEND_DSTATOP,	IMX_EXA_BLEND_INV_DST_ALPHA,	IMX_EXA_BLEND_SRC_ALPHA },
+	[PictOpXor] =			{ C2D_ALPHA_BLEND_XOR,		IMX_EXA_BLEND_INV_DST_ALPHA,	IMX_EXA_BLEND_INV_SRC_ALPHA },
+	[PictOpAdd] =			{ C2D_ALPHA_BLEND_ADDITIVE,	IMX_EXA_BLEND_ONE,				IMX_EXA_BLEND_ONE },
+	[PictOpSaturate] =		{ C2D_ALPHA_BLEND_NONE,		IMX_EXA_BLEND_ZERO,				IMX_EXA_BLEND_ZERO }
+};
+
+/* Porter-Duff ops equivalent to each op once dst alpha is known to be 1, as with dst formats */
+/* without alpha. */
+static const int imxexa_pict_op_opaque_dst[PictOpSaturate + 1] = {
+	[PictOpClear] =			PictOpClear,
+	[PictOpSrc] =			PictOpSrc,
+	[PictOpDst] =			PictOpDst,
+	[PictOpOver] =			PictOpOver,
+	[PictOpOverReverse] =	PictOpDst,
+	[PictOpIn] =			PictOpSrc,
+	[PictOpInReverse] =		PictOpInReverse,
+	[PictOpOut] =			PictOpClear,
+	[PictOpOutReverse] =	PictOpOutReverse,
+	[PictOpAtop] =			PictOpOver,
+	[PictOpAtopReverse] =	PictOpInReverse,
+	[PictOpXor] =			PictOpOutReverse,
+	[PictOpAdd] =			PictOpAdd,
+	[PictOpSaturate] =		PictOpDst
+};
+
+/* Porter-Duff ops equivalent to each op once src alpha is known to be 1, as with unmasked src */
+/* formats without alpha. */
+static const int imxexa_pict_op_opaque_src[PictOpSaturate + 1] = {
+	[PictOpClear] =			PictOpClear,
+	[PictOpSrc] =			PictOpSrc,
+	[PictOpDst] =			PictOpDst,
+	[PictOpOver] =			PictOpSrc,
+	[PictOpOverReverse] =	PictOpOverReverse,
+	[PictOpIn] =			PictOpIn,
+	[PictOpInReverse] =		PictOpDst,
+	[PictOpOut] =			PictOpOut,
+	[PictOpOutReverse] =	PictOpClear,
+	[PictOpAtop] =			PictOpIn,
+	[PictOpAtopReverse] =	PictOpOverReverse,
+	[PictOpXor] =			PictOpOut,
+	[PictOpAdd] =			PictOpAdd,
+	[PictOpSaturate] =		PictOpOverReverse
+};
+
+/* Porter-Duff ops taken on by each backend, as masks by 1 << op. Z430 has been kept off In and */
+/* Add before, Saturate has no blend mode; ops other than Src and Over get checked at startup. */
+static const unsigned imxexa_pict_op_caps[] = {
+	[IMXEXA_BACKEND_NONE] = 0,
+	[IMXEXA_BACKEND_Z160] = (1U << PictOpSaturate) - 1,
+	[IMXEXA_BACKEND_Z430] = ((1U << PictOpSaturate) - 1) & ~(1U << PictOpIn | 1U << PictOpAdd)
+};
+
+static int
+imxexa_reduce_pict_op(
+	int op,
+	PicturePtr pPictureSrc,
+	PicturePtr pPictureMask,
+	PicturePtr pPictureDst)
+{
+	if (PictOpSaturate < op)
+		return op;
+
+	/* Reducing dst first leaves nothing further for dst after reducing src. */
+	if (0 == PICT_FORMAT_A(pPictureDst->format))
+		op = imxexa_pict_op_opaque_dst[op];
+
+	if (NULL == pPictureMask && 0 == PICT_FORMAT_A(pPictureSrc->format))
+		op = imxexa_pict_op_opaque_src[op];
+
+	return op;
+}
+
+static inline unsigned
+imxexa_mul_un8(
+	unsigned a,
+	unsigned b)
+{
+	const unsigned t = a * b + 0x80;
+
+	return (t + (t >> 8)) >> 8;
+}
+
+static inline unsigned
+imxexa_blend_factor(
+	int factor,
+	unsigned srcAlpha,
+	unsigned dstAlpha)
+{
+	switch (factor) {
+	case IMX_EXA_BLEND_ONE:
+		return 0xff;
+	case IMX_EXA_BLEND_SRC_ALPHA:
+		return srcAlpha;
+	case IMX_EXA_BLEND_INV_SRC_ALPHA:
+		return 0xff - srcAlpha;
+	case IMX_EXA_BLEND_DST_ALPHA:
+		return dstAlpha;
+	case IMX_EXA_BLEND_INV_DST_ALPHA:
+		return 0xff - dstAlpha;
+	}
+
+	return 0;
+}
+
+/* Premultiplied a8r8g8b8 pixel of the specified alpha, its color varying by seed. */
+static inline CARD32
+imxexa_check_pixel(
+	unsigned alpha,
+	unsigned seed)
+{
+	CARD32 pixel = alpha << 24;
+	int shift;
+
+	for (shift = 0; shift < 24; shift += 8, seed = seed * 0x35 + 0x59)
+		pixel |= (alpha * (seed & 0xff) / 0xff) << shift;
+
+	return pixel;
+}
+
+static Bool
+imxexa_check_blend(
+	IMXEXAPtr fPtr,
+	int op,
+	C2D_SURFACE dstSurf,
+	C2D_SURFACE srcSurf)
+{
+	static const CARD8 src_alpha[IMX_EXA_ROP_CHECK_WIDTH] = { 0xff, 0x80, 0x00, 0x40, 0xff, 0xc0, 0x20, 0x99 };
+	static const CARD8 dst_alpha[IMX_EXA_ROP_CHECK_WIDTH] = { 0xff, 0xff, 0x80, 0x00, 0x40, 0xc0, 0x99, 0x20 };
+
+	CARD32 src[IMX_EXA_ROP_CHECK_WIDTH];
+	CARD32 dst[IMX_EXA_ROP_CHECK_WIDTH];
+	void* bits;
+	int i;
+
+	/* Pair each of transparent, translucent and opaque src with each of those of dst. */
+	for (i = 0; i < IMX_EXA_ROP_CHECK_WIDTH; ++i) {
+
+		src[i] = imxexa_check_pixel(src_alpha[i], i + 1);
+		dst[i] = imxexa_check_pixel(dst_alpha[i], i + 0x80);
+	}
+
+	if (!imxexa_write_check_row(fPtr, dstSurf, dst) || !imxexa_write_check_row(fPtr, srcSurf, src))
+		return FALSE;
+
+	C2D_RECT rect = {
+		0, 0, IMX_EXA_ROP_CHECK_WIDTH, 1
+	};
+
+	imxexa_set_dst_surface(fPtr, dstSurf);
+	imxexa_set_src_surface(fPtr, srcSurf);
+	imxexa_set_blend_mode(fPtr, imxexa_pict_op_blends[op].mode);
+	c2dSetDstRectangle(fPtr->gpuContext, &rect);
+	c2dSetSrcRectangle(fPtr->gpuContext, &rect);
+
+	const C2D_STATUS r = c2dDrawBlit(fPtr->gpuContext);
+
+	c2dFlush(fPtr->gpuContext);
+	c2dFinish(fPtr->gpuContext);
+
+	if (C2D_STATUS_OK != r || C2D_STATUS_OK != c2dSurfLock(fPtr->gpuContext, dstSurf, &bits))
+		return FALSE;
+
+	Bool match = TRUE;
+
+	/* Compute each channel as pixman does, allowing for a difference of one in rounding. */
+	for (i = 0; i < IMX_EXA_ROP_CHECK_WIDTH && match; ++i) {
+
+		const CARD32 got = ((const CARD32*) bits)[i];
+		const unsigned sa = src[i] >> 24;
+		const unsigned da = dst[i] >> 24;
+		const unsigned fa = imxexa_blend_factor(imxexa_pict_op_blends[op].srcFactor, sa, da);
+		const unsigned fb = imxexa_blend_factor(imxexa_pict_op_blends[op].dstFactor, sa, da);
+		int shift;
+
+		for (shift = 0; shift < 32 && match; shift += 8) {
+
+			unsigned expect =
+				imxexa_mul_un8(src[i] >> shift & 0xff, fa) +
+				imxexa_mul_un8(dst[i] >> shift & 0xff, fb);
+
+			if (0xff < expect)
+				expect = 0xff;
+
+			match = abs((int) (got >> shift & 0xff) - (int) expect) <= 1;
+		}
+	}
+
+	c2dSurfUnlock(fPtr->gpuContext, dstSurf);
+
+	return match;
+}
+
 static void
-IMXEXAWaitMarker(
-	ScreenPtr pScreen,
-	int marker)
+imxexa_check_blends(
+	ScrnInfoPtr pScrn)
 {
-	/* Access screen info associated with this screen. */
-	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
-
 	/* Access driver specific data associated with the screen. */
 	IMXPtr imxPtr = IMXPTR(pScrn);
 	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
-	/* Nothing to do if there has not been a GPU operation since last sync. */
-	if (fPtr->gpuSynced)
+	/* Src and Over are what composites have been built on, and stay regardless; Clear and Dst */
+	/* need no blending. */
+	const unsigned unchecked =
+		1U << PictOpClear | 1U << PictOpSrc | 1U << PictOpDst | 1U << PictOpOver;
+
+	C2D_SURFACE dstSurf;
+	C2D_SURFACE srcSurf;
+
+	const C2D_STATUS r = imxexa_alloc_check_surfaces(fPtr, &dstSurf, &srcSurf);
+
+	if (C2D_STATUS_OK != r) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			"Unable to check blend modes (code: 0x%08x), accelerating Src and Over only\n", r);
+
+		fPtr->composOps &= unchecked;
 		return;
+	}
 
-#if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
+	/* Compare the results of each blending op taken on against those of pixman; drop mismatching ones. */
+	imxexa_finish_gpu(fPtr);
 
-	/* Log how many calls were made to solid, copy, and composite before sync called. */
-	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
-		"IMXEXAWaitMarker called after solid=%lu copy=%lu conv=%lu composite=%lu access=%lu up=%lu down=%lu\n",
-			fPtr->numSolidBeforeSync,
-			fPtr->numCopyBeforeSync,
-			fPtr->numConvBeforeSync,
-			fPtr->numCompositeBeforeSync,
-			fPtr->numAccessBeforeSync,
-			fPtr->numUploadBeforeSync,
-			fPtr->numDnloadBeforeSync);
+	imxexa_set_brush_surface(fPtr, NULL);
+	imxexa_set_mask_surface(fPtr, NULL);
+	imxexa_set_plain_sampling(fPtr);
+	imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
 
-	/* Reset counters */
-	fPtr->numSolidBeforeSync = 0;
-	fPtr->numCopyBeforeSync = 0;
-	fPtr->numConvBeforeSync = 0;
-	fPtr->numCompositeBeforeSync = 0;
-	fPtr->numAccessBeforeSync = 0;
-	fPtr->numUploadBeforeSync = 0;
-	fPtr->numDnloadBeforeSync = 0;
+	int op;
 
-#endif
+	for (op = 0; op <= PictOpSaturate; ++op) {
 
-	/* We use a surface-lock mechanism when doing CPU access to GPU surfaces, */
-	/* so no need to sync here. Just update the sync status. By doing so we achieve */
-	/* higher cpu-gpu concurrency. */
-	fPtr->gpuSynced = TRUE;
+		if (0 == (fPtr->composOps & ~unchecked & 1U << op) ||
+			imxexa_check_blend(fPtr, op, dstSurf, srcSurf)) {
+
+			continue;
+		}
+
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			"GPU result of %s differs from pixman, not accelerating it\n",
+			imxexa_string_from_pict_op(op));
+
+		fPtr->composOps &= ~(1U << op);
+	}
+
+	imxexa_free_c2d_surface(fPtr, srcSurf);
+	imxexa_free_c2d_surface(fPtr, dstSurf);
 }
 
 static Bool
@@ -2425,14 +7025,6 @@ IMXEXACheckComposite(
 	IMXEXAPixmapPtr fPixmapMskPtr = NULL != pPixmapMsk ?
 		(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pPixmapMsk) : NULL;
 
-	/* Make sure pixmaps can be accelerated in principle. */
-	if (!imxexa_can_accelerate_pixmap(fPixmapDstPtr) ||
-		!imxexa_can_accelerate_pixmap(fPixmapSrcPtr) ||
-		NULL != fPixmapMskPtr && !imxexa_can_accelerate_pixmap(fPixmapMskPtr)) {
-
-		return FALSE;
-	}
-
 	/* Cannot perform blend unless screens associated with src and dst pixmaps are the same. */
 	if (pPixmapSrc->drawable.pScreen->myNum !=
 		pPixmapDst->drawable.pScreen->myNum) {
@@ -2454,20 +7046,6 @@ IMXEXACheckComposite(
 		return FALSE;
 	}
 
-	/* Do not accelerate masks of component alpha (used for sub-pixel glyph anti-aliasing). */
-	if (NULL != pPictureMask && pPictureMask->componentAlpha) {
-
-#if IMX_EXA_DEBUG_CHECK_COMPOSITE
-
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXACheckComposite called with mask of component alpha\n");
-#endif
-		imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
-		imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
-		imxexa_update_pixmap_on_failure(fPtr, fPixmapMskPtr);
-		return FALSE;
-	}
-
 	/* Do not accelerate if mask format is not supported by backend. */
 	if (NULL != pPictureMask &&
 		pPictureMask->format != PICT_a8 &&
@@ -2528,53 +7106,64 @@ IMXEXACheckComposite(
 		return FALSE;
 	}
 
-	/* Filter out unsupported blending ops. */
-	Bool success = FALSE;
+	/* Masks of component alpha (used for sub-pixel glyph anti-aliasing) need per-channel blend factors, */
+	/* which the GPU lacks; pixman does those on the CPU for any op, given whole bytes per pixel. */
+	const Bool ca = NULL != pPictureMask && pPictureMask->componentAlpha;
 
-	switch (op) {
-	case PictOpSrc:
-	case PictOpOver:
-		success = TRUE;
-		break;
-	case PictOpAdd:
-		if (IMXEXA_BACKEND_Z160 == imxPtr->backend)
-			success = TRUE;
-		break;
-	case PictOpIn:
-		if (IMXEXA_BACKEND_Z160 == imxPtr->backend)
-			success = TRUE;
-		break;
-/*	case PictOpClear:
-	case PictOpSrc:
-	case PictOpDst:
-	case PictOpOver:
-	case PictOpOverReverse:
-	case PictOpIn:
-	case PictOpInReverse:
-	case PictOpOut:
-	case PictOpOutReverse:
-	case PictOpAtop:
-	case PictOpAtopReverse:
-	case PictOpXor:
-	case PictOpAdd:
-	case PictOpSaturate:
-*/	}
+	if (ca && (PictOpSaturate < op ||
+		0 != (PICT_FORMAT_BPP(pPictureSrc->format) & 7) ||
+		0 != (PICT_FORMAT_BPP(pPictureDst->format) & 7))) {
 
-	if (success)
-		return TRUE;
+#if IMX_EXA_DEBUG_CHECK_COMPOSITE
+
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"IMXEXACheckComposite called with mask of component alpha for unsupported op (%s) or format\n",
+			imxexa_string_from_pict_op(op));
+#endif
+		imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
+		imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
+		imxexa_update_pixmap_on_failure(fPtr, fPixmapMskPtr);
+		return FALSE;
+	}
+
+	/* Filter out unsupported blending ops, once reduced to what they amount to for the formats. */
+	const int reduced_op = imxexa_reduce_pict_op(op, pPictureSrc, pPictureMask, pPictureDst);
+
+	if (!ca && (PictOpSaturate < reduced_op || 0 == (fPtr->composOps & 1U << reduced_op))) {
 
 #if IMX_EXA_DEBUG_CHECK_COMPOSITE
 
-	xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-		"IMXEXACheckComposite called with unsupported op (%s)\n",
-		imxexa_string_from_pict_op(op));
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			"IMXEXACheckComposite called with unsupported op (%s)\n",
+			imxexa_string_from_pict_op(op));
 #endif
+		imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
+		imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
+		imxexa_update_pixmap_on_failure(fPtr, fPixmapMskPtr);
+		return FALSE;
+	}
 
-	imxexa_update_pixmap_on_failure(fPtr, fPixmapDstPtr);
-	imxexa_update_pixmap_on_failure(fPtr, fPixmapSrcPtr);
-	imxexa_update_pixmap_on_failure(fPtr, fPixmapMskPtr);
+	/* Op is fit for acceleration; now make sure its pixmaps are too. Sysmem pixmaps in the way */
+	/* get promoted only here, lest they get promoted for an op that gets rejected anyway. */
+	PixmapPtr pPixmaps[] = { pPixmapDst, pPixmapSrc, pPixmapMsk };
 
-	return FALSE;
+	if (!imxexa_promote_blocking_pixmaps(imxPtr->backend, fPtr, pPixmaps, 3))
+		return FALSE;
+
+	/* Keep demoted pixmaps in sysmem until they prove worthy of gpumem again. */
+	const Bool held =
+		imxexa_is_pixmap_held_in_sysmem(fPtr, fPixmapDstPtr) |
+		imxexa_is_pixmap_held_in_sysmem(fPtr, fPixmapSrcPtr) |
+		imxexa_is_pixmap_held_in_sysmem(fPtr, fPixmapMskPtr);
+
+	if (held)
+		return FALSE;
+
+	/* Pixman reads a repeating src in place, which takes rows of whole words. */
+	if (ca && 0 != (fPixmapSrcPtr->surfDef.stride & 3))
+		return FALSE;
+
+	return TRUE;
 }
 
 static Bool
@@ -2663,7 +7252,7 @@ imxexa_prepare_surface_alias(
 	/* To preserve access exclusivity, make sure the surface we just assigned an alias to */
 	/* is not being accessed by the GPU. To avoid future access conflicts, all sanctioned */
 	/* access to the surface of this pixmap will be via its alias. */
-	c2dWaitForTimestamp(fPtr->gpuContext);
+	imxexa_wait_pixmap_idle(fPtr, fPixmapPtr);
 
 	return TRUE;
 }
@@ -2698,7 +7287,7 @@ IMXEXAPrepareComposite(
 	fPtr->pPixSrc = fPixmapSrcPtr;
 	fPtr->pPixMsk = fPixmapMskPtr;
 
-	/* Set up draw state. */
+	/* Set up draw state; surfaces get unlocked right away, before any alias of theirs takes over. */
 	if (!imxexa_unlock_surface(fPtr, fPixmapDstPtr) ||
 		!imxexa_unlock_surface(fPtr, fPixmapSrcPtr) ||
 		!imxexa_unlock_surface(fPtr, fPixmapMskPtr)) {
@@ -2706,6 +7295,45 @@ IMXEXAPrepareComposite(
 		return FALSE;
 	}
 
+	/* Composites with a mask of component alpha get done by the CPU in full, and need no GPU state. */
+	/* Whatever may fail is set up here, so that EXA can still fall back; rects are clipped to dst, */
+	/* hence no wider than a chunk holds. */
+	fPtr->composCA = NULL != pPictureMask && pPictureMask->componentAlpha;
+
+	if (fPtr->composCA) {
+
+		if (NULL == fPtr->caRows)
+			fPtr->caRows = malloc(3 * IMX_EXA_CA_CHUNK_BYTES);
+
+		if (NULL == fPtr->caRows ||
+			IMX_EXA_CA_CHUNK_BYTES / 4 < fPixmapDstPtr->width ||
+			NULL == imxexa_map_pixmap(fPtr, fPixmapDstPtr) ||
+			NULL == imxexa_map_pixmap(fPtr, fPixmapSrcPtr) ||
+			NULL == imxexa_map_pixmap(fPtr, fPixmapMskPtr)) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAPrepareComposite failed to set up CPU composite with mask of component alpha\n");
+			return FALSE;
+		}
+
+		fPtr->composOp = op;
+		fPtr->composSrcFormat = pPictureSrc->format;
+		fPtr->composMskFormat = pPictureMask->format;
+		fPtr->composDstFormat = pPictureDst->format;
+		fPtr->composSrcRepeat = pPictureSrc->repeat ? pPictureSrc->repeatType : RepeatNone;
+		fPtr->composConvert = FALSE;
+		fPtr->composCopy = FALSE;
+		fPtr->opCpuCapable = FALSE;
+		fPtr->opOnGpu = FALSE;
+
+		imxexa_update_pixmap_on_use(fPtr, fPixmapDstPtr);
+		imxexa_update_pixmap_on_use(fPtr, fPixmapSrcPtr);
+		imxexa_update_pixmap_on_use(fPtr, fPixmapMskPtr);
+		++fPtr->heartbeat;
+
+		return TRUE;
+	}
+
 	if (!imxexa_prepare_surface_alias(
 			imxPtr->backend,
 			pPictureDst->format,
@@ -2740,45 +7368,59 @@ IMXEXAPrepareComposite(
 		return FALSE;
 	}
 
-	switch (op) {
-	case PictOpSrc:
-		c2dSetBlendMode(fPtr->gpuContext, C2D_ALPHA_BLEND_NONE);
-		break;
-	case PictOpOver:
-		c2dSetBlendMode(fPtr->gpuContext, C2D_ALPHA_BLEND_SRCOVER);
-		break;
-	case PictOpAdd:
-		c2dSetBlendMode(fPtr->gpuContext, C2D_ALPHA_BLEND_ADDITIVE);
-		break;
-	case PictOpIn:
-		c2dSetBlendMode(fPtr->gpuContext, C2D_ALPHA_BLEND_SRCIN);
-		break;
-	default:
+	fPtr->composOp = imxexa_reduce_pict_op(op, pPictureSrc, pPictureMask, pPictureDst);
+
+	if (PictOpSaturate < fPtr->composOp || 0 == (fPtr->composOps & 1U << fPtr->composOp))
 		return FALSE;
-	}
+
+	imxexa_set_blend_mode(fPtr, imxexa_pict_op_blends[fPtr->composOp].mode);
 
 	fPtr->composConvert = pPictureDst->format != pPictureSrc->format;
 
-	c2dSetDstSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapDstPtr));
-	c2dSetSrcSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapSrcPtr));
+	/* Unmasked Src, which Over from an opaque format reduces to, into the same format is a plain */
+	/* copy, which small rects can get done by the CPU. */
+	fPtr->composCopy = !fPtr->composConvert && NULL == pPixmapMask && !pPictureSrc->repeat &&
+		PictOpSrc == fPtr->composOp;
+
+	fPtr->opCpuCapable = fPtr->cpuSmallOps && fPtr->composCopy &&
+		0 == (fPixmapDstPtr->bitsPerPixel & 7) &&
+		fPixmapDstPtr->bitsPerPixel == fPixmapSrcPtr->bitsPerPixel;
+	fPtr->opOnGpu = FALSE;
+
+	imxexa_set_dst_surface(fPtr, imxexa_get_preferred_surface(fPixmapDstPtr));
+	imxexa_set_src_surface(fPtr, imxexa_get_preferred_surface(fPixmapSrcPtr));
 
 	/* Repeating source is a special case of pattern fill on the Z160 backend */
 	/* (which is an anachronism; c2d_z160 needs to be brought up to date and on par with c2d_z430) */
 	if (pPictureSrc->repeat && IMXEXA_BACKEND_Z160 == imxPtr->backend) {
 
-		c2dSetBrushSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapSrcPtr), NULL);
+		imxexa_set_brush_surface(fPtr, imxexa_get_preferred_surface(fPixmapSrcPtr));
 		fPtr->composRepeat = TRUE;
 	}
 	else {
-		c2dSetBrushSurface(fPtr->gpuContext, NULL, NULL);
+		imxexa_set_brush_surface(fPtr, NULL);
 		fPtr->composRepeat = FALSE;
 	}
 
 	/* Set up mask, but watch out for Z160 doing pattern fill - combining the two can produce hard lock-ups. */
 	if (NULL != pPixmapMask && !fPtr->composRepeat)
-		c2dSetMaskSurface(fPtr->gpuContext, imxexa_get_preferred_surface(fPixmapMskPtr), NULL);
+		imxexa_set_mask_surface(fPtr, imxexa_get_preferred_surface(fPixmapMskPtr));
 	else
-		c2dSetMaskSurface(fPtr->gpuContext, NULL, NULL);
+		imxexa_set_mask_surface(fPtr, NULL);
+
+	/* Clear amounts to a fill with zero, whatever src and mask. */
+	if (PictOpClear == fPtr->composOp) {
+
+		imxexa_set_src_surface(fPtr, NULL);
+		imxexa_set_brush_surface(fPtr, NULL);
+		imxexa_set_mask_surface(fPtr, NULL);
+		c2dSetFgColor(fPtr->gpuContext, 0);
+
+		fPtr->composRepeat = FALSE;
+	}
+
+	imxexa_set_plain_sampling(fPtr);
+	imxexa_set_rop(fPtr, IMXEXA_ROP4_COPY);
 
 	/* Mark pixmaps as used and update driver's heartbeat. */
 	imxexa_update_pixmap_on_use(fPtr, fPixmapDstPtr);
@@ -2831,35 +7473,68 @@ IMXEXAComposite(
 	IMXPtr imxPtr = IMXPTR(pScrn);
 	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
-	C2D_RECT rectDst = {
-		.x = dstX,
-		.y = dstY,
-		.width = width,
-		.height = height
-	};
+	/* Dst leaves dst as it is. */
+	if (PictOpDst == fPtr->composOp)
+		return;
 
-	C2D_RECT rectSrc = {
-		.x = srcX,
-		.y = srcY,
-		.width = width,
-		.height = height
-	};
+	if (fPtr->composCA) {
 
-	c2dSetDstRectangle(fPtr->gpuContext, &rectDst);
-	c2dSetSrcRectangle(fPtr->gpuContext, &rectSrc);
+		if (!imxexa_cpu_composite_ca(fPtr, fPtr->composOp,
+				srcX, srcY, maskX, maskY, dstX, dstY, width, height)) {
 
-	C2D_STATUS r;
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAComposite failed to perform CPU composite with mask of component alpha\n");
+		}
 
-	if (fPtr->composRepeat)
-		r = c2dDrawRect(fPtr->gpuContext, C2D_PARAM_PATTERN_BIT);
-	else
-		r = c2dDrawBlit(fPtr->gpuContext);
+		return;
+	}
 
-	if (C2D_STATUS_OK != r) {
+	/* Composites amounting to a copy go to the CPU if cheaper. */
+	const Bool cpu_done = fPtr->composCopy &&
+		imxexa_cpu_is_cheaper(fPtr, width, height, fPtr->costCpuCopy) &&
+		imxexa_cpu_copy(fPtr, srcX, srcY, dstX, dstY, width, height);
 
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			"IMXEXAComposite failed to perform GPU draw (code: 0x%08x) - %s\n",
-			r, (fPtr->composRepeat ? "pattern fill" : "blit"));
+	if (!cpu_done) {
+
+		C2D_RECT rectDst = {
+			.x = dstX,
+			.y = dstY,
+			.width = width,
+			.height = height
+		};
+
+		C2D_RECT rectSrc = {
+			.x = srcX,
+			.y = srcY,
+			.width = width,
+			.height = height
+		};
+
+		imxexa_unlock_op_surfaces(fPtr);
+
+		c2dSetDstRectangle(fPtr->gpuContext, &rectDst);
+		c2dSetSrcRectangle(fPtr->gpuContext, &rectSrc);
+
+		C2D_STATUS r;
+
+		if (PictOpClear == fPtr->composOp)
+			r = c2dDrawRect(fPtr->gpuContext, C2D_PARAM_FILL_BIT);
+		else if (fPtr->composRepeat)
+			r = c2dDrawRect(fPtr->gpuContext, C2D_PARAM_PATTERN_BIT);
+		else
+			r = c2dDrawBlit(fPtr->gpuContext);
+
+		if (C2D_STATUS_OK != r) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+				"IMXEXAComposite failed to perform GPU draw (code: 0x%08x) - %s\n",
+				r, (PictOpClear == fPtr->composOp ? "fill" : fPtr->composRepeat ? "pattern fill" : "blit"));
+		}
+		else {
+
+			imxexa_mark_pixmap_dirty(fPtr->pPixDst, dstX, dstY, dstX + width, dstY + height);
+			imxexa_queue_draw(fPtr);
+		}
 	}
 
 #if IMX_EXA_DEBUG_INSTRUMENT_SYNCS
@@ -2914,8 +7589,9 @@ IMXEXADoneComposite(
 
 	if (NULL != fPtr->gpuContext) {
 
-		/* Flush pending operations to the GPU. */
-		c2dFlush(fPtr->gpuContext);
+		/* Leave the draws of the op queued; they get flushed in batches. */
+		if (fPtr->opOnGpu)
+			imxexa_record_op_serial(fPtr);
 
 		fPtr->gpuSynced = FALSE;
 
@@ -2953,6 +7629,7 @@ IMX_EXA_ScreenInit(int scrnIndex, ScreenPtr pScreen)
 
 	/* Access driver specific data associated with the screen. */
 	IMXPtr imxPtr = IMXPTR(pScrn);
+	IMXEXAPtr fPtr = IMXEXAPTR(imxPtr);
 
 	/* Compute the number of bytes per pixel */
 	unsigned bytesPerPixel = ((pScrn->bitsPerPixel + 7) / 8);
@@ -3003,6 +7680,7 @@ IMX_EXA_ScreenInit(int scrnIndex, ScreenPtr pScreen)
 
 	/* Required */
 	imxPtr->exaDriverPtr->WaitMarker = IMXEXAWaitMarker;
+	imxPtr->exaDriverPtr->MarkSync = IMXEXAMarkSync;
 
 	/* Solid fill - required */
 	imxPtr->exaDriverPtr->PrepareSolid = IMXEXAPrepareSolid;
@@ -3049,10 +7727,197 @@ IMX_EXA_ScreenInit(int scrnIndex, ScreenPtr pScreen)
 		return FALSE;
 	}
 
+	/* Select the policy for evicting pixmaps from gpumem. */
+	fPtr->evictionPolicy = imxexa_eviction_policies;
+
+	const char* const policy = xf86GetOptValString(imxPtr->options, OPTION_EVICTION_POLICY);
+
+	if (NULL != policy) {
+
+		unsigned i;
+
+		for (i = 0; i < sizeof(imxexa_eviction_policies) / sizeof(imxexa_eviction_policies[0]); ++i)
+			if (0 == xf86NameCmp(policy, imxexa_eviction_policies[i].name))
+				break;
+
+		if (sizeof(imxexa_eviction_policies) / sizeof(imxexa_eviction_policies[0]) > i) {
+
+			fPtr->evictionPolicy = imxexa_eviction_policies + i;
+		}
+		else {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				"Unknown eviction policy \"%s\", using \"%s\"\n",
+				policy, fPtr->evictionPolicy->name);
+		}
+	}
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"Using %s eviction policy\n", fPtr->evictionPolicy->name);
+
+	/* Set up the placement policy thresholds. */
+	fPtr->minSurfArea = IMX_EXA_MIN_SURF_AREA;
+	fPtr->minSurfHeight = IMX_EXA_MIN_SURF_HEIGHT;
+	fPtr->maxSurfDim = IMX_EXA_MAX_SURF_DIM;
+
+	xf86GetOptValInteger(imxPtr->options, OPTION_MIN_SURF_AREA, &fPtr->minSurfArea);
+	xf86GetOptValInteger(imxPtr->options, OPTION_MIN_SURF_HEIGHT, &fPtr->minSurfHeight);
+	xf86GetOptValInteger(imxPtr->options, OPTION_MAX_SURF_DIM, &fPtr->maxSurfDim);
+
+	if (0 > fPtr->minSurfArea)
+		fPtr->minSurfArea = 0;
+
+	if (0 > fPtr->minSurfHeight)
+		fPtr->minSurfHeight = 0;
+
+	if (IMX_EXA_MAX_SURF_DIM < fPtr->maxSurfDim || 0 >= fPtr->maxSurfDim)
+		fPtr->maxSurfDim = IMX_EXA_MAX_SURF_DIM;
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		"Placing pixmaps in gpumem from %d pixels of area, %d of height, up to %d of width and height\n",
+		fPtr->minSurfArea, fPtr->minSurfHeight, fPtr->maxSurfDim);
+
+	/* Set up atlases for small pixmaps. Their sub-surfaces keep the pixmap height, so atlases are */
+	/* off by default on Z160 for its trouble with short surfaces. */
+	fPtr->useAtlas = xf86ReturnOptValBool(imxPtr->options, OPTION_PIXMAP_ATLAS,
+		IMXEXA_BACKEND_Z160 != imxPtr->backend);
+
+	if (fPtr->useAtlas) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"Sub-allocating pixmaps of up to %dx%d from %dx%d atlases\n",
+			IMX_EXA_ATLAS_MAX_PIXMAP_WIDTH, IMX_EXA_ATLAS_MAX_PIXMAP_HEIGHT,
+			IMX_EXA_ATLAS_WIDTH, IMX_EXA_ATLAS_HEIGHT);
+	}
+
+	/* Set up the heap over spare framebuffer memory; it gets sized along with the GPU context. */
+	fPtr->useVidmem = xf86ReturnOptValBool(imxPtr->options, OPTION_VIDMEM_HEAP, TRUE);
+
+	/* Set up routing of small ops to the CPU; unless given, its costs get measured at startup. */
+	fPtr->cpuSmallOps = xf86ReturnOptValBool(imxPtr->options, OPTION_CPU_SMALL_OPS, TRUE);
+	fPtr->costGpuDraw = IMX_EXA_COST_GPU_DRAW;
+	fPtr->costLock = IMX_EXA_COST_LOCK;
+	fPtr->costCpuFill = IMX_EXA_COST_CPU_FILL;
+	fPtr->costCpuCopy = IMX_EXA_COST_CPU_COPY;
+
+	Bool calibrate = fPtr->cpuSmallOps;
+	const char* const costs = xf86GetOptValString(imxPtr->options, OPTION_CPU_OP_COSTS);
+
+	if (NULL != costs) {
+
+		unsigned draw_ns, lock_ns, fill_ps, copy_ps;
+
+		if (4 == sscanf(costs, "%u,%u,%u,%u", &draw_ns, &lock_ns, &fill_ps, &copy_ps)) {
+
+			fPtr->costGpuDraw = draw_ns;
+			fPtr->costLock = lock_ns;
+			fPtr->costCpuFill = fill_ps;
+			fPtr->costCpuCopy = copy_ps;
+
+			calibrate = FALSE;
+		}
+		else {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				"Malformed small op costs \"%s\", expected \"draw ns,lock ns,fill ps,copy ps\"\n",
+				costs);
+		}
+	}
+
+	/* Set up compression of the sysmem backups of evicted pixmaps. */
+	int pack_min_kb = IMX_EXA_PACK_MIN_BYTES / 1024;
+
+	fPtr->packEvicted = xf86ReturnOptValBool(imxPtr->options, OPTION_COMPRESS_EVICTED, FALSE);
+	xf86GetOptValInteger(imxPtr->options, OPTION_COMPRESS_EVICTED_MIN_KB, &pack_min_kb);
+
+	fPtr->packMinBytes = 0 < pack_min_kb ? pack_min_kb * 1024 : 0;
+
+	if (fPtr->packEvicted) {
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"Compressing backups of evicted pixmaps of %u KB or more\n",
+			fPtr->packMinBytes / 1024);
+	}
+
+	/* Set up the gpumem budget and its watermarks. */
+	int budget_kb = 0;
+	int high_pct = IMX_EXA_GPUMEM_HIGH_WATERMARK;
+	int low_pct = IMX_EXA_GPUMEM_LOW_WATERMARK;
+
+	xf86GetOptValInteger(imxPtr->options, OPTION_GPUMEM_BUDGET_KB, &budget_kb);
+	xf86GetOptValInteger(imxPtr->options, OPTION_GPUMEM_HIGH_WATERMARK, &high_pct);
+	xf86GetOptValInteger(imxPtr->options, OPTION_GPUMEM_LOW_WATERMARK, &low_pct);
+
+	if (0 >= high_pct || 100 < high_pct)
+		high_pct = IMX_EXA_GPUMEM_HIGH_WATERMARK;
+
+	if (0 > low_pct || high_pct < low_pct)
+		low_pct = high_pct * IMX_EXA_GPUMEM_LOW_WATERMARK / IMX_EXA_GPUMEM_HIGH_WATERMARK;
+
+	fPtr->gpumemBudget = 0 < budget_kb ? budget_kb * 1024U : 0;
+	fPtr->gpumemHighMark = fPtr->gpumemBudget / 100 * high_pct;
+	fPtr->gpumemLowMark = fPtr->gpumemBudget / 100 * low_pct;
+	fPtr->idleEvicting = FALSE;
+	fPtr->idleStallStamp = 0;
+
+	/* Set up compaction of gpumem at idle time. */
+	fPtr->defragGpumem = xf86ReturnOptValBool(imxPtr->options, OPTION_GPUMEM_DEFRAG, FALSE);
+	fPtr->defragmenting = FALSE;
+	fPtr->defragCheckStamp = 0;
+
 	/* Connect to the GPU if accelerated backend in use. */
 	if (!imxexa_gpu_context_acquire(pScrn))
 		imxPtr->backend = IMXEXA_BACKEND_NONE;
 
+	/* Set up the raster ops done by the GPU, keeping only those matching fb in practice. */
+	fPtr->solidAlus = imxexa_alu_caps[imxPtr->backend].solid;
+	fPtr->copyAlus = imxexa_alu_caps[imxPtr->backend].copy;
+
+	if (IMXEXA_BACKEND_NONE != imxPtr->backend)
+		imxexa_check_rops(pScrn);
+
+	/* Set up the Porter-Duff ops done by the GPU, keeping only those matching pixman in practice. */
+	fPtr->composOps = imxexa_pict_op_caps[imxPtr->backend];
+
+	if (IMXEXA_BACKEND_NONE != imxPtr->backend)
+		imxexa_check_blends(pScrn);
+
+	if (IMXEXA_BACKEND_NONE != imxPtr->backend && fPtr->cpuSmallOps) {
+
+		if (calibrate)
+			imxexa_calibrate_cpu_op_costs(pScrn);
+
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			"Doing small ops on the CPU when cheaper; costs: GPU draw %u ns, lock %u ns, "
+			"CPU fill %u ps/pixel, CPU copy %u ps/pixel\n",
+			fPtr->costGpuDraw, fPtr->costLock, fPtr->costCpuFill, fPtr->costCpuCopy);
+	}
+
+	/* Flush queued draws, enforce the gpumem budget and compact gpumem from the block and wakeup */
+	/* handlers, i.e. before the server sleeps and at idle time. */
+	fPtr->pendingDraws = 0;
+	fPtr->flushRateBase = fPtr->numFlushes;
+	fPtr->flushRateStamp = GetTimeInMillis();
+
+	if (IMXEXA_BACKEND_NONE != imxPtr->backend) {
+
+		RegisterBlockAndWakeupHandlers(imxexa_block_handler, imxexa_wakeup_handler, pScrn);
+
+		if (0 != fPtr->gpumemBudget) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				"Using gpumem budget of %u KB, evicting at idle time from %d%% down to %d%% of it\n",
+				fPtr->gpumemBudget / 1024, high_pct, low_pct);
+		}
+
+		if (fPtr->defragGpumem) {
+
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				"Compacting gpumem at idle time from %d%% of fragmentation\n",
+				IMX_EXA_DEFRAG_THRESHOLD);
+		}
+	}
+
 	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
 		"Using %s backend\n",
 		(imxPtr->backend == IMXEXA_BACKEND_Z160 ? "Z160" :
@@ -3071,6 +7936,10 @@ IMX_EXA_CloseScreen(int scrnIndex, ScreenPtr pScreen)
 	/* Access driver specific data associated with the screen. */
 	IMXPtr imxPtr = IMXPTR(pScrn);
 
+	/* Stop flushing queued draws, enforcing the gpumem budget and compacting gpumem. */
+	if (IMXEXA_BACKEND_NONE != imxPtr->backend)
+		RemoveBlockAndWakeupHandlers(imxexa_block_handler, imxexa_wakeup_handler, pScrn);
+
 	/* Disconnect from the GPU if accelerated backend in use. */
 	imxexa_gpu_context_release(pScrn);
 
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2011 Genesi USA, Inc. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Lossless pixel packer for the sysmem backups of evicted pixmaps.
+ *
+ * Tuned for UI content: rows identical to the row above collapse into a
+ * single token, and within a row, runs of a solid color collapse into a
+ * token carrying the color once. Everything else is stored verbatim.
+ *
+ * Packed stream is a sequence of tokens, each a 3-byte header (type,
+ * little-endian 16-bit count) followed by the payload:
+ *
+ *	PACK_ROWS	count rows equal to the row above; no payload
+ *	PACK_RUN	count pixels of the color that follows
+ *	PACK_LIT	count pixels that follow verbatim
+ *
+ * Pixel tokens never straddle rows.
+ */
+
+#include <xf86.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#define PACK_ROWS			0
+#define PACK_RUN			1
+#define PACK_LIT			2
+
+#define PACK_HEADER_BYTES	3
+#define PACK_MAX_COUNT		0xffff
+
+/* Shortest run of a solid color worth a token of its own. */
+#define PACK_MIN_RUN		3
+
+static inline uint32_t
+imxexa_pack_load_pixel(
+	const uint8_t* p,
+	int bytesPerPixel)
+{
+	switch (bytesPerPixel) {
+	case 1:
+		return *p;
+	case 2:
+		return *(const uint16_t*) p;
+	case 3:
+		return p[0] | p[1] << 8 | p[2] << 16;
+	}
+
+	return *(const uint32_t*) p;
+}
+
+static inline uint8_t*
+imxexa_pack_emit(
+	uint8_t* dst,
+	const uint8_t* dst_end,
+	int type,
+	unsigned count,
+	const uint8_t* payload,
+	unsigned payload_bytes)
+{
+	if (NULL == dst || dst_end - dst < (long) (PACK_HEADER_BYTES + payload_bytes))
+		return NULL;
+
+	dst[0] = type;
+	dst[1] = count & 0xff;
+	dst[2] = count >> 8;
+
+	if (0 != payload_bytes)
+		memcpy(dst + PACK_HEADER_BYTES, payload, payload_bytes);
+
+	return dst + PACK_HEADER_BYTES + payload_bytes;
+}
+
+static inline uint8_t*
+imxexa_pack_emit_literals(
+	uint8_t* dst,
+	const uint8_t* dst_end,
+	const uint8_t* src,
+	unsigned count,
+	int bytesPerPixel)
+{
+	while (0 != count && NULL != dst) {
+
+		const unsigned n = PACK_MAX_COUNT < count ? PACK_MAX_COUNT : count;
+
+		dst = imxexa_pack_emit(dst, dst_end, PACK_LIT, n, src, n * bytesPerPixel);
+
+		src += n * bytesPerPixel;
+		count -= n;
+	}
+
+	return dst;
+}
+
+/*
+ * Pack width x height pixels of bytesPerPixel bytes from src of the specified pitch into dst.
+ * Returns the packed size, or 0 if that would exceed dst_bytes.
+ */
+unsigned
+imxexa_pack_pixels(
+	void* dst,
+	unsigned dst_bytes,
+	const void* src,
+	int pitch,
+	int width,
+	int height,
+	int bytesPerPixel)
+{
+	uint8_t* out = dst;
+	const uint8_t* const out_end = out + dst_bytes;
+
+	const uint8_t* row = src;
+	const int line_bytes = width * bytesPerPixel;
+	unsigned repeats = 0;
+	int y;
+
+	for (y = 0; y < height; ++y, row += pitch) {
+
+		/* Is row identical to the one above? */
+		if (0 != y && 0 == memcmp(row, row - pitch, line_bytes)) {
+
+			if (PACK_MAX_COUNT == ++repeats) {
+
+				out = imxexa_pack_emit(out, out_end, PACK_ROWS, repeats, NULL, 0);
+				repeats = 0;
+			}
+
+			continue;
+		}
+
+		if (0 != repeats) {
+
+			out = imxexa_pack_emit(out, out_end, PACK_ROWS, repeats, NULL, 0);
+			repeats = 0;
+		}
+
+		int lit = 0;
+		int x = 0;
+
+		while (x < width) {
+
+			const uint32_t pixel = imxexa_pack_load_pixel(row + x * bytesPerPixel, bytesPerPixel);
+			int run = 1;
+
+			while (x + run < width && PACK_MAX_COUNT > run &&
+				pixel == imxexa_pack_load_pixel(row + (x + run) * bytesPerPixel, bytesPerPixel)) {
+
+				++run;
+			}
+
+			if (PACK_MIN_RUN <= run) {
+
+				out = imxexa_pack_emit_literals(out, out_end,
+					row + lit * bytesPerPixel, x - lit, bytesPerPixel);
+
+				out = imxexa_pack_emit(out, out_end, PACK_RUN, run,
+					row + x * bytesPerPixel, bytesPerPixel);
+
+				lit = x + run;
+			}
+
+			x += run;
+		}
+
+		out = imxexa_pack_emit_literals(out, out_end,
+			row + lit * bytesPerPixel, width - lit, bytesPerPixel);
+
+		if (NULL == out)
+			return 0;
+	}
+
+	if (0 != repeats)
+		out = imxexa_pack_emit(out, out_end, PACK_ROWS, repeats, NULL, 0);
+
+	if (NULL == out)
+		return 0;
+
+	return out - (uint8_t*) dst;
+}
+
+/*
+ * Unpack src of src_bytes into width x height pixels of bytesPerPixel bytes at dst of the specified pitch.
+ * Returns FALSE on malformed input.
+ */
+Bool
+imxexa_unpack_pixels(
+	void* dst,
+	int pitch,
+	int width,
+	int height,
+	int bytesPerPixel,
+	const void* src,
+	unsigned src_bytes)
+{
+	const uint8_t* in = src;
+	const uint8_t* const in_end = in + src_bytes;
+
+	uint8_t* row = dst;
+	const int line_bytes = width * bytesPerPixel;
+	int x = 0;
+	int y = 0;
+
+	uint8_t* p;
+	uint8_t* p_end;
+	uint16_t pixel16;
+	uint32_t pixel32;
+	int i;
+
+	while (y < height) {
+
+		if (in_end - in < PACK_HEADER_BYTES)
+			return FALSE;
+
+		const int type = in[0];
+		const int count = in[1] | in[2] << 8;
+
+		in += PACK_HEADER_BYTES;
+
+		switch (type) {
+		case PACK_ROWS:
+
+			if (0 != x || 0 == y || height - y < count)
+				return FALSE;
+
+			for (i = 0; i < count; ++i, ++y, row += pitch)
+				memcpy(row, row - pitch, line_bytes);
+
+			continue;
+
+		case PACK_RUN:
+
+			if (width - x < count || in_end - in < bytesPerPixel)
+				return FALSE;
+
+			p = row + x * bytesPerPixel;
+			p_end = p + count * bytesPerPixel;
+
+			/* Color in the stream may be unaligned. */
+			switch (bytesPerPixel) {
+			case 1:
+				memset(p, in[0], count);
+				break;
+			case 2:
+				memcpy(&pixel16, in, sizeof(pixel16));
+				for (; p < p_end; p += 2)
+					*(uint16_t*) p = pixel16;
+				break;
+			case 4:
+				memcpy(&pixel32, in, sizeof(pixel32));
+				for (; p < p_end; p += 4)
+					*(uint32_t*) p = pixel32;
+				break;
+			default:
+				for (; p < p_end; p += bytesPerPixel)
+					memcpy(p, in, bytesPerPixel);
+				break;
+			}
+
+			in += bytesPerPixel;
+			break;
+
+		case PACK_LIT:
+
+			if (width - x < count || in_end - in < count * bytesPerPixel)
+				return FALSE;
+
+			memcpy(row + x * bytesPerPixel, in, count * bytesPerPixel);
+
+			in += count * bytesPerPixel;
+			break;
+
+		default:
+			return FALSE;
+		}
+
+		x += count;
+
+		/* Has row been completed? */
+		if (width == x) {
+
+			x = 0;
+			++y;
+			row += pitch;
+		}
+	}
+
+	return TRUE;
+}
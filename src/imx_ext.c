@@ -28,6 +28,7 @@
 #include <extension.h>
 #include <xorg/extnsionst.h>
 #include <xorg/xf86Module.h>
+#include <stdlib.h>
 
 #if GET_ABI_MAJOR(ABI_VIDEODRV_VERSION) < 12
 #	define compat_swapl(x, n) swapl(x,n)
@@ -47,13 +48,44 @@ IMXGetPixmapProperties(
 	void** pPhysAddr,	/* OUT: pixmap phys addr, NULL if not GPU mem */
 	int* pPitch);		/* OUT: pixmap pitch, 0 if not in GPU mem */
 
+extern void
+IMXUnpinPixmap(
+	PixmapPtr pPixmap);	/* IN: pixmap pinned by IMXGetPixmapProperties */
+
 static DISPATCH_PROC(Proc_IMX_EXT_Dispatch);
 static DISPATCH_PROC(Proc_IMX_EXT_GetPixmapPhysAddr);
+static DISPATCH_PROC(Proc_IMX_EXT_ReleasePixmapPhysAddr);
 static DISPATCH_PROC(SProc_IMX_EXT_Dispatch);
 static DISPATCH_PROC(SProc_IMX_EXT_GetPixmapPhysAddr);
+static DISPATCH_PROC(SProc_IMX_EXT_ReleasePixmapPhysAddr);
+
+/* Resource type of the pins held by clients. The resource value records the pinned pixmap */
+/* along with the client's XID for it, which outlives the pixmap resource as far as pins go. */
+static RESTYPE RT_IMX_EXT_PIN;
+
+typedef struct {
+	PixmapPtr	pPixmap;
+	XID		pixmap;
+} IMX_EXT_PinRec;
+
+static int
+IMX_EXT_DeletePin(pointer value, XID id)
+{
+	IMX_EXT_PinRec* pin = (IMX_EXT_PinRec*)value;
+	PixmapPtr pPixmap = pin->pPixmap;
+
+	/* Give back the pin, then the reference on the pixmap that kept it alive. */
+	IMXUnpinPixmap(pPixmap);
+	(*pPixmap->drawable.pScreen->DestroyPixmap)(pPixmap);
+
+	free(pin);
+	return Success;
+}
 
 void IMX_EXT_Init()
 {
+	RT_IMX_EXT_PIN = CreateNewResourceType(IMX_EXT_DeletePin, "IMXPixmapPin");
+
 	AddExtension(IMX_EXT_NAME, 0, 0, Proc_IMX_EXT_Dispatch, SProc_IMX_EXT_Dispatch,
 		NULL, StandardMinorOpcode);
 }
@@ -84,12 +116,34 @@ Proc_IMX_EXT_GetPixmapPhysAddr(ClientPtr client)
 		void* pPhysAddr;
 		int pitch;
 
-		/* Query the pixmap properties from the driver. */
+		/* Query the pixmap properties from the driver, which pins the pixmap. */
 		if (IMXGetPixmapProperties(pPixmap, &pPhysAddr, &pitch))
 		{
-			rep.pixmapState = IMX_EXT_PixmapFramebuffer;
-			rep.pixmapPhysAddr = (CARD32)pPhysAddr;
-			rep.pixmapPitch = pitch;
+			/* Record the pin as a resource of the client, so that it gets released */
+			/* along with the client at the latest. The pin holds a pixmap reference. */
+			/* Should recording fail, AddResource releases the pin by itself; */
+			/* should there be no record, the pin gets released right away. */
+			IMX_EXT_PinRec* pin = malloc(sizeof(IMX_EXT_PinRec));
+
+			if (NULL != pin)
+			{
+				pin->pPixmap = pPixmap;
+				pin->pixmap = stuff->pixmap;
+				++pPixmap->refcnt;
+			} else {
+
+				IMXUnpinPixmap(pPixmap);
+			}
+
+			if (NULL != pin && AddResource(FakeClientID(client->index), RT_IMX_EXT_PIN, pin))
+			{
+				rep.pixmapState = IMX_EXT_PixmapFramebuffer;
+				rep.pixmapPhysAddr = (CARD32)pPhysAddr;
+				rep.pixmapPitch = pitch;
+			} else {
+
+				rep.pixmapState = IMX_EXT_PixmapOther;
+			}
 
 		/* Pixmap was defined, but is not in frame buffer */
 		} else {
@@ -112,6 +166,43 @@ Proc_IMX_EXT_GetPixmapPhysAddr(ClientPtr client)
 	return client->noClientException;
 }
 
+typedef struct {
+	XID		pixmap;
+	XID		id;
+} IMX_EXT_FindPinRec;
+
+static void
+IMX_EXT_FindPin(pointer value, XID id, pointer cdata)
+{
+	IMX_EXT_PinRec* pin = (IMX_EXT_PinRec*)value;
+	IMX_EXT_FindPinRec* find = (IMX_EXT_FindPinRec*)cdata;
+
+	if (pin->pixmap == find->pixmap && 0 == find->id)
+		find->id = id;
+}
+
+static int
+Proc_IMX_EXT_ReleasePixmapPhysAddr(ClientPtr client)
+{
+	REQUEST(xIMX_EXT_ReleasePixmapPhysAddrReq);
+	REQUEST_SIZE_MATCH(xIMX_EXT_ReleasePixmapPhysAddrReq);
+
+	/* Find one of the pins this client holds on the pixmap, by the XID it was pinned by; */
+	/* the pixmap may have been freed by the client since, yet stays alive for the pin. */
+	IMX_EXT_FindPinRec find = { stuff->pixmap, 0 };
+	FindClientResourcesByType(client, RT_IMX_EXT_PIN, IMX_EXT_FindPin, &find);
+
+	if (0 == find.id)
+	{
+		client->errorValue = stuff->pixmap;
+		return BadValue;
+	}
+
+	/* Freeing the resource releases the pin */
+	FreeResource(find.id, RT_NONE);
+	return Success;
+}
+
 static int
 Proc_IMX_EXT_Dispatch(ClientPtr client)
 {
@@ -120,6 +211,8 @@ Proc_IMX_EXT_Dispatch(ClientPtr client)
 	{
 		case X_IMX_EXT_GetPixmapPhysAddr:
 			return Proc_IMX_EXT_GetPixmapPhysAddr(client);
+		case X_IMX_EXT_ReleasePixmapPhysAddr:
+			return Proc_IMX_EXT_ReleasePixmapPhysAddr(client);
 		default:
 			return BadRequest;
 	}
@@ -139,6 +232,20 @@ SProc_IMX_EXT_GetPixmapPhysAddr(ClientPtr client)
 	return Proc_IMX_EXT_GetPixmapPhysAddr(client);
 }
 
+static int
+SProc_IMX_EXT_ReleasePixmapPhysAddr(ClientPtr client)
+{
+	int n;
+
+	REQUEST(xIMX_EXT_ReleasePixmapPhysAddrReq);
+
+	compat_swaps(&stuff->length, n);
+	REQUEST_SIZE_MATCH(xIMX_EXT_ReleasePixmapPhysAddrReq);
+
+	compat_swapl(&stuff->pixmap, n);
+	return Proc_IMX_EXT_ReleasePixmapPhysAddr(client);
+}
+
 static int
 SProc_IMX_EXT_Dispatch(ClientPtr client)
 {
@@ -147,6 +254,8 @@ SProc_IMX_EXT_Dispatch(ClientPtr client)
 	{
 		case X_IMX_EXT_GetPixmapPhysAddr:
 			return SProc_IMX_EXT_GetPixmapPhysAddr(client);
+		case X_IMX_EXT_ReleasePixmapPhysAddr:
+			return SProc_IMX_EXT_ReleasePixmapPhysAddr(client);
 		default:
 			return BadRequest;
 	}
@@ -33,6 +33,7 @@
 #define	IMX_EXT_NumEvents	0
 
 #define	X_IMX_EXT_GetPixmapPhysAddr	1
+#define	X_IMX_EXT_ReleasePixmapPhysAddr	2
 
 /************************************************************************/
 
@@ -65,6 +66,23 @@ typedef struct {
 } xIMX_EXT_GetPixmapPhysAddrReply;
 #define	sz_xIMX_EXT_GetPixmapPhysAddrReply 32
 
+/*
+ * A successful GetPixmapPhysAddr pins the pixmap at its physical address
+ * until the client releases the pin, or disconnects. Pins are counted;
+ * each successful GetPixmapPhysAddr takes one, each Release gives one back.
+ * Release names the pixmap by the XID it was pinned by, and may come after
+ * the client has freed that pixmap: a pin keeps the pixmap alive, so the
+ * usual order of GetPixmapPhysAddr, FreePixmap, ReleasePixmapPhysAddr
+ * works as well as releasing before freeing.
+ */
+typedef struct {
+    CARD8	reqType;	/* always XTestReqCode */
+    CARD8	xtReqType;	/* always X_IMX_EXT_ReleasePixmapPhysAddr */
+    CARD16	length B16;
+    Pixmap	pixmap B32;
+} xIMX_EXT_ReleasePixmapPhysAddrReq;
+#define sz_xIMX_EXT_ReleasePixmapPhysAddrReq 8
+
 /************************************************************************/
 
 #undef Pixmap
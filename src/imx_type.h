@@ -60,6 +60,20 @@ typedef enum {
 	OPTION_COMPOSITING,
 	OPTION_XV_BILINEAR,
 	OPTION_XV_DOUBLEFB,
+	OPTION_EVICTION_POLICY,
+	OPTION_COMPRESS_EVICTED,
+	OPTION_COMPRESS_EVICTED_MIN_KB,
+	OPTION_MIN_SURF_AREA,
+	OPTION_MIN_SURF_HEIGHT,
+	OPTION_MAX_SURF_DIM,
+	OPTION_PIXMAP_ATLAS,
+	OPTION_GPUMEM_BUDGET_KB,
+	OPTION_GPUMEM_HIGH_WATERMARK,
+	OPTION_GPUMEM_LOW_WATERMARK,
+	OPTION_GPUMEM_DEFRAG,
+	OPTION_VIDMEM_HEAP,
+	OPTION_CPU_SMALL_OPS,
+	OPTION_CPU_OP_COSTS,
 	OPTION_DEBUG,
 } IMXOpts;
 
@@ -123,31 +137,298 @@ typedef struct {
 /* Private data for the EXA driver. */
 typedef struct _IMXEXAPixmapRec *IMXEXAPixmapPtr;
 
+#define IMXEXA_CACHE_LINE_BYTES		64U			/* L1 cache line size of the targets */
+#define IMXEXA_PIXMAP_SLAB_BYTES	(16U * 1024U)	/* Size of the slabs pixmap records are carved from. */
+
+#define IMXEXA_SURF_POOL_ENTRIES	32U			/* Max number of recycled surfaces kept around. */
+
+/* Classes of driver memory accounted for by residency of the owning pixmap. */
+typedef enum {
+
+	IMXEXA_RESIDENCY_GPU = 0,					/* gpumem of pixmaps subject to eviction */
+	IMXEXA_RESIDENCY_PINNED,					/* gpumem of pixmaps exempt from eviction */
+	IMXEXA_RESIDENCY_EVICTED,					/* sysmem backup of evicted pixmaps */
+
+	IMXEXA_RESIDENCY_COUNT
+
+} imxexa_residency_t;
+
+/* Where a new pixmap goes, as decided by the placement policy. */
+typedef enum {
+
+	IMXEXA_PLACEMENT_SYSMEM = 0,				/* system memory */
+	IMXEXA_PLACEMENT_GPUMEM_IF_FREE,			/* gpumem, unless that requires evicting other pixmaps */
+	IMXEXA_PLACEMENT_GPUMEM,					/* gpumem, evicting other pixmaps if need be */
+	IMXEXA_PLACEMENT_ATLAS						/* sub-surface of a shared atlas surface in gpumem */
+
+} imxexa_placement_t;
+
+/* Eviction priority classes, from first to last evicted. */
+typedef enum {
+
+	IMXEXA_PRIORITY_SCRATCH = 0,				/* short-lived scratch pixmaps */
+	IMXEXA_PRIORITY_NORMAL,
+	IMXEXA_PRIORITY_GLYPH,						/* glyph caches, heavily reused */
+	IMXEXA_PRIORITY_BACKING,					/* backing pixmaps of redirected windows */
+
+	IMXEXA_PRIORITY_COUNT
+
+} imxexa_priority_t;
+
+#define IMXEXA_GPUMEM_FORMAT_COUNT	5U			/* 8, 0565, 888, 8888 and other surface formats */
+#define IMXEXA_GPUMEM_USAGE_COUNT	5U			/* nil, scratch, backing, glyph and other usage hints */
+
+struct _IMXEXARec;
+
+/* Policy for choosing which pixmaps to evict from gpumem when an allocation runs out of memory. */
+typedef struct {
+	const char*						name;
+
+	/* Desirability of pixmap as an eviction victim; pixmaps of higher scores get evicted first. */
+	double							(*score)(const struct _IMXEXARec* fPtr, const struct _IMXEXAPixmapRec* fPixmapPtr);
+} IMXEXAEvictionPolicyRec;
+
+#define IMXEXA_VIDMEM_MAX_BLOCKS	256U		/* Max number of free blocks in the vidmem heap. */
+
+/* Free block of the heap over the spare framebuffer memory; offsets relative to the framebuffer start. */
+typedef struct {
+	unsigned						offset;
+	unsigned						size;
+} IMXEXAVidmemBlockRec;
+
+#define IMXEXA_ROP4_COPY			0xccccU		/* C2D raster op of a plain copy, source to destination. */
+
+#define IMXEXA_BATCH_MAX_RECTS		64U			/* Max number of rects of a Solid or Copy op held back for drawing at once. */
+
+/* Rect of a Solid or Copy op held back; src coordinates matter to Copy only. */
+typedef struct {
+	BoxRec							dst;
+	int								srcX;
+	int								srcY;
+} IMXEXABatchRectRec;
+
+#define IMXEXA_ATLAS_MAX_SHELVES	64U			/* Max number of shelves per atlas. */
+#define IMXEXA_ATLAS_MAX_COUNT		8U			/* Max number of atlases around. */
+
+/* Horizontal strip of an atlas, filled left to right with sub-surfaces of similar heights. */
+typedef struct {
+	unsigned short					y;
+	unsigned short					height;
+	unsigned short					x;			/* fill cursor */
+	unsigned short					count;		/* number of live sub-surfaces */
+} IMXEXAAtlasShelfRec;
+
+/* Large gpumem surface shared by the surfaces of small pixmaps, sub-allocated by a shelf packer. */
+typedef struct {
+	C2D_SURFACE_DEF					surfDef;
+	C2D_SURFACE						surf;		/* NULL if atlas slot is unused */
+	unsigned						top;		/* number of rows taken by shelves */
+	unsigned						liveCount;
+	unsigned						liveArea;	/* pixels taken by live sub-surfaces */
+	unsigned						shelfCount;
+	IMXEXAAtlasShelfRec				shelf[IMXEXA_ATLAS_MAX_SHELVES];
+} IMXEXAAtlasRec, *IMXEXAAtlasPtr;
+
+/* Recently released pixmap surface, kept for recycling by later pixmaps of matching geometry. */
+typedef struct {
+	C2D_SURFACE_DEF					surfDef;
+	C2D_SURFACE						surf;
+	uint64_t						stamp;		/* heartbeat at the time of release */
+	uint64_t						gpuSerial;	/* serial of the batch holding the last GPU op on the surface */
+} IMXEXASurfPoolEntryRec;
+
+/* C2D context state shadowed by the driver, one slot per filtered setter */
+typedef enum {
+	IMXEXA_STATE_DST_SURFACE,
+	IMXEXA_STATE_SRC_SURFACE,
+	IMXEXA_STATE_BRUSH_SURFACE,
+	IMXEXA_STATE_MASK_SURFACE,
+	IMXEXA_STATE_BLEND_MODE,
+	IMXEXA_STATE_DITHER,
+	IMXEXA_STATE_STRETCH_MODE,
+	IMXEXA_STATE_ROP,
+	IMXEXA_STATE_COUNT
+} imxexa_state_t;
+
+/* Last values set on the C2D context, for skipping setters that would change nothing */
+typedef struct {
+	C2D_SURFACE						dstSurf;
+	C2D_SURFACE						srcSurf;
+	C2D_SURFACE						brushSurf;
+	C2D_SURFACE						maskSurf;
+	C2D_ALPHA_BLEND_MODE			blendMode;
+	int								dither;
+	C2D_STRETCH_MODE				stretchMode;
+	unsigned						rop;
+	unsigned						valid;		/* mask of slots known to match the context, by imxexa_state_t */
+} IMXEXAContextStateRec;
+
 typedef struct _IMXEXARec {
 
 	C2D_CONTEXT		gpuContext;
 	Bool			gpuSynced;
+	IMXEXAContextStateRec	ctxState;
+
+	/* Submission of queued draws to the GPU in batches */
+	unsigned		pendingDraws;				/* draws queued since the last flush */
+	unsigned long	numDraws;
+	unsigned long	numFlushes;
+	unsigned long	flushRateBase;				/* number of flushes at the start of the rate window */
+	unsigned long	flushRateStamp;				/* time in ms at the start of the rate window */
+	unsigned		flushesPerSec;				/* rate over the last complete window */
+	unsigned		flushesPerSecMax;
+
+	/* Rects of the current Solid or Copy op, merged where possible and drawn at once */
+	Bool			batchBlit;					/* rects are drawn by blit rather than by fill */
+	unsigned		batchCount;
+	IMXEXABatchRectRec	batch[IMXEXA_BATCH_MAX_RECTS];
+
+	/* Routing of small Solid, Copy and Composite rects to the CPU by a cost model */
+	Bool			cpuSmallOps;
+	unsigned		costGpuDraw;				/* ns per GPU draw, including its share of a flush */
+	unsigned		costLock;					/* ns per lock plus unlock of a surface */
+	unsigned		costCpuFill;				/* ps per pixel filled by the CPU */
+	unsigned		costCpuCopy;				/* ps per pixel copied by the CPU out of gpumem */
+	Bool			opCpuCapable;				/* current op can be done by the CPU at all */
+	Bool			opOnGpu;					/* a rect of the current op went to the GPU; the rest follow */
+	Pixel			solidColor;					/* fill value of the current Solid op */
+
+	/* X raster ops done by the GPU, as masks by 1 << alu; the rest fall back to fb */
+	unsigned		solidAlus;
+	unsigned		copyAlus;
+
+	/* Planemask of the current Solid or Copy op, written through in several passes */
+	Bool			opMasked;
+	Pixel			planemask;
+	Pixel			maskedAnd;					/* Solid: dst bits kept by the first pass */
+	Pixel			maskedXor;					/* Solid: dst bits flipped by the second pass */
+	int				maskedAlu;					/* Copy: alu of the pass drawing op(src, dst) ^ dst into scratch */
+
+	/* Serials of the flushed batches of draws; the batch being queued is one past the flushed one */
+	uint64_t		flushSerial;				/* serial of the last flushed batch */
+	uint64_t		retiredSerial;				/* serial of the last batch known to be done by the GPU */
+	uint64_t		releasedSerial;				/* latest serial of pixmaps whose atlas or vidmem space got released */
 
 	/* GPU surface for the screen */
 	C2D_SURFACE_DEF	screenSurfDef;
 	C2D_SURFACE		screenSurf;
 	C2D_SURFACE		doubleSurf;					/* for fullscreen double-buffering clients, eg. XV adaptor */
+	C2D_SURFACE_DEF	scratchSurfDef;
+	C2D_SURFACE		scratchSurf;				/* for bouncing overlapping copies through, allocated on demand */
 
 	/* Parameters originating from PrepareComposite and going into Composite */
 	Bool			composRepeat;
 	Bool			composConvert;
+	Bool			composCopy;					/* composite amounts to a plain copy */
+	int				composOp;					/* Porter-Duff op of the composite, reduced as per imxexa_reduce_pict_op */
+	unsigned		composOps;					/* Porter-Duff ops done by the GPU, as a mask by 1 << op */
+
+	/* Composites with a mask of component alpha, done by the CPU through pixman on rows read out of gpumem */
+	Bool			composCA;
+	CARD32			composSrcFormat;
+	CARD32			composMskFormat;
+	CARD32			composDstFormat;
+	int				composSrcRepeat;			/* repeat type of src, RepeatNone if not repeating */
+	void*			caRows;						/* cached copies of the rows being composited, allocated on demand */
 
 	/* Pixmap parameters passed into Prepare{Solid,Copy,Composite} */
 	IMXEXAPixmapPtr	pPixDst;
 	IMXEXAPixmapPtr	pPixSrc;
 	IMXEXAPixmapPtr	pPixMsk;
 
-	IMXEXAPixmapPtr	pFirstPix;					/* header of the list of driver-allocated pixmaps, sorted by MRU */
-	IMXEXAPixmapPtr pFirstEvictionCandidate;	/* header of the list of LRU-sorted pixmaps, AKA tail of the above */
+	IMXEXAPixmapPtr	pFirstPix;					/* header of the circular list of driver-allocated pixmaps */
+	IMXEXAPixmapPtr	pLastPix;					/* tail of the above */
+	IMXEXAPixmapPtr	pClockHand;					/* next pixmap in the list examined for eviction; NULL for the head */
+	void*			pPixSlabs;					/* list of slabs of pixmap records, linked via their first word */
+	IMXEXAPixmapPtr	pFreePixRecs;				/* list of free pixmap records, linked via next */
 	uint64_t		heartbeat;					/* counter incremented with each eax op */
 
+	const IMXEXAEvictionPolicyRec*	evictionPolicy;
+
+	/* Pool of recycled pixmap surfaces, sorted by age of release, oldest first */
+	IMXEXASurfPoolEntryRec	surfPool[IMXEXA_SURF_POOL_ENTRIES];
+	unsigned		surfPoolCount;
+	unsigned		surfPoolBytes;
+
+	/* Running totals of driver-allocated memory, updated at pixmap state transitions */
+	unsigned		gpumemAllocated;
+	unsigned		gpumemByFormat[IMXEXA_GPUMEM_FORMAT_COUNT];
+	unsigned		gpumemByUsage[IMXEXA_GPUMEM_USAGE_COUNT];
+	unsigned		memByResidency[IMXEXA_RESIDENCY_COUNT];
+
+	/* Placement policy thresholds */
+	int				minSurfArea;				/* min pixmap area in pixels to go in gpumem */
+	int				minSurfHeight;
+	int				maxSurfDim;
+	uint64_t		lastEvictionStamp;			/* heartbeat at the last allocation that had to evict */
+
+	/* Budget of gpumem, enforced by evicting cold pixmaps while the server is idle */
+	unsigned		gpumemBudget;				/* 0 if none */
+	unsigned		gpumemHighMark;				/* idle eviction starts above this */
+	unsigned		gpumemLowMark;				/* idle eviction stops at this */
+	Bool			idleEvicting;
+	uint64_t		idleStallStamp;				/* heartbeat at the last idle eviction pass that freed nothing */
+
+	/* Compaction of gpumem at idle time, driven by the fragmentation of its free space */
+	Bool			defragGpumem;
+	Bool			defragmenting;
+	uint64_t		defragCheckStamp;			/* heartbeat at the last fragmentation check */
+	unsigned		gpumemFreeTotal;			/* free gpumem found by the last check */
+	unsigned		gpumemFreeLargest;			/* largest free block found by the last check */
+
+	/* Atlases for the surfaces of small pixmaps */
+	Bool			useAtlas;
+	IMXEXAAtlasRec	atlas[IMXEXA_ATLAS_MAX_COUNT];
+	unsigned		atlasBytes;
+
+	/* Heap over the framebuffer memory past the virtual screen, for surfaces of pixmaps */
+	Bool			useVidmem;
+	void*			vidmemBuffer;				/* phys and virtual address of the framebuffer start */
+	void*			vidmemHost;
+	unsigned		vidmemSize;					/* bytes in the heap, 0 if none */
+	unsigned		vidmemFree;					/* bytes in the free blocks */
+	unsigned		vidmemLiveCount;			/* number of surfaces in the heap */
+	unsigned		vidmemBlockCount;
+	IMXEXAVidmemBlockRec	vidmemBlock[IMXEXA_VIDMEM_MAX_BLOCKS];	/* free blocks, by ascending offset */
+
+	/* Compression of the sysmem backups of evicted pixmaps */
+	Bool			packEvicted;
+	unsigned		packMinBytes;				/* smallest backup worth compressing */
+	unsigned		packedBackups;				/* running totals over backups currently held compressed */
+	unsigned		packedRawBytes;
+	unsigned		packedBytes;
+
+	/* Migrations of pixmaps between sysmem and gpumem driven by their acceleration record */
+	unsigned long	numPromotions;
+	unsigned long	numDemotions;
+
 #if IMX_DEBUG_MASTER
 	uint32_t		gpumem_watermark;
+	unsigned long	numPixSlabs;
+	unsigned long	numSurfPoolHits;
+	unsigned long	numSurfPoolMisses;
+	unsigned long	numSurfPoolDrops;
+	unsigned long	numEvictingAllocs;			/* allocations that had to evict to succeed */
+	unsigned long	numEvictedPixmaps;
+	unsigned long	numEvictedUnmapped;			/* evicted pixmaps that had to be access-locked first */
+	uint64_t		evictedBytesTotal;
+	unsigned		evictedBytesMax;			/* most bytes evicted by a single allocation */
+	unsigned long	numCleanEvictions;			/* evictions of pixmaps whose backup was up to date */
+	uint64_t		evictedBytesCopied;
+	uint64_t		reinstatedBytesCopied;
+	unsigned long	numIdleEvictedPixmaps;
+	uint64_t		idleEvictedBytes;
+	unsigned long	numDefragPasses;
+	unsigned long	numRelocatedPixmaps;
+	uint64_t		relocatedBytes;
+	unsigned long	numPackAttempts;
+	unsigned long	numPackRejects;				/* backups that didn't compress well enough */
+	unsigned long	numUnpacks;
+	unsigned long	numAtlasAllocs;
+	unsigned long	numAtlasFailures;			/* small pixmaps that didn't fit in any atlas */
+	unsigned long	numAtlasRepacks;
+	unsigned long	numVidmemAllocs;
+	unsigned long	numVidmemFailures;			/* pixmap surfaces that didn't fit in the vidmem heap */
 	unsigned long	numSolidBeforeSync;
 	unsigned long	numCopyBeforeSync;
 	unsigned long	numConvBeforeSync;
@@ -155,6 +436,18 @@ typedef struct _IMXEXARec {
 	unsigned long	numAccessBeforeSync;
 	unsigned long	numUploadBeforeSync;
 	unsigned long	numDnloadBeforeSync;
+	unsigned long	numBatchedRects;			/* rects passed to Solid and Copy */
+	unsigned long	numMergedRects;				/* of the above, merged into a neighbour */
+	unsigned long	numBatchSubmits;
+	unsigned long	numOverlapBanded;			/* overlapping copies split in bands */
+	unsigned long	numOverlapBounced;			/* overlapping copies bounced through the scratch surface */
+	unsigned long	numCpuRects;				/* Solid, Copy and Composite rects done by the CPU */
+	unsigned long	numCpuRectsCA;				/* of the above, composites with a mask of component alpha */
+	unsigned long	numMaskedSolids;			/* Solid ops with a planemask done by the GPU rather than fb */
+	unsigned long	numMaskedCopies;			/* Copy ops with a planemask done by the GPU rather than fb */
+	unsigned long	numMaskedFallbacks;			/* Solid and Copy ops left to fb for their planemask */
+	unsigned long	numStateIssued[IMXEXA_STATE_COUNT];
+	unsigned long	numStateSkipped[IMXEXA_STATE_COUNT];
 #endif
 
 } IMXEXARec, *IMXEXAPtr;
@@ -165,29 +458,55 @@ typedef struct _IMXEXARec {
 
 typedef struct _IMXEXAPixmapRec {
 
-	/* Properties for pixmap header passed in CreatePixmap2. */
+	/* Hot fields, touched by every Prepare*; they fill the first cache line on 32-bit targets. */
+	uint64_t		stamp;			/* updated at use to the heartbeat of exa ops; see PIXMAP_STAMP_* */
+	C2D_SURFACE		surf;			/* genuine surface */
+	C2D_SURFACE		alias;			/* own-pixel-format alias/proxy of the above */
+	void*			surfPtr;		/* ptr to surface buffer (VA) used by lazy unlock */
 	int				width;
 	int				height;
-	int				depth;
 	int				bitsPerPixel;
+	unsigned 		n_uses;			/* number of successful acceleration ops pixmap participated in */
+	unsigned 		n_failures;		/* number of failed acceleration ops pixmap participated in */
+	Bool			referenced;		/* used since last passed by the clock hand */
+	Bool			demoted;		/* evicted for causing fallbacks; stays in sysmem until hot again */
+
+	/* Content tracking for the sysmem backup of offscreen pixmaps. */
+	BoxRec			dirty;			/* extents of surface content not reflected in the backup */
+	BoxRec			defined;		/* extents of content ever written; pixels outside are undefined */
+
+	/* Cold fields from here on. */
+
+	/* Properties for pixmap header passed in CreatePixmap2. */
+	int				depth;
+	int				usage;			/* usage hint */
+	imxexa_priority_t	priority;	/* eviction priority class */
 
 	/* Properties for pixmap allocated from offscreen memory. */
 	C2D_SURFACE_DEF	surfDef;		/* genuine surface definition */
-	C2D_SURFACE		surf;			/* genuine surface */
-	C2D_SURFACE		alias;			/* own-pixel-format alias/proxy of the above */
-	void*			surfPtr;		/* ptr to surface buffer (VA) used by lazy unlock */
-	uint64_t		stamp;			/* updated at use to the heartbeat of exa ops; see PIXMAP_STAMP_* */
+	unsigned		pinCount;		/* number of outstanding pins; pixmap stamped pinned while non-zero */
+	IMXEXAAtlasPtr	atlas;			/* atlas hosting the surface, if any */
+	unsigned short	atlasShelf;		/* shelf and column of the surface within the atlas */
+	unsigned short	atlasX;
+	unsigned		vidmemOffset;	/* block of the vidmem heap hosting the surface, if size is non-zero */
+	unsigned		vidmemBytes;
 
-	/* Offscreen pixmap quality metrics */
-	unsigned 		n_uses;			/* number of successful acceleration ops pixmap participated in */
-	unsigned 		n_failures;		/* number of failed acceleration ops pixmap participated in */
+	/* Migration metrics */
+	unsigned		heat;			/* decaying count of acceleration requests while in sysmem */
+	uint64_t		heatStamp;		/* heartbeat at last update of the above */
+	uint64_t		migrateStamp;	/* heartbeat at last promotion or demotion */
+
+	/* GPU access tracking */
+	uint64_t		gpuSerial;		/* serial of the batch holding the last GPU op on the pixmap */
 
 	/* Properties for pixmap allocated from system memory. */
 	void*			sysPtr;			/* ptr to sys memory alloc */
 	int				sysPitchBytes;	/* bytes per row */
+	void*			packPtr;		/* compressed copy of the backup, if any */
+	unsigned		packBytes;
 
 	IMXEXAPixmapPtr	prev;
-	IMXEXAPixmapPtr	next;
+	IMXEXAPixmapPtr	next;			/* also links free records in the slab allocator */
 
 } IMXEXAPixmapRec;
 
@@ -197,56 +197,61 @@ extern const char*
 imxexa_string_from_c2d_format(
 	C2D_COLORFORMAT format);
 
-static inline unsigned
-imxxv_bpp_from_c2d_format(
-	C2D_COLORFORMAT format)
-{
-	switch (format) {
-
-	/* 1bpp formats */
-	case C2D_COLOR_A1:
-		return 1;
-
-	/* 4bpp formats */
-	case C2D_COLOR_A4:
-		return 4;
-
-	/* 8bpp formats */
-	case C2D_COLOR_A8:
-	case C2D_COLOR_8:
-		return 8;
-
-	/* 16bpp formats */
-	case C2D_COLOR_4444:
-	case C2D_COLOR_4444_RGBA:
-	case C2D_COLOR_1555:
-	case C2D_COLOR_5551_RGBA:
-	case C2D_COLOR_0565:
-		return 16;
-
-	/* 32bpp formats */
-	case C2D_COLOR_8888:
-	case C2D_COLOR_8888_RGBA:
-	case C2D_COLOR_8888_ABGR:
-		return 32;
-
-	/* 24bpp formats */
-	case C2D_COLOR_888:
-		return 24;
-
-	/* 16bpp formats */
-	case C2D_COLOR_YVYU:
-	case C2D_COLOR_UYVY:
-	case C2D_COLOR_YUY2:
-		return 16;
-
-	/* Pacify the compiler. */
-	default:
-		break;
-	}
+extern unsigned
+imxexa_bpp_from_c2d_format(
+	C2D_COLORFORMAT format);
 
-	return 0;
-}
+extern void
+imxexa_mark_pixmap_dirty(
+	IMXEXAPixmapPtr fPixmapPtr,
+	int x1, int y1,
+	int x2, int y2);
+
+/* Setters of the C2D context state that skip redundant changes; see imx_exa_c2d.c. */
+extern C2D_STATUS
+imxexa_set_dst_surface(
+	IMXEXAPtr imxexaPtr,
+	C2D_SURFACE surf);
+
+extern C2D_STATUS
+imxexa_set_src_surface(
+	IMXEXAPtr imxexaPtr,
+	C2D_SURFACE surf);
+
+extern C2D_STATUS
+imxexa_set_brush_surface(
+	IMXEXAPtr imxexaPtr,
+	C2D_SURFACE surf);
+
+extern C2D_STATUS
+imxexa_set_mask_surface(
+	IMXEXAPtr imxexaPtr,
+	C2D_SURFACE surf);
+
+extern C2D_STATUS
+imxexa_set_blend_mode(
+	IMXEXAPtr imxexaPtr,
+	C2D_ALPHA_BLEND_MODE mode);
+
+extern C2D_STATUS
+imxexa_set_dither(
+	IMXEXAPtr imxexaPtr,
+	int dither);
+
+extern C2D_STATUS
+imxexa_set_stretch_mode(
+	IMXEXAPtr imxexaPtr,
+	C2D_STRETCH_MODE mode);
+
+extern C2D_STATUS
+imxexa_set_rop(
+	IMXEXAPtr imxexaPtr,
+	unsigned rop);
+
+extern C2D_STATUS
+imxexa_free_c2d_surface(
+	IMXEXAPtr imxexaPtr,
+	C2D_SURFACE surf);
 
 static inline const char*
 imxxv_string_from_c2d_surface(
@@ -276,7 +281,7 @@ imxxv_string_from_unalloc_c2d_surface(
 		imxexa_string_from_c2d_format(surfDef->format),
 		surfDef->width,
 		surfDef->height,
-		surfDef->width * surfDef->height * imxxv_bpp_from_c2d_format(surfDef->format) / 8);
+		surfDef->width * surfDef->height * imxexa_bpp_from_c2d_format(surfDef->format) / 8);
 
 	return buf;
 }
@@ -304,14 +309,14 @@ imxxv_delete_port_surface(
 {
 	IMXEXAPtr imxexaPtr = IMXEXAPTR(imxPtr);
 
-	c2dSurfFree(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surf);
+	imxexa_free_c2d_surface(imxexaPtr, imxPtr->xvPort[port_idx].surf);
 
 	imxPtr->xvPort[port_idx].surf = NULL;
 	memset(&imxPtr->xvPort[port_idx].surfDef, 0, sizeof(imxPtr->xvPort[port_idx].surfDef));
 
 	if (NULL != imxPtr->xvPort[port_idx].surfAux) {
 
-		c2dSurfFree(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surfAux);
+		imxexa_free_c2d_surface(imxexaPtr, imxPtr->xvPort[port_idx].surfAux);
 		imxPtr->xvPort[port_idx].surfAux = NULL;
 	}
 
@@ -447,19 +452,24 @@ imxxv_seek_mapping(
 
 static inline void
 imxxv_fill_surface(
-	const C2D_CONTEXT context,
+	const IMXEXAPtr imxexaPtr,
 	const C2D_SURFACE surf,
 	const uint32_t color)
 {
+	const C2D_CONTEXT context = imxexaPtr->gpuContext;
+
 	C2D_RECT rect = {
 		0, 0, 2048, 2048
 	};
 
-	c2dSetDstSurface(context, surf);
-	c2dSetSrcSurface(context, NULL);
-	c2dSetBrushSurface(context, NULL, NULL);
-	c2dSetMaskSurface(context, NULL, NULL);
-	c2dSetBlendMode(context, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_dst_surface(imxexaPtr, surf);
+	imxexa_set_src_surface(imxexaPtr, NULL);
+	imxexa_set_brush_surface(imxexaPtr, NULL);
+	imxexa_set_mask_surface(imxexaPtr, NULL);
+	imxexa_set_blend_mode(imxexaPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_dither(imxexaPtr, 0);
+	imxexa_set_stretch_mode(imxexaPtr, C2D_STRETCH_POINT_SAMPLING);
+	imxexa_set_rop(imxexaPtr, IMXEXA_ROP4_COPY);
 	c2dSetDstRectangle(context, &rect);
 	c2dSetFgColor(context, color);
 
@@ -610,7 +620,7 @@ IMXXVPutImage(
 #endif /* IMXXV_SURF_ALLOC_DEBUG */
 
 		/* Wipe out the new surface to YUY2 black. */
-		imxxv_fill_surface(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surf, 0x800000U);
+		imxxv_fill_surface(imxexaPtr, imxPtr->xvPort[port_idx].surf, 0x800000U);
 
 		if (width > IMXXV_MAX_BLIT_COORD) {
 
@@ -784,24 +794,23 @@ IMXXVPutImage(
 	/* Surface updated, unlock it. */
 	c2dSurfUnlock(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surf);
 
-	/* Set various static draw parameters. */
-	c2dSetBrushSurface(imxexaPtr->gpuContext, NULL, NULL);
-	c2dSetMaskSurface(imxexaPtr->gpuContext, NULL, NULL);
+	/* Set various static draw parameters; those left over from the previous frame stay as they are. */
+	imxexa_set_brush_surface(imxexaPtr, NULL);
+	imxexa_set_mask_surface(imxexaPtr, NULL);
 
-	c2dSetBlendMode(imxexaPtr->gpuContext, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_blend_mode(imxexaPtr, C2D_ALPHA_BLEND_NONE);
+	imxexa_set_rop(imxexaPtr, IMXEXA_ROP4_COPY);
 
 	const Bool dither_blit = 16 == pScrn->bitsPerPixel;
 
-	if (dither_blit)
-		c2dSetDither(imxexaPtr->gpuContext, 1);
+	imxexa_set_dither(imxexaPtr, dither_blit);
 
 	const Bool stretch_blit = imxPtr->use_bilinear_filtering ?
 		(src_w != drw_w || src_h != drw_h) : FALSE;
 
-	if (stretch_blit) {
-		c2dSetStretchMode(imxexaPtr->gpuContext, C2D_STRETCH_BILINEAR_SAMPLING);
-		/* c2d_z160: the above seems to set the _general_ sampling, not just at stretching. */
-	}
+	/* c2d_z160: this seems to set the _general_ sampling, not just at stretching. */
+	imxexa_set_stretch_mode(imxexaPtr, stretch_blit ?
+		C2D_STRETCH_BILINEAR_SAMPLING : C2D_STRETCH_POINT_SAMPLING);
 
 	C2D_RECT rectDst = {
 		.x = drw_x,
@@ -905,9 +914,9 @@ IMXXVPutImage(
 			imxPtr->xvBufferTracker ^= 1;
 
 		if (full_screen && imxPtr->xvBufferTracker)
-			c2dSetDstSurface(imxexaPtr->gpuContext, imxexaPtr->doubleSurf);
+			imxexa_set_dst_surface(imxexaPtr, imxexaPtr->doubleSurf);
 		else
-			c2dSetDstSurface(imxexaPtr->gpuContext, surfDst);
+			imxexa_set_dst_surface(imxexaPtr, surfDst);
 
 		if (!full_screen) {
 
@@ -917,8 +926,8 @@ IMXXVPutImage(
 	}
 	else {
 
-		c2dSetDstSurface(imxexaPtr->gpuContext, surfDst);
-		c2dSetSrcSurface(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surf);
+		imxexa_set_dst_surface(imxexaPtr, surfDst);
+		imxexa_set_src_surface(imxexaPtr, imxPtr->xvPort[port_idx].surf);
 
 		c2dSetSrcRectangle(imxexaPtr->gpuContext, &rectSrc);
 		c2dSetDstRectangle(imxexaPtr->gpuContext, &rectDst);
@@ -952,7 +961,7 @@ IMXXVPutImage(
 				rectClip.x < rectDst.x + rectDst.width &&
 				rectClip.y < rectDst.y + rectDst.height) {
 
-				c2dSetSrcSurface(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surf);
+				imxexa_set_src_surface(imxexaPtr, imxPtr->xvPort[port_idx].surf);
 
 				c2dSetSrcRectangle(imxexaPtr->gpuContext, &rectSrc);
 				c2dSetDstRectangle(imxexaPtr->gpuContext, &rectDst);
@@ -971,7 +980,7 @@ IMXXVPutImage(
 				continue;
 			}
 
-			c2dSetSrcSurface(imxexaPtr->gpuContext, imxPtr->xvPort[port_idx].surfAux);
+			imxexa_set_src_surface(imxexaPtr, imxPtr->xvPort[port_idx].surfAux);
 
 			c2dSetSrcRectangle(imxexaPtr->gpuContext, &rectSrcAux);
 			c2dSetDstRectangle(imxexaPtr->gpuContext, &rectDstAux);
@@ -983,17 +992,9 @@ IMXXVPutImage(
 			break;
 	}
 
-	/* Reset clipping and various static draw parameters. */
+	/* Reset clipping; dithering and sampling get reset by the EXA ops that care, if any come before the next frame. */
 	c2dSetDstClipRect(imxexaPtr->gpuContext, NULL);
 
-	if (dither_blit)
-		c2dSetDither(imxexaPtr->gpuContext, 0);
-
-	if (stretch_blit) {
-		c2dSetStretchMode(imxexaPtr->gpuContext, C2D_STRETCH_POINT_SAMPLING);
-		/* c2d_z160: the above seems to set the _general_ sampling, not just at stretching. */
-	}
-
 	if (C2D_STATUS_OK != r) {
 
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -1002,6 +1003,19 @@ IMXXVPutImage(
 		return BadMatch;
 	}
 
+	/* Let the driver know which part of the drawable pixmap the GPU has written to. */
+	if (!full_screen) {
+
+		const BoxPtr extents = RegionExtents(clipBoxes);
+		const int dx = pxDst->drawable.x - pxDst->screen_x;
+		const int dy = pxDst->drawable.y - pxDst->screen_y;
+
+		imxexa_mark_pixmap_dirty(
+			(IMXEXAPixmapPtr) exaGetPixmapDriverPrivate(pxDst),
+			extents->x1 + dx, extents->y1 + dy,
+			extents->x2 + dx, extents->y2 + dy);
+	}
+
 	/* This is a synchronous movie sequence, show the individual frames on screen ASAP. */
 	/* Note: Using GPU flush effectively doubles the CPU load at presenting a frame, but the */
 	/* frame reaches the screen sooner, as long as the required CPU resource is available. */
@@ -1166,7 +1180,7 @@ IMXXVInitAdaptorC2D(
 
 	/* Wipe out screen's seconday surface to RGB black. */
 	if (imxPtr->use_double_buffering)
-		imxxv_fill_surface(imxexaPtr->gpuContext, imxexaPtr->doubleSurf, 0U);
+		imxxv_fill_surface(imxexaPtr, imxexaPtr->doubleSurf, 0U);
 
 	/* This early during driver init ScrnInfoPtr does not have a valid ScreenPtr yet. */
 	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];